@@ -86,6 +86,7 @@ for v in ivalues(tup.glob(EXECUTABLE_FOLDER .. "*.o")) do
     objfiles += v
     objfiles += tup.glob('src/custom_benchmark/*.o')
     objfiles += tup.glob('src/debug/*.o')
+    objfiles += tup.glob('src/memory/*.o')
     objfiles += tup.glob('src/util/*.o')
     objfiles += tup.glob('libs/benchmark/src/*.o')
     objfiles += tup.glob('libs/gtest/src/*.o')
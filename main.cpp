@@ -7,28 +7,42 @@
 #include <random>
 #include <vector>
 #include <algorithm>
+#include <cstring>
+#include <limits>
+#include <cmath>
 
 #include "custom_benchmark/custom_benchmark.h"
 #include "custom_benchmark/benchmark_graph.h"
 #include <thread>
+#include <functional>
+#include <fstream>
 #include "custom_benchmark/main_gui.hpp"
 #include "math/halton_sequence.hpp"
 #include "custom_benchmark/profile_mode.hpp"
+#include "custom_benchmark/compare.hpp"
+#include "custom_benchmark/run_scheduler.hpp"
 #include "db/benchmark_db.hpp"
+#include "db/result_writer.hpp"
 #include "thread/ticket_mutex.hpp"
+#include "thread/cpu_topology.hpp"
 
-void RunOne(skb::BenchmarkResults & benchmark_data, int64_t argument, bool profile_mode)
+skb::BenchmarkResults::RunAndBaselineResults RunOne(skb::BenchmarkResults & benchmark_data, int64_t argument, bool profile_mode, skb::RunPlacement placement, int64_t block)
 {
+    skb::BenchmarkResults::RunAndBaselineResults result = benchmark_data.Run(argument, profile_mode ? skb::BenchmarkResults::ProfileMode : skb::BenchmarkResults::Normal, placement, block);
+
+    // build the whole line first. other threads are printing at the same time
     std::string message = benchmark_data.categories->CategoriesString();
     message += '/';
     message += std::to_string(argument);
     message += ": ";
-    std::cout << message;
-    std::cout.flush();
-    skb::BenchmarkResults::RunAndBaselineResults result = benchmark_data.Run(argument, profile_mode ? skb::BenchmarkResults::ProfileMode : skb::BenchmarkResults::Normal);
-
-    double nanoseconds = result.results.time.count() / static_cast<double>(result.results.num_iterations);
-    message = std::to_string(static_cast<int64_t>(nanoseconds));
+    if (!result.results)
+    {
+        message += "failed";
+        std::cout << message << std::endl;
+        return result;
+    }
+    double nanoseconds = result.results->time.count() / static_cast<double>(result.results->num_iterations);
+    message += std::to_string(static_cast<int64_t>(nanoseconds));
 
     if (result.baseline_results)
     {
@@ -39,9 +53,9 @@ void RunOne(skb::BenchmarkResults & benchmark_data, int64_t argument, bool profi
         message += std::to_string(static_cast<int64_t>(nanoseconds - baseline_nanoseonds));
     }
 
-    if (result.results.num_items_processed)
+    if (result.results->num_items_processed)
     {
-        double nanoseconds_per_item = result.results.GetNanosecondsPerItem(nullptr);
+        double nanoseconds_per_item = result.results->GetNanosecondsPerItem(nullptr);
         message += " per item: ";
         if (result.baseline_results)
             nanoseconds_per_item -= result.baseline_results->GetNanosecondsPerItem(nullptr);
@@ -49,7 +63,15 @@ void RunOne(skb::BenchmarkResults & benchmark_data, int64_t argument, bool profi
         message += "ns";
     }
 
+    if (result.results->warmup_iterations)
+    {
+        message += " warmup: ";
+        message += std::to_string(result.results->warmup_iterations);
+        message += " iterations";
+    }
+
     std::cout << message << std::endl;
+    return result;
 }
 
 static constexpr size_t NumBenchmarksToKeep = 64;
@@ -60,12 +82,16 @@ void load_from_db(BenchmarkDB & db, interned_string filename)
     // DB on save. Or maybe only delete results for the currently loaded file.
     for (auto & [categories, results] : skb::Benchmark::AllBenchmarks())
     {
-        if (results.executable != filename)
+        // loading the same file again would add all its runs a second time
+        if (results.executable != filename || results.loaded_from_db)
             continue;
-        int benchmark_id = db.GetBenchmarkId(categories);
+        results.loaded_from_db = true;
+        int benchmark_id = db.GetBenchmarkId(results.executable, categories);
         if (benchmark_id == -1)
             continue;
+        db.FillBenchmarkCategories(benchmark_id, categories);
         db.load_result.bind(1, benchmark_id);
+        std::vector<skb::RunResults> loaded;
         while (db.load_result.step())
         {
             int num_iterations = db.load_result.GetInt(0);
@@ -73,7 +99,6 @@ void load_from_db(BenchmarkDB & db, interned_string filename)
             int64_t time = db.load_result.GetInt64(2);
             int64_t num_items_processed = db.load_result.GetInt64(3);
             int64_t num_bytes_used = db.load_result.GetInt64(4);
-            auto & subgroup = results.results[argument];
             skb::RunResults result =
             {
                 num_iterations,
@@ -82,55 +107,29 @@ void load_from_db(BenchmarkDB & db, interned_string filename)
                 static_cast<size_t>(num_items_processed),
                 static_cast<size_t>(num_bytes_used)
             };
-            subgroup.push_back(std::move(result));
-            CHECK_FOR_PROGRAMMER_ERROR(subgroup.size() <= NumBenchmarksToKeep);
-        }
-        for (auto & subgroup : results.results)
-        {
-            skb::BenchmarkResults::MoveMedianToFront(subgroup.second);
+            result.placement.num_parallel_runs = db.load_result.GetInt(5);
+            result.placement.policy = static_cast<skb::RunPlacement::Policy>(db.load_result.GetInt(6));
+            result.timer = static_cast<skb::RunTimer>(db.load_result.GetInt(7));
+            result.warmup_iterations = db.load_result.GetInt64(8);
+            result.warmup_time = std::chrono::nanoseconds(db.load_result.GetInt64(9));
+            result.peak_bytes = static_cast<size_t>(db.load_result.GetInt64(11));
+            result.num_allocations = static_cast<size_t>(db.load_result.GetInt64(12));
+            result.num_threads = db.load_result.GetInt(13);
+            result.thread_time = std::chrono::nanoseconds(db.load_result.GetInt64(14));
+            result.environment.controls = static_cast<uint32_t>(db.load_result.GetInt64(15));
+            result.environment.cpu = db.load_result.GetInt(16);
+            result.block = db.load_result.GetInt64(17);
+            db.ReadCounters(result.counters);
+            db.ReadLatencies(result);
+            loaded.push_back(std::move(result));
         }
         db.load_result.reset();
+        // the benchmark threads may be adding results at the same time, so
+        // there can be more runs than the database keeps
+        results.AddResults(std::move(loaded));
     }
 }
 
-void persist_to_db(BenchmarkDB & db)
-{
-    ska::flat_hash_set<interned_string> all_filenames;
-    for (const auto &[_, results] : skb::Benchmark::AllBenchmarks()) {
-        all_filenames.insert(results.executable);
-    }
-    db.BeginTransaction();
-    for (interned_string filename : all_filenames) {
-        db.DeleteOldResults(filename);
-        db.DeleteOldBenchmarks(filename);
-    }
-    for (auto & [categories, results] : skb::Benchmark::AllBenchmarks())
-    {
-        int benchmark_id = db.AddBenchmark(results.executable, categories);
-        for (auto & group : results.results)
-        {
-            if (group.second.size() > NumBenchmarksToKeep)
-            {
-                std::sort(group.second.begin(), group.second.end(), [](const skb::RunResults & a, const skb::RunResults & b)
-                {
-                    return a.GetNanosecondsPerItem(nullptr) < b.GetNanosecondsPerItem(nullptr);
-                });
-                do
-                {
-                    group.second.pop_back();
-                    group.second.erase(group.second.begin());
-                }
-                while (group.second.size() > NumBenchmarksToKeep);
-            }
-            for (const skb::RunResults & result : group.second)
-            {
-                db.AddResult(benchmark_id, result);
-            }
-        }
-    }
-    db.EndTransaction();
-}
-
 void read_checkbox_state(BenchmarkMainGui & root, BenchmarkDB & db)
 {
     std::map<interned_string, std::map<interned_string, bool, interned_string::pointer_less>, interned_string::pointer_less> state;
@@ -167,10 +166,425 @@ void write_checkbox_state(BenchmarkMainGui & root, BenchmarkDB & db)
     }
 }
 
+// what the benchmark threads ask whoever started them, the gui or the headless
+// runner. all of these get called with the results mutex held
+struct RunLoopCallbacks
+{
+    std::function<bool()> profile_mode;
+    std::function<bool()> interleave_runs;
+    // the benchmarks that an interleaved block may add to the picked one
+    std::function<const std::vector<skb::BenchmarkResults *> &()> candidates;
+    // nullptr if there is nothing to run right now
+    std::function<std::pair<skb::BenchmarkResults *, int64_t>()> get_next_to_run;
+};
+
+// the loop of one benchmark thread, which runs until keep_running goes false.
+// the gui and the headless runner share it so that their results are
+// comparable
+static void RunBenchmarks(int benchmark_cpu, const std::vector<int> & benchmark_cpus, ticket_mutex & results_mutex, skb::RunScheduler & scheduler, ResultWriter & writer, const std::atomic<bool> & keep_running, const RunLoopCallbacks & callbacks)
+{
+    skb::RunPlacement placement;
+    placement.num_parallel_runs = std::max(1, static_cast<int>(benchmark_cpus.size()));
+    if (benchmark_cpu != -1)
+    {
+        // the child processes inherit this
+        if (PinCurrentThread({ benchmark_cpu }))
+        {
+            placement.policy = skb::RunPlacement::DedicatedPhysicalCore;
+            if (benchmark_cpus.size() > 1)
+                skb::BenchmarkResults::SetRunnerCpu(benchmark_cpu);
+        }
+        else
+            std::cout << "Couldn't pin a benchmark thread to cpu " << benchmark_cpu << ". Its results will be marked as unpinned" << std::endl;
+    }
+    // profile mode is one global switch that the child process checks, so only
+    // one thread may run benchmarks while it's on
+    bool may_profile = benchmark_cpu == (benchmark_cpus.empty() ? -1 : benchmark_cpus.front());
+
+    std::mt19937_64 block_order(std::random_device{}());
+    std::vector<skb::BenchmarkResults *> block;
+    while (keep_running)
+    {
+        std::unique_lock<ticket_mutex> lock(results_mutex);
+        bool profile_mode = callbacks.profile_mode();
+        std::pair<skb::BenchmarkResults *, int64_t> next(nullptr, 0);
+        // the graph asks for baselines that it can't draw without, so those
+        // go first. profile runs don't add results, so they'd never arrive
+        std::optional<std::pair<skb::BenchmarkResults *, int64_t>> requested;
+        if (!profile_mode)
+            requested = skb::BenchmarkResults::TakeRequestedRun();
+        if (requested)
+            next = *requested;
+        else if (may_profile || !profile_mode)
+            next = callbacks.get_next_to_run();
+        if (!next.first) {
+            lock.unlock();
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+            continue;
+        }
+        // when interleaving, the point that was picked decides the argument,
+        // and every candidate benchmark that has that argument runs in the block
+        block.assign(1, next.first);
+        int64_t block_id = 0;
+        if (callbacks.interleave_runs() && !profile_mode && !requested)
+        {
+            for (skb::BenchmarkResults * candidate : callbacks.candidates())
+            {
+                if (candidate == next.first)
+                    continue;
+                if (candidate->GetResults()->Find(next.second))
+                    block.push_back(candidate);
+            }
+            std::shuffle(block.begin(), block.end(), block_order);
+            block_id = skb::BenchmarkResults::NewBlockId();
+        }
+        // requested runs are baselines, which the scheduler doesn't pick from.
+        // points that the graph wants first may or may not be candidates, the
+        // scheduler only counts them if they are
+        if (!requested)
+        {
+            for (skb::BenchmarkResults * benchmark : block)
+                scheduler.StartRun({ benchmark, next.second });
+        }
+        lock.unlock();
+        for (skb::BenchmarkResults * benchmark : block)
+        {
+            skb::BenchmarkResults::RunAndBaselineResults result = RunOne(*benchmark, next.second, profile_mode, placement, block_id);
+            if (profile_mode)
+                continue;
+            if (result.results)
+                writer.Add(*benchmark, *result.results);
+            if (result.baseline_results)
+                writer.Add(*benchmark->baseline_results, *result.baseline_results);
+        }
+        lock.lock();
+        if (requested)
+            requested->first->FinishRequestedRun(requested->second);
+        else
+        {
+            for (skb::BenchmarkResults * benchmark : block)
+                scheduler.FinishRun({ benchmark, next.second });
+        }
+    }
+}
+static std::vector<std::thread> StartBenchmarkThreads(const std::vector<int> & benchmark_cpus, ticket_mutex & results_mutex, skb::RunScheduler & scheduler, ResultWriter & writer, const std::atomic<bool> & keep_running, const RunLoopCallbacks & callbacks)
+{
+    std::vector<std::thread> result;
+    if (benchmark_cpus.empty())
+        result.emplace_back(RunBenchmarks, -1, std::cref(benchmark_cpus), std::ref(results_mutex), std::ref(scheduler), std::ref(writer), std::cref(keep_running), std::cref(callbacks));
+    for (int cpu : benchmark_cpus)
+        result.emplace_back(RunBenchmarks, cpu, std::cref(benchmark_cpus), std::ref(results_mutex), std::ref(scheduler), std::ref(writer), std::cref(keep_running), std::cref(callbacks));
+    return result;
+}
+
+// housekeeping stays on the physical core of cpu 0: this thread, and with it every
+// thread that Qt or sqlite start later. the benchmarks get one hyperthread on each
+// of the other cores, and the siblings of that hyperthread stay idle. returns the
+// cpus for the benchmark threads
+static std::vector<int> PinHousekeepingThread(int max_parallel_runs)
+{
+    std::vector<PhysicalCore> cpu_topology = ReadCpuTopology();
+    std::vector<int> benchmark_cpus = PickBenchmarkCpus(cpu_topology, max_parallel_runs);
+    if (benchmark_cpus.empty())
+        std::cout << "Couldn't find a physical core for benchmarks that is separate from cpu 0. Running one benchmark at a time without pinning" << std::endl;
+    else
+        RAW_VERIFY(PinCurrentThread(FindHousekeepingCore(cpu_topology)->logical_cpus));
+    return benchmark_cpus;
+}
+
+static constexpr const char * PARALLEL_RUNS = "--parallel-runs";
+
+// removes "--parallel-runs <n>" from the arguments so that gtest and Qt don't see it.
+// the default is to use every physical core except for the housekeeping core
+static int TakeMaxParallelRunsArgument(int & argc, char * argv[])
+{
+    int result = std::numeric_limits<int>::max();
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        if (std::strcmp(argv[i], PARALLEL_RUNS) != 0)
+            continue;
+        result = std::max(1, std::atoi(argv[i + 1]));
+        std::copy(argv + i + 2, argv + argc + 1, argv + i);
+        argc -= 2;
+        break;
+    }
+    return result;
+}
+
+static const char * DatabaseFilename()
+{
+#ifdef DEBUG_BUILD
+    return "../benchmark_timings_debug.db";
+#else
+    return "../benchmark_timings.db";
+#endif
+}
+
+static constexpr const char * COMPARE = "--compare";
+
+// --compare <before.exe> <after.exe> [--alpha <a>] [--min-change <fraction>]
+// compares the results that are already in the database, so that CI can gate
+// merges on it. exits with 1 if anything got slower and with 2 if there was
+// nothing to compare
+static std::optional<int> CompareFromCommandLine(int argc, char * argv[])
+{
+    if (argc < 4 || std::strcmp(argv[1], COMPARE) != 0)
+        return std::nullopt;
+    skb::ComparisonOptions options;
+    for (int i = 4; i < argc; i += 2)
+    {
+        if (i + 1 < argc && std::strcmp(argv[i], "--alpha") == 0)
+            options.alpha = std::atof(argv[i + 1]);
+        else if (i + 1 < argc && std::strcmp(argv[i], "--min-change") == 0)
+            options.min_relative_change = std::atof(argv[i + 1]);
+        else
+        {
+            std::cerr << "Unknown option for " << COMPARE << ": " << argv[i] << std::endl;
+            return 2;
+        }
+    }
+    interned_string before(argv[2]);
+    interned_string after(argv[3]);
+    BenchmarkDB db(DatabaseFilename());
+    for (interned_string executable : { before, after })
+    {
+        if (auto error = skb::LoadAllBenchmarksFromFile(executable.view()))
+        {
+            std::cerr << "Couldn't load the benchmarks from " << executable.view() << ": " << *error << std::endl;
+            return 2;
+        }
+        load_from_db(db, executable);
+    }
+    std::vector<skb::BenchmarkResults *> after_benchmarks;
+    for (auto & [categories, results] : skb::Benchmark::AllBenchmarks())
+    {
+        if (results.executable == after)
+            after_benchmarks.push_back(&results);
+    }
+    std::vector<std::pair<skb::BenchmarkResults *, skb::BenchmarkResults *>> pairs = skb::FindComparisonPairs(before, after_benchmarks);
+    if (pairs.empty())
+    {
+        std::cerr << "The two executables have no benchmarks in common" << std::endl;
+        return 2;
+    }
+    skb::ComparisonSummary summary = skb::PrintComparison(skb::CompareBenchmarks(pairs, options), std::cout);
+    if (summary.num_slower)
+        return 1;
+    else if (summary.num_faster + summary.num_unchanged == 0)
+        return 2;
+    else
+        return 0;
+}
+
+static constexpr const char * HEADLESS = "--headless";
+
+static void WriteJsonString(std::ostream & out, std::string_view text)
+{
+    out << '"';
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+            out << escaped;
+        }
+        else
+            out << c;
+    }
+    out << '"';
+}
+// one object per benchmark and argument with the median and its 95% interval,
+// in nanoseconds per item without the baseline
+static void WriteJson(std::ostream & out, const std::vector<skb::BenchmarkResults *> & benchmarks)
+{
+    out << "[\n";
+    bool first = true;
+    for (skb::BenchmarkResults * benchmark : benchmarks)
+    {
+        std::string categories = benchmark->categories->CategoriesString();
+        std::shared_ptr<const skb::ResultsSnapshot> snapshot = benchmark->GetResults();
+        for (const auto & [argument, runs] : snapshot->by_argument)
+        {
+            if (runs->empty())
+                continue;
+            skb::MedianConfidenceInterval interval = runs->GetMedianConfidenceInterval();
+            if (!first)
+                out << ",\n";
+            first = false;
+            out << "  {\"executable\": ";
+            WriteJsonString(out, benchmark->executable.view());
+            out << ", \"benchmark\": ";
+            WriteJsonString(out, categories);
+            out << ", \"argument\": " << argument;
+            out << ", \"runs\": " << runs->size();
+            out << ", \"median_ns_per_item\": " << interval.median;
+            if (interval.valid)
+                out << ", \"low\": " << interval.low << ", \"high\": " << interval.high;
+            out << "}";
+        }
+    }
+    out << "\n]\n";
+}
+
+// --headless <executable>... [--filter <text>]... [--max-argument <n>]
+//     [--confidence <fraction>] [--seconds <n>] [--interleave] [--json <file>]
+// runs benchmarks on a machine without a display. the filters keep only the
+// benchmarks whose categories contain one of them. it uses the same scheduler
+// and benchmark threads as the gui and stops once every interval is narrower
+// than the confidence, or when the seconds are up. the results go to the
+// database just like those of the gui
+static std::optional<int> RunHeadlessFromCommandLine(int argc, char * argv[], int max_parallel_runs)
+{
+    if (argc < 2 || std::strcmp(argv[1], HEADLESS) != 0)
+        return std::nullopt;
+    std::vector<interned_string> executables;
+    std::vector<std::string> filters;
+    int64_t max_argument = 0;
+    double target_relative_confidence = 0.01;
+    double max_seconds = 0.0;
+    bool interleave = false;
+    const char * json_filename = nullptr;
+    for (int i = 2; i < argc; ++i)
+    {
+        bool has_value = i + 1 < argc;
+        if (std::strcmp(argv[i], "--interleave") == 0)
+            interleave = true;
+        else if (has_value && std::strcmp(argv[i], "--filter") == 0)
+            filters.push_back(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--max-argument") == 0)
+            max_argument = std::atoll(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--confidence") == 0)
+            target_relative_confidence = std::atof(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--seconds") == 0)
+            max_seconds = std::atof(argv[++i]);
+        else if (has_value && std::strcmp(argv[i], "--json") == 0)
+            json_filename = argv[++i];
+        else if (std::strncmp(argv[i], "--", 2) == 0)
+        {
+            std::cerr << "Unknown option for " << HEADLESS << ": " << argv[i] << std::endl;
+            return 2;
+        }
+        else
+            executables.emplace_back(argv[i]);
+    }
+    if (executables.empty())
+    {
+        std::cerr << HEADLESS << " needs at least one executable" << std::endl;
+        return 2;
+    }
+
+    BenchmarkDB db(DatabaseFilename());
+    for (interned_string executable : executables)
+    {
+        if (auto error = skb::LoadAllBenchmarksFromFile(executable.view()))
+        {
+            std::cerr << "Couldn't load the benchmarks from " << executable.view() << ": " << *error << std::endl;
+            return 2;
+        }
+        load_from_db(db, executable);
+    }
+    std::vector<skb::BenchmarkResults *> candidates;
+    for (auto & [categories, results] : skb::Benchmark::AllBenchmarks())
+    {
+        if (std::find(executables.begin(), executables.end(), results.executable) == executables.end())
+            continue;
+        std::string categories_string = categories.CategoriesString();
+        bool matches = filters.empty() || std::any_of(filters.begin(), filters.end(), [&](const std::string & filter)
+        {
+            return categories_string.find(filter) != std::string::npos;
+        });
+        if (matches)
+            candidates.push_back(&results);
+    }
+    if (candidates.empty())
+    {
+        std::cerr << "No benchmarks match the filters" << std::endl;
+        return 2;
+    }
+
+    std::vector<int> benchmark_cpus = PinHousekeepingThread(max_parallel_runs);
+    ResultWriter writer(DatabaseFilename(), NumBenchmarksToKeep);
+    std::atomic<bool> keep_running(true);
+    ticket_mutex results_mutex;
+    skb::RunScheduler scheduler(NumBenchmarksToKeep + 12);
+    scheduler.SetCandidates(candidates, max_argument, target_relative_confidence);
+    std::cout << "Running " << candidates.size() << " benchmarks at " << scheduler.NumCandidates() << " points" << std::endl;
+
+    RunLoopCallbacks callbacks;
+    callbacks.profile_mode = []
+    {
+        return false;
+    };
+    callbacks.interleave_runs = [&]
+    {
+        return interleave;
+    };
+    callbacks.candidates = [&]() -> const std::vector<skb::BenchmarkResults *> &
+    {
+        return candidates;
+    };
+    callbacks.get_next_to_run = [&]
+    {
+        if (std::optional<std::pair<skb::BenchmarkResults *, int64_t>> next = scheduler.Next())
+            return *next;
+        else
+            return std::pair<skb::BenchmarkResults *, int64_t>(nullptr, 0);
+    };
+    std::vector<std::thread> benchmark_threads = StartBenchmarkThreads(benchmark_cpus, results_mutex, scheduler, writer, keep_running, callbacks);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int64_t last_progress = 0;
+    for (;;)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::lock_guard<ticket_mutex> lock(results_mutex);
+        bool done = !scheduler.Next() && scheduler.NumPointsInFlight() == 0;
+        if (done)
+            break;
+        if (max_seconds > 0.0 && seconds >= max_seconds)
+        {
+            std::cout << "Out of time with " << scheduler.NumCandidates() << " points left" << std::endl;
+            break;
+        }
+        if (static_cast<int64_t>(seconds) / 10 != last_progress)
+        {
+            last_progress = static_cast<int64_t>(seconds) / 10;
+            std::cout << static_cast<int64_t>(seconds) << "s: " << scheduler.NumCandidates() << " points left, " << scheduler.NumPointsInFlight() << " running" << std::endl;
+        }
+    }
+    // the threads finish the runs that they started. the writer has all the
+    // others already
+    keep_running = false;
+    for (std::thread & benchmark_thread : benchmark_threads)
+        benchmark_thread.join();
+
+    if (json_filename)
+    {
+        std::ofstream json(json_filename);
+        WriteJson(json, candidates);
+        if (!json)
+        {
+            std::cerr << "Couldn't write " << json_filename << std::endl;
+            return 2;
+        }
+    }
+    return 0;
+}
+
 int main(int argc, char * argv[])
 {
     if (skb::RunSingleBenchmarkFromCommandLine(argc, argv))
         return 0;
+    if (std::optional<int> compare_result = CompareFromCommandLine(argc, argv))
+        return *compare_result;
+
+    int max_parallel_runs = TakeMaxParallelRunsArgument(argc, argv);
+    if (std::optional<int> headless_result = RunHeadlessFromCommandLine(argc, argv, max_parallel_runs))
+        return *headless_result;
 
     ::testing::InitGoogleTest(&argc, argv);
     int result = RUN_ALL_TESTS();
@@ -183,14 +597,12 @@ int main(int argc, char * argv[])
         return 0;
 #endif
 
-    QApplication app(argc, argv);
+    std::vector<int> benchmark_cpus = PinHousekeepingThread(max_parallel_runs);
 
-    const char * filename = "../benchmark_timings.db";
-#ifdef DEBUG_BUILD
-    filename = "../benchmark_timings_debug.db";
-#endif
+    QApplication app(argc, argv);
 
-    BenchmarkDB permanent_storage(filename);
+    BenchmarkDB permanent_storage(DatabaseFilename());
+    ResultWriter writer(DatabaseFilename(), NumBenchmarksToKeep);
 
     BenchmarkMainGui root;
 
@@ -198,13 +610,24 @@ int main(int argc, char * argv[])
     ticket_mutex results_mutex;
     std::mutex run_first_mutex;
     std::deque<std::pair<skb::BenchmarkResults *, int64_t>> run_argument_first;
+    // protected by results_mutex. picks its candidates again whenever the
+    // graph's schedule generation changes
+    skb::RunScheduler scheduler(NumBenchmarksToKeep + 12);
+    uint64_t scheduled_generation = 0;
+    bool scheduled_once = false;
 
     QObject::connect(&root, &BenchmarkMainGui::NewFileLoaded, &root, [&](interned_string filename)
     {
-        std::lock_guard<ticket_mutex> lock(results_mutex);
+        // publishing the results doesn't need the lock, but the benchmark threads
+        // look at which benchmarks are visible
         load_from_db(permanent_storage, filename);
+        std::lock_guard<ticket_mutex> lock(results_mutex);
         read_checkbox_state(root, permanent_storage);
     });
+    QObject::connect(&root, &BenchmarkMainGui::ResultsCleared, &root, [&](skb::BenchmarkResults * benchmark)
+    {
+        writer.Clear(*benchmark);
+    });
     QObject::connect(&root.GetGraph(), &BenchmarkGraph::RunBenchmarkFirst, &root, [&](skb::BenchmarkResults * benchmark, int64_t argument)
     {
         std::lock_guard<std::mutex> lock(run_first_mutex);
@@ -213,69 +636,55 @@ int main(int argc, char * argv[])
     });
 
     skb::DisableProfileMode();
-    std::thread benchmark_thread([&]
+    auto get_next_to_run = [&]
     {
-        auto get_next_to_run = [&]
         {
+            std::lock_guard<std::mutex> lock(run_first_mutex);
+            if (!run_argument_first.empty())
             {
-                std::lock_guard<std::mutex> lock(run_first_mutex);
-                if (!run_argument_first.empty())
+                if (root.ProfileMode())
                 {
-                    if (root.ProfileMode())
-                    {
-                        if (run_argument_first.size() > 1)
-                            run_argument_first.erase(run_argument_first.begin(), run_argument_first.end() - 1);
-                        return run_argument_first.front();
-                    }
-                    else
-                    {
-                        std::pair<skb::BenchmarkResults *, int64_t> result = run_argument_first.front();
-                        run_argument_first.pop_front();
-                        return result;
-                    }
+                    if (run_argument_first.size() > 1)
+                        run_argument_first.erase(run_argument_first.begin(), run_argument_first.end() - 1);
+                    return run_argument_first.front();
                 }
-            }
-            const std::vector<skb::BenchmarkResults *> & visible = root.GetGraph().GetData();
-            skb::BenchmarkResults * min_result = nullptr;
-            int64_t min_argument = 0;
-            size_t min_size = NumBenchmarksToKeep + 12;
-            int64_t xlimit = root.GetGraph().GetXLimit();
-            for (skb::BenchmarkResults * result : visible)
-            {
-                for (const auto & [argument, repeat_results] : result->results)
+                else
                 {
-                    // todo: why do I ever have this?
-                    if (argument <= 0)
-                        continue;
-                    if (xlimit > 0 && argument > xlimit)
-                        continue;
-                    if (repeat_results.size() < min_size)
-                    {
-                        min_size = repeat_results.size();
-                        min_argument = argument;
-                        min_result = result;
-                    }
+                    std::pair<skb::BenchmarkResults *, int64_t> result = run_argument_first.front();
+                    run_argument_first.pop_front();
+                    return result;
                 }
             }
-            if (min_result)
-                return std::make_pair(min_result, min_argument);
-            else
-                return std::pair<skb::BenchmarkResults *, int64_t>(nullptr, 0);
-        };
-
-        while (keep_running)
+        }
+        BenchmarkGraph & graph = root.GetGraph();
+        uint64_t generation = graph.GetScheduleGeneration();
+        if (!scheduled_once || generation != scheduled_generation)
         {
-            std::unique_lock<ticket_mutex> lock(results_mutex);
-            auto [results, argument] = get_next_to_run();
-            if (results) {
-                RunOne(*results, argument, root.ProfileMode());
-            }
-            else {
-                lock.unlock();
-                std::this_thread::sleep_for(std::chrono::seconds(1));
-            }
+            scheduler.SetCandidates(graph.GetData(), graph.GetXLimit(), graph.GetTargetRelativeConfidence());
+            scheduled_generation = generation;
+            scheduled_once = true;
         }
-    });
+        if (std::optional<std::pair<skb::BenchmarkResults *, int64_t>> next = scheduler.Next())
+            return *next;
+        else
+            return std::pair<skb::BenchmarkResults *, int64_t>(nullptr, 0);
+    };
+
+    RunLoopCallbacks callbacks;
+    callbacks.profile_mode = [&]
+    {
+        return root.ProfileMode();
+    };
+    callbacks.interleave_runs = [&]
+    {
+        return root.InterleaveRuns();
+    };
+    callbacks.candidates = [&]() -> const std::vector<skb::BenchmarkResults *> &
+    {
+        return root.GetGraph().GetData();
+    };
+    callbacks.get_next_to_run = get_next_to_run;
+    std::vector<std::thread> benchmark_threads = StartBenchmarkThreads(benchmark_cpus, results_mutex, scheduler, writer, keep_running, callbacks);
 
     root.setWindowTitle("Benchmarks");
     root.show();
@@ -285,9 +694,9 @@ int main(int argc, char * argv[])
 
     keep_running = false;
     skb::DisableProfileMode();
-    benchmark_thread.join();
+    for (std::thread & benchmark_thread : benchmark_threads)
+        benchmark_thread.join();
 
-    persist_to_db(permanent_storage);
     write_checkbox_state(root, permanent_storage);
 
     return 0;
@@ -8,6 +8,9 @@
 #include <QClipboard>
 #include <QApplication>
 #include <QToolTip>
+#include <QTimer>
+#include <charconv>
+#include <set>
 
 BenchmarkGraph::BenchmarkGraph(QWidget * parent)
     : QWidget(parent)
@@ -34,6 +37,12 @@ BenchmarkGraph::BenchmarkGraph(QWidget * parent)
             QApplication::clipboard()->setText(QString::fromUtf8(for_clipboard.c_str()));
         }
     });
+    QTimer * results_timer = new QTimer(this);
+    QObject::connect(results_timer, &QTimer::timeout, this, [this]
+    {
+        CheckForNewResults();
+    });
+    results_timer->start(results_poll_milliseconds);
 }
 
 void BenchmarkGraph::EmitBenchmark(skb::BenchmarkResults * benchmark, int64_t argument)
@@ -47,37 +56,30 @@ void BenchmarkGraph::EmitBenchmark(skb::BenchmarkResults * benchmark, int64_t ar
 
 std::string BenchmarkGraph::BuildClipboardString(const skb::BenchmarkResults & results, ClipboardStringType type) const
 {
-    std::lock_guard<std::mutex> lock(results.results_mutex);
+    std::shared_ptr<const skb::ResultsSnapshot> snapshot = results.GetResults();
     skb::BenchmarkResults * baseline = results.baseline_results;
     std::string clipboard_string;
-    std::vector<double> all_results;
-    for (const auto & run : results.results)
+    for (const auto & run : snapshot->by_argument)
     {
-        if (run.first <= 0 || run.second.empty())
+        if (run.first <= 0 || run.second->empty())
             continue;
         if (xlimit > 0 && run.first > xlimit)
             continue;
+        double nanoseconds = run.second->MedianRun().GetNanosecondsPerItem(baseline);
+        // the baseline hasn't run at this argument yet
+        if (std::isnan(nanoseconds))
+            continue;
         clipboard_string += std::to_string(run.first);
         clipboard_string += ';';
-        double nanoseconds = run.second.front().GetNanosecondsPerItem(baseline);
         clipboard_string += std::to_string(nanoseconds);
         if (type == With_Error_Bars)
         {
-            all_results.clear();
-            for (const skb::RunResults & result : run.second)
-            {
-                all_results.push_back(result.GetNanosecondsPerItem(baseline));
-            }
-            size_t quarter = all_results.size() / 4;
-            auto percentile_25 = all_results.begin() + quarter;
-            std::nth_element(all_results.begin(), percentile_25, all_results.end());
-            auto percentile_75 = all_results.end() - std::max(size_t(1), quarter);
-            if (percentile_75 != percentile_25)
-                std::nth_element(percentile_25 + 1, percentile_75, all_results.end());
+            // the baseline moves all of them by the same amount
+            const skb::OrderStatisticsSummary & statistics = run.second->Statistics();
             clipboard_string += ';';
-            clipboard_string += std::to_string(nanoseconds - *percentile_25);
+            clipboard_string += std::to_string(statistics.median.value - statistics.first_quartile);
             clipboard_string += ';';
-            clipboard_string += std::to_string(*percentile_75 - nanoseconds);
+            clipboard_string += std::to_string(statistics.third_quartile - statistics.median.value);
         }
         clipboard_string += '\n';
     }
@@ -116,7 +118,114 @@ void BenchmarkGraph::mouseMoveEvent(QMouseEvent * event)
         tooltip_string += '\n';
         tooltip_string += QString::number(highlighted_argument);
         tooltip_string += '\n';
-        tooltip_string += QString::number(highlighted_benchmark->results[highlighted_argument].front().GetNanosecondsPerItem(baseline), 'f', 2);
+        // the points were drawn from an older snapshot, so the runs may have been
+        // cleared since
+        std::shared_ptr<const skb::ResultsSnapshot> snapshot = highlighted_benchmark->GetResults();
+        const skb::RunSamples * runs = snapshot->Find(highlighted_argument);
+        double yvalue = runs && !runs->empty() ? YValueFromRuns(*runs, baseline) : std::numeric_limits<double>::quiet_NaN();
+        if (std::isnan(yvalue) && baseline)
+            tooltip_string += "baseline pending";
+        else
+            tooltip_string += QString::number(yvalue, 'f', 2);
+        skb::MedianConfidenceInterval confidence;
+        int64_t warmup_iterations = 0;
+        std::chrono::nanoseconds warmup_time(0);
+        std::shared_ptr<const skb::MergedLatencyHistogram> latencies;
+        size_t footprint = 0;
+        int num_threads = 1;
+        double per_thread = 0.0;
+        double allocations_per_item = 0.0;
+        std::string environment;
+        if (runs)
+        {
+            confidence = runs->GetMedianConfidenceInterval();
+            latencies = runs->Latencies();
+            if (!runs->empty())
+            {
+                const skb::RunResults & median = runs->MedianRun();
+                warmup_iterations = median.warmup_iterations;
+                warmup_time = median.warmup_time;
+                footprint = median.GetMemoryFootprint();
+                num_threads = median.num_threads;
+                per_thread = median.GetNanosecondsPerItemPerThread();
+                environment = median.environment.ToString();
+                if (median.num_items_processed)
+                    allocations_per_item = median.num_allocations / static_cast<double>(median.num_items_processed);
+            }
+        }
+        tooltip_string += '\n';
+        if (confidence.valid)
+            tooltip_string += "95% CI: +/-" + QString::number(100.0 * confidence.RelativeHalfWidth(), 'f', 2) + '%';
+        else
+            tooltip_string += "95% CI: not enough runs";
+        tooltip_string += " (" + QString::number(confidence.num_samples) + " runs)";
+        if (latencies)
+        {
+            tooltip_string += "\np50: " + QString::number(latencies->Percentile(0.5), 'f', 0);
+            tooltip_string += "ns, p99: " + QString::number(latencies->Percentile(0.99), 'f', 0);
+            tooltip_string += "ns, p99.9: " + QString::number(latencies->Percentile(0.999), 'f', 0) + "ns";
+        }
+        if (num_threads > 1)
+            tooltip_string += "\n" + QString::number(num_threads) + " threads, " + QString::number(per_thread, 'f', 2) + "ns per item in each thread";
+        if (footprint && highlighted_argument > 0)
+        {
+            tooltip_string += "\nmemory: " + QString::number(footprint / static_cast<double>(highlighted_argument), 'f', 1) + " bytes per item";
+            tooltip_string += ", " + QString::number(allocations_per_item, 'f', 3) + " allocations per item";
+        }
+        if (!environment.empty())
+            tooltip_string += "\nenvironment: " + QString::fromUtf8(environment.c_str());
+        if (warmup_iterations)
+        {
+            tooltip_string += "\nwarmup: " + QString::number(warmup_iterations) + " iterations, ";
+            tooltip_string += QString::number(warmup_time.count() / 1000000.0, 'f', 1) + "ms";
+        }
+        auto fits = complexity_fits.find(highlighted_benchmark);
+        if (fits != complexity_fits.end())
+        {
+            for (const skb::ComplexityFit & fit : fits->second)
+            {
+                if (highlighted_argument < fit.first_argument || highlighted_argument > fit.last_argument)
+                    continue;
+                std::string_view name = skb::ComplexityName(fit.complexity);
+                tooltip_string += "\nfit from " + readable_xvalue(fit.first_argument) + " to " + readable_xvalue(fit.last_argument) + ": ";
+                tooltip_string += QString::number(fit.coefficient, 'g', 3) + " * " + QString::fromUtf8(name.data(), name.size());
+                tooltip_string += ", rms " + QString::number(100.0 * fit.rms, 'f', 2) + '%';
+            }
+        }
+        auto compared = compared_points.find({ highlighted_benchmark, highlighted_argument });
+        if (compared != compared_points.end())
+        {
+            const skb::ArgumentComparison & comparison = compared->second;
+            tooltip_string += "\nvs " + QString::fromUtf8(compare_against.data(), compare_against.size()) + ": ";
+            tooltip_string += (comparison.relative_change > 0.0 ? "+" : "") + QString::number(100.0 * comparison.relative_change, 'f', 2) + '%';
+            if (comparison.verdict == skb::ArgumentComparison::NotEnoughRuns)
+                tooltip_string += ", not enough runs";
+            else
+                tooltip_string += ", adjusted p " + QString::number(comparison.adjusted_p_value, 'g', 3);
+        }
+        // only for runs that were interleaved with other visible benchmarks
+        static constexpr int max_paired_lines = 8;
+        int num_paired_lines = 0;
+        for (skb::BenchmarkResults * other : data)
+        {
+            if (other == highlighted_benchmark || num_paired_lines == max_paired_lines)
+                continue;
+            skb::PairedComparison paired = skb::ComparePaired(*highlighted_benchmark, *other, highlighted_argument);
+            if (!paired.num_pairs)
+                continue;
+            ++num_paired_lines;
+            const skb::MedianConfidenceInterval & difference = paired.relative_difference;
+            auto percent = [](double value)
+            {
+                return (value > 0.0 ? "+" : "") + QString::number(100.0 * value, 'f', 2) + '%';
+            };
+            tooltip_string += "\n" + QString::fromUtf8(other->categories->CategoriesString().c_str()) + " in the same blocks: " + percent(difference.median);
+            if (difference.valid)
+                tooltip_string += " (95% CI " + percent(difference.low) + " to " + percent(difference.high) + ", ";
+            else
+                tooltip_string += " (";
+            tooltip_string += QString::number(paired.num_pairs) + " blocks)";
+        }
         QToolTip::showText(event->globalPos(), tooltip_string);
     }
     else
@@ -127,12 +236,9 @@ void BenchmarkGraph::mouseMoveEvent(QMouseEvent * event)
 
 void BenchmarkGraph::AddData(skb::BenchmarkResults * benchmark)
 {
+    compared_pairs_dirty = true;
     data.push_back(benchmark);
-    callbacks.push_back(benchmark->results_added_signal.map([this](skb::BenchmarkResults *)
-    {
-        lines_dirty = true;
-        update();
-    }));
+    ++schedule_generation;
     lines_dirty = true;
     update();
 }
@@ -141,15 +247,34 @@ void BenchmarkGraph::RemoveData(skb::BenchmarkResults * benchmark)
     auto found = std::find(data.begin(), data.end(), benchmark);
     if (found == data.end())
         return;
-    callbacks.erase(callbacks.begin() + std::distance(data.begin(), found));
     data.erase(found);
+    compared_pairs_dirty = true;
+    ++schedule_generation;
     lines_dirty = true;
     update();
 }
 void BenchmarkGraph::RemoveAll()
 {
-    callbacks.clear();
+    compared_pairs_dirty = true;
     data.clear();
+    ++schedule_generation;
+    lines_dirty = true;
+    update();
+}
+void BenchmarkGraph::CheckForNewResults()
+{
+    // the values are NaN until the baseline has run at the same argument, and
+    // that run only gets requested while painting, so the baselines count too
+    std::vector<uint64_t> generations;
+    generations.reserve(2 * data.size());
+    for (skb::BenchmarkResults * benchmark : data)
+    {
+        generations.push_back(benchmark->GetResultsGeneration());
+        generations.push_back(benchmark->baseline_results ? benchmark->baseline_results->GetResultsGeneration() : 0);
+    }
+    if (generations == seen_generations)
+        return;
+    seen_generations = std::move(generations);
     lines_dirty = true;
     update();
 }
@@ -165,6 +290,76 @@ void BenchmarkGraph::SetDrawAsPoints(bool value)
     lines_dirty = true;
     update();
 }
+void BenchmarkGraph::SetDrawAsHeatmap(bool value)
+{
+    draw_as_heatmap = value;
+    lines_dirty = true;
+    update();
+}
+void BenchmarkGraph::SetFitComplexity(bool value)
+{
+    fit_complexity = value;
+    lines_dirty = true;
+    update();
+}
+void BenchmarkGraph::SetTargetRelativeConfidence(double value)
+{
+    target_relative_confidence.store(value, std::memory_order_relaxed);
+    ++schedule_generation;
+    lines_dirty = true;
+    update();
+}
+void BenchmarkGraph::SetCompareAgainst(interned_string executable)
+{
+    compared_pairs_dirty = true;
+    compare_against = executable;
+    lines_dirty = true;
+    update();
+}
+void BenchmarkGraph::SetYAxisLatencies(bool value)
+{
+    y_axis_latencies = value;
+    lines_dirty = true;
+    update();
+}
+void BenchmarkGraph::SetYAxisCounter(std::optional<skb::RunCounter> counter)
+{
+    y_axis_counter = counter;
+    lines_dirty = true;
+    update();
+}
+
+static constexpr double latency_percentiles[] = { 0.5, 0.99, 0.999 };
+
+double BenchmarkGraph::YValueFromResult(const skb::RunResults & result, skb::BenchmarkResults * baseline, double latency_percentile) const
+{
+    double value;
+    if (y_axis_latencies)
+        value = result.latencies ? result.latencies->Percentile(latency_percentile) : std::numeric_limits<double>::quiet_NaN();
+    else if (y_axis_counter)
+        value = result.GetCounterPerItem(*y_axis_counter, baseline);
+    else
+        value = result.GetNanosecondsPerItem(baseline);
+    return NormalizeForMemory(value, result);
+}
+double BenchmarkGraph::YValueFromRuns(const skb::RunSamples & runs, skb::BenchmarkResults * baseline, double latency_percentile) const
+{
+    const skb::RunResults & median = runs.MedianRun();
+    if (!y_axis_latencies)
+        return YValueFromResult(median, baseline);
+    double value = runs.Latencies() ? runs.Latencies()->Percentile(latency_percentile) : std::numeric_limits<double>::quiet_NaN();
+    return NormalizeForMemory(value, median);
+}
+double BenchmarkGraph::NormalizeForMemory(double value, const skb::RunResults & result) const
+{
+    size_t footprint = result.GetMemoryFootprint();
+    if (normalize_for_memory && footprint > 0 && result.argument > 0)
+    {
+        double memory_per_item = footprint / static_cast<double>(result.argument);
+        value *= memory_per_item;
+    }
+    return value;
+}
 
 QSize BenchmarkGraph::sizeHint() const
 {
@@ -271,6 +466,155 @@ bool is_finite(double x) {
     return !std::isnan(x) && std::abs(x) != std::numeric_limits<double>::infinity();
 }
 
+// compares numbers as numbers, so that "16" comes after "8"
+static bool CategoryValueLess(std::string_view a, std::string_view b)
+{
+    double a_number = 0.0;
+    double b_number = 0.0;
+    auto a_parsed = std::from_chars(a.data(), a.data() + a.size(), a_number);
+    auto b_parsed = std::from_chars(b.data(), b.data() + b.size(), b_number);
+    if (a_parsed.ec == std::errc() && a_parsed.ptr == a.data() + a.size() && b_parsed.ec == std::errc() && b_parsed.ptr == b.data() + b.size())
+        return a_number < b_number;
+    return a < b;
+}
+
+void BenchmarkGraph::DrawHeatmap(QPainter & painter, const std::function<double (double)> & position_x, double height)
+{
+    if (data.empty())
+        return;
+    // the categories that aren't the same for all benchmarks label the rows
+    std::vector<interned_string> differing;
+    for (const auto & [category, value] : data.front()->categories->GetCategories())
+    {
+        for (skb::BenchmarkResults * benchmark : data)
+        {
+            auto found = benchmark->categories->GetCategories().find(category);
+            if (found == benchmark->categories->GetCategories().end() || found->second != value)
+            {
+                differing.push_back(category);
+                break;
+            }
+        }
+    }
+    std::sort(differing.begin(), differing.end(), [](const interned_string & l, const interned_string & r)
+    {
+        return l.view() < r.view();
+    });
+    struct Row
+    {
+        std::vector<std::string_view> values;
+        skb::BenchmarkResults * benchmark;
+    };
+    std::vector<Row> rows;
+    for (skb::BenchmarkResults * benchmark : data)
+    {
+        Row & row = rows.emplace_back();
+        row.benchmark = benchmark;
+        for (const interned_string & category : differing)
+        {
+            auto found = benchmark->categories->GetCategories().find(category);
+            row.values.push_back(found == benchmark->categories->GetCategories().end() ? std::string_view() : found->second.view());
+        }
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](const Row & l, const Row & r)
+    {
+        return std::lexicographical_compare(l.values.begin(), l.values.end(), r.values.begin(), r.values.end(), CategoryValueLess);
+    });
+
+    // the colors are on a log scale, which needs a positive minimum
+    double color_min = std::numeric_limits<double>::max();
+    for (const Row & row : rows)
+    {
+        std::shared_ptr<const skb::ResultsSnapshot> snapshot = row.benchmark->GetResults();
+        for (const auto & run : snapshot->by_argument)
+        {
+            if (run.first <= 0 || run.second->empty() || (xlimit > 0 && run.first > xlimit))
+                continue;
+            double value = YValueFromRuns(*run.second, row.benchmark->baseline_results);
+            if (value > 0.0)
+                color_min = std::min(color_min, value);
+        }
+    }
+    if (color_min >= ymax)
+        color_min = ymax / 2.0;
+    double log_color_min = std::log(color_min);
+    double log_color_range = std::log(ymax) - log_color_min;
+
+    double row_height = height / rows.size();
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+        const Row & row = rows[i];
+        double top = i * row_height;
+        std::shared_ptr<const skb::ResultsSnapshot> snapshot = row.benchmark->GetResults();
+        std::vector<const skb::RunSamples *> runs;
+        std::vector<int64_t> arguments;
+        for (const auto & run : snapshot->by_argument)
+        {
+            if (run.first > 0 && !run.second->empty() && !(xlimit > 0 && run.first > xlimit))
+            {
+                runs.push_back(run.second.get());
+                arguments.push_back(run.first);
+            }
+        }
+        for (size_t j = 0; j < arguments.size(); ++j)
+        {
+            // the cells reach halfway to the neighbors on the log scale
+            double center = position_x(arguments[j]);
+            double left = j == 0 ? center : (center + position_x(arguments[j - 1])) / 2.0;
+            double right = j + 1 == arguments.size() ? center : (center + position_x(arguments[j + 1])) / 2.0;
+            if (j == 0)
+                left = center - (right - center);
+            if (j + 1 == arguments.size())
+                right = center + (center - left);
+            double value = YValueFromRuns(*runs[j], row.benchmark->baseline_results);
+            if (std::isnan(value))
+                continue;
+            double fraction = value > 0.0 ? (std::log(value) - log_color_min) / log_color_range : 0.0;
+            fraction = std::clamp(fraction, 0.0, 1.0);
+            painter.fillRect(QRectF(QPointF(left, top), QPointF(right, top + row_height)), QColor::fromHsvF(0.66 * (1.0 - fraction), 0.7, 0.95));
+            points.push_back({ row.benchmark, arguments[j], center, top + row_height / 2.0, 0 });
+        }
+        std::string label;
+        for (size_t j = 0; j < differing.size(); ++j)
+        {
+            if (j)
+                label += ", ";
+            label += differing[j].view();
+            label += '=';
+            label += row.values[j];
+        }
+        painter.setPen(Qt::black);
+        painter.drawText(QRectF(position_x(xmin), top, position_x(xmax) - position_x(xmin), row_height), Qt::AlignLeft | Qt::AlignVCenter, QString::fromUtf8(label.c_str()));
+    }
+}
+
+void BenchmarkGraph::UpdateComparedPoints()
+{
+    if (compared_pairs_dirty)
+    {
+        compared_pairs.clear();
+        if (!compare_against.view().empty())
+            compared_pairs = skb::FindComparisonPairs(compare_against, data);
+        compared_snapshots.clear();
+        compared_pairs_dirty = false;
+    }
+    std::vector<std::shared_ptr<const skb::ResultsSnapshot>> snapshots;
+    for (const auto & [before, after] : compared_pairs)
+    {
+        snapshots.push_back(before->GetResults());
+        snapshots.push_back(after->GetResults());
+    }
+    if (!snapshots.empty() && snapshots == compared_snapshots)
+        return;
+    compared_snapshots = std::move(snapshots);
+    compared_points.clear();
+    for (const skb::BenchmarkComparison & comparison : skb::CompareBenchmarks(compared_pairs, {}))
+    {
+        for (const skb::ArgumentComparison & one : comparison.arguments)
+            compared_points.emplace(std::make_pair(comparison.after, one.argument), one);
+    }
+}
+
 void BenchmarkGraph::paintEvent(QPaintEvent *)
 {
     QSize overall_size = size();
@@ -298,17 +642,6 @@ void BenchmarkGraph::paintEvent(QPaintEvent *)
         return y_percent * lines_size.height();
     };
 
-    auto yval_from_result = [&](const skb::RunResults & median, skb::BenchmarkResults * baseline)
-    {
-        double time = median.GetNanosecondsPerItem(baseline);
-        if (normalize_for_memory && median.num_bytes_used > 0 && median.argument > 0)
-        {
-            double memory_per_item = median.num_bytes_used / static_cast<double>(median.argument);
-            time *= memory_per_item;
-        }
-        return time;
-    };
-
     static const QColor colors[12] =
     {
         QColor(0x1f, 0x78, 0xb4), // blue
@@ -333,20 +666,33 @@ void BenchmarkGraph::paintEvent(QPaintEvent *)
         xmax = std::numeric_limits<int64_t>::lowest();
         ymin = 0.0;
         ymax = std::numeric_limits<double>::lowest();
+        num_converged_points = 0;
+        num_visible_points = 0;
+        widest_relative_confidence = 0.0;
+        double target = GetTargetRelativeConfidence();
 
         for (skb::BenchmarkResults * benchmark : data)
         {
-            std::lock_guard<std::mutex> lock(benchmark->results_mutex);
+            std::shared_ptr<const skb::ResultsSnapshot> snapshot = benchmark->GetResults();
             skb::BenchmarkResults * baseline = benchmark->baseline_results;
-            for (const auto & run : benchmark->results)
+            for (const auto & run : snapshot->by_argument)
             {
-                if (run.first <= 0 || run.second.empty())
+                if (run.first <= 0 || run.second->empty())
                     continue;
                 if (xlimit > 0 && run.first > xlimit)
                     continue;
+                double relative_confidence = run.second->GetMedianConfidenceInterval().RelativeHalfWidth();
+                ++num_visible_points;
+                if (relative_confidence <= target)
+                    ++num_converged_points;
+                widest_relative_confidence = std::max(widest_relative_confidence, relative_confidence);
+                double time = YValueFromRuns(*run.second, baseline);
+                if (std::isnan(time))
+                    continue;
+                if (y_axis_latencies)
+                    time = YValueFromRuns(*run.second, baseline, latency_percentiles[std::size(latency_percentiles) - 1]);
                 xmin = std::min(xmin, run.first);
                 xmax = std::max(xmax, run.first);
-                double time = yval_from_result(run.second.front(), baseline);
                 ymin = std::min(ymin, time);
                 ymax = std::max(ymax, time);
             }
@@ -375,110 +721,213 @@ void BenchmarkGraph::paintEvent(QPaintEvent *)
             QRectF bounding_rect(QPointF(screen_x - 100.0, screen_y + tick_length), QPointF(screen_x + 100.0, size().height()));
             graph_painter.drawText(bounding_rect, Qt::AlignTop | Qt::AlignHCenter, readable_xvalue(x));
         }
-        for (double y = ylabels.min; y <= ylabels.max; y = ylabels.step(y))
+        if (!draw_as_heatmap)
         {
-            double screen_x = position_x(xmin);
-            double screen_y = position_y(y);
-            graph_painter.drawLine(QPointF(screen_x, screen_y), QPointF(screen_x - tick_length, screen_y));
-            QRectF bounding_rect(QPointF(0.0, screen_y - 2.0 * text_height), QPointF(screen_x - tick_length - 2, screen_y + 2.0 * text_height));
-            graph_painter.drawText(bounding_rect, Qt::AlignRight | Qt::AlignVCenter, readable_yvalue(y));
+            for (double y = ylabels.min; y <= ylabels.max; y = ylabels.step(y))
+            {
+                double screen_x = position_x(xmin);
+                double screen_y = position_y(y);
+                graph_painter.drawLine(QPointF(screen_x, screen_y), QPointF(screen_x - tick_length, screen_y));
+                QRectF bounding_rect(QPointF(0.0, screen_y - 2.0 * text_height), QPointF(screen_x - tick_length - 2, screen_y + 2.0 * text_height));
+                graph_painter.drawText(bounding_rect, Qt::AlignRight | Qt::AlignVCenter, readable_yvalue(y));
+            }
         }
 
         points.clear();
+        complexity_fits.clear();
         int color_choice = 0;
         std::vector<QPointF> benchmark_points;
-        for (skb::BenchmarkResults * benchmark : data)
+        if (draw_as_heatmap)
+            DrawHeatmap(graph_painter, position_x, lines_size.height());
+        else
         {
-            std::lock_guard<std::mutex> lock(benchmark->results_mutex);
-            skb::BenchmarkResults * baseline = benchmark->baseline_results;
-
-            if (draw_as_points)
+            for (skb::BenchmarkResults * benchmark : data)
             {
-                benchmark_points.clear();
-                auto begin = benchmark->results.begin();
-                auto end = benchmark->results.end();
-                for (auto it = begin; it != end; ++it)
+                std::shared_ptr<const skb::ResultsSnapshot> snapshot = benchmark->GetResults();
+                skb::BenchmarkResults * baseline = benchmark->baseline_results;
+
+                if (draw_as_points)
                 {
-                    if (it->first <= 0 || it->second.empty())
-                        continue;
-                    auto next = std::next(it);
-                    double jitter = 0.0;
-                    double jitter_amount = 0.4;
-                    if (it == begin) {
-                        if (next != end) {
-                            jitter = static_cast<double>(next->first) / it->first;
-                        }
-                    }
-                    else if (next != end && next->first < xlimit)
+                    benchmark_points.clear();
+                    auto begin = snapshot->by_argument.begin();
+                    auto end = snapshot->by_argument.end();
+                    for (auto it = begin; it != end; ++it)
                     {
-                        if (color_choice & 1) {
-                            jitter = std::prev(it)->first / static_cast<double>(it->first);
+                        if (it->first <= 0 || it->second->empty())
+                            continue;
+                        auto next = std::next(it);
+                        double jitter = 0.0;
+                        double jitter_amount = 0.4;
+                        if (it == begin) {
+                            if (next != end) {
+                                jitter = static_cast<double>(next->first) / it->first;
+                            }
+                        }
+                        else if (next != end && next->first < xlimit)
+                        {
+                            if (color_choice & 1) {
+                                jitter = std::prev(it)->first / static_cast<double>(it->first);
+                            }
+                            else {
+                                jitter = static_cast<double>(next->first) / it->first;
+                            }
                         }
                         else {
-                            jitter = static_cast<double>(next->first) / it->first;
+                            jitter = std::prev(it)->first / static_cast<double>(it->first);
+                        }
+                        double jitter_fraction = color_choice / static_cast<double>(std::extent<decltype(colors)>::value);
+                        jitter = std::pow(jitter, jitter_amount * jitter_fraction);
+                        for (const skb::RunResults & result : *it->second)
+                        {
+                            double xvalue = result.argument;
+                            double yvalue = YValueFromResult(result, baseline);
+                            if (std::isnan(yvalue))
+                                continue;
+                            QPointF point(position_x(xvalue * jitter), position_y(yvalue));
+                            benchmark_points.push_back(point);
+                            points.push_back({benchmark, result.argument, point.x(), point.y(), color_choice});
                         }
                     }
-                    else {
-                        jitter = std::prev(it)->first / static_cast<double>(it->first);
-                    }
-                    double jitter_fraction = color_choice / static_cast<double>(std::extent<decltype(colors)>::value);
-                    jitter = std::pow(jitter, jitter_amount * jitter_fraction);
-                    for (const skb::RunResults & result : it->second)
-                    {
-                        double xvalue = result.argument;
-                        double yvalue = yval_from_result(result, baseline);
-                        QPointF point(position_x(xvalue * jitter), position_y(yvalue));
-                        benchmark_points.push_back(point);
-                        points.push_back({benchmark, result.argument, point.x(), point.y(), color_choice});
-                    }
+                    if (benchmark_points.empty())
+                        continue;
+                    QColor color = colors[color_choice];
+                    color.setAlpha(127);
+                    QPen pen(color);
+                    pen.setWidthF(line_width * 4.0f);
+                    graph_painter.setPen(pen);
+                    graph_painter.drawPoints(benchmark_points.data(), static_cast<int>(benchmark_points.size()));
                 }
-                if (benchmark_points.empty())
-                    continue;
-                QColor color = colors[color_choice];
-                color.setAlpha(127);
-                QPen pen(color);
-                pen.setWidthF(line_width * 4.0f);
-                graph_painter.setPen(pen);
-                graph_painter.drawPoints(benchmark_points.data(), static_cast<int>(benchmark_points.size()));
-            }
-            else
-            {
-                QPainterPath path;
-
-                bool first = true;
-                for (auto & range : benchmark->results)
+                else
                 {
-                    if (range.first <= 0 || range.second.empty())
-                        continue;
-                    auto median = range.second.begin();
-
-                    int64_t xvalue = median->argument;
-                    double yvalue = yval_from_result(*median, baseline);
-                    double xpos = position_x(xvalue);
-                    double ypos = position_y(yvalue);
-                    CHECK_FOR_PROGRAMMER_ERROR(is_finite(xpos) && is_finite(ypos));
-                    QPointF point(xpos, ypos);
+                    QPainterPath path;
+                    std::vector<skb::ComplexityPoint> fit_points;
+
+                    bool first = true;
+                    for (auto & range : snapshot->by_argument)
+                    {
+                        if (range.first <= 0 || range.second->empty())
+                            continue;
+                        int64_t xvalue = range.first;
+                        double yvalue = YValueFromRuns(*range.second, baseline);
+                        if (std::isnan(yvalue))
+                            continue;
+                        double xpos = position_x(xvalue);
+                        double ypos = position_y(yvalue);
+                        CHECK_FOR_PROGRAMMER_ERROR(is_finite(xpos) && is_finite(ypos));
+                        QPointF point(xpos, ypos);
+                        if (first)
+                        {
+                            first = false;
+                            path.moveTo(point);
+                        }
+                        else
+                            path.lineTo(point);
+                        points.push_back({benchmark, xvalue, point.x(), point.y(), color_choice});
+                        if (xlimit <= 0 || xvalue <= xlimit)
+                            fit_points.push_back({ xvalue, yvalue });
+                    }
                     if (first)
+                        continue;
+                    QPen pen(colors[color_choice]);
+                    pen.setWidthF(line_width);
+                    graph_painter.setPen(pen);
+                    graph_painter.drawPath(path);
+                    if (y_axis_latencies)
+                    {
+                        // the tail percentiles in the same color
+                        const Qt::PenStyle styles[] = { Qt::DashLine, Qt::DotLine };
+                        for (size_t i = 1; i < std::size(latency_percentiles); ++i)
+                        {
+                            QPainterPath tail_path;
+                            bool first_tail = true;
+                            for (auto & range : snapshot->by_argument)
+                            {
+                                if (range.first <= 0 || range.second->empty())
+                                    continue;
+                                double yvalue = YValueFromRuns(*range.second, baseline, latency_percentiles[i]);
+                                if (std::isnan(yvalue))
+                                    continue;
+                                QPointF point(position_x(range.first), position_y(yvalue));
+                                if (first_tail)
+                                    tail_path.moveTo(point);
+                                else
+                                    tail_path.lineTo(point);
+                                first_tail = false;
+                            }
+                            pen.setStyle(styles[i - 1]);
+                            graph_painter.setPen(pen);
+                            graph_painter.drawPath(tail_path);
+                        }
+                    }
+                    if (fit_complexity)
                     {
-                        first = false;
-                        path.moveTo(point);
+                        std::vector<skb::ComplexityFit> & fits = complexity_fits[benchmark];
+                        fits = skb::FitPiecewiseComplexity(fit_points);
+                        pen.setStyle(Qt::DashLine);
+                        pen.setWidthF(line_width * 0.5f);
+                        graph_painter.setPen(pen);
+                        for (const skb::ComplexityFit & fit : fits)
+                        {
+                            // sampled evenly on the log scale of the x axis
+                            static constexpr int num_samples = 32;
+                            QPainterPath fit_path;
+                            double log_first = std::log(static_cast<double>(fit.first_argument));
+                            double log_last = std::log(static_cast<double>(fit.last_argument));
+                            for (int i = 0; i <= num_samples; ++i)
+                            {
+                                double xvalue = std::exp(log_first + (log_last - log_first) * i / num_samples);
+                                QPointF point(position_x(xvalue), position_y(std::clamp(fit.Evaluate(xvalue), ymin, ymax)));
+                                if (i == 0)
+                                    fit_path.moveTo(point);
+                                else
+                                    fit_path.lineTo(point);
+                            }
+                            graph_painter.drawPath(fit_path);
+                            std::string_view name = skb::ComplexityName(fit.complexity);
+                            QString label = QString::fromUtf8(name.data(), name.size()) + ", rms " + QString::number(100.0 * fit.rms, 'f', 1) + '%';
+                            double middle = std::sqrt(static_cast<double>(fit.first_argument) * fit.last_argument);
+                            QPointF label_position(position_x(middle), position_y(std::clamp(fit.Evaluate(middle), ymin, ymax)));
+                            graph_painter.drawText(QRectF(label_position.x() - 100.0, label_position.y() - 1.5 * text_height, 200.0, text_height), Qt::AlignHCenter | Qt::AlignBottom, label);
+                        }
                     }
-                    else
-                        path.lineTo(point);
-                    points.push_back({benchmark, median->argument, point.x(), point.y(), color_choice});
                 }
-                if (first)
+                color_choice = (color_choice + 1) % std::extent<decltype(colors)>::value;
+            }
+        }
+
+        UpdateComparedPoints();
+        if (!compare_against.view().empty())
+        {
+            // a ring around the median of every point that changed: green if it got faster
+            std::set<std::pair<skb::BenchmarkResults *, int64_t>> marked;
+            for (const DrawnPoint & point : points)
+            {
+                auto compared = compared_points.find({ point.benchmark, point.argument });
+                if (compared == compared_points.end() || !marked.insert(compared->first).second)
+                    continue;
+                if (compared->second.verdict != skb::ArgumentComparison::Faster && compared->second.verdict != skb::ArgumentComparison::Slower)
                     continue;
-                QPen pen(colors[color_choice]);
+                QPen pen(compared->second.verdict == skb::ArgumentComparison::Faster ? QColor(0x00, 0xa0, 0x00) : QColor(0xe0, 0x00, 0x00));
                 pen.setWidthF(line_width);
                 graph_painter.setPen(pen);
-                graph_painter.drawPath(path);
+                graph_painter.setBrush(Qt::NoBrush);
+                float radius = 4.0f * line_width;
+                graph_painter.drawEllipse(QPointF(point.x, point.y), radius, radius);
             }
-            color_choice = (color_choice + 1) % std::extent<decltype(colors)>::value;
         }
     }
 
     my_painter.drawImage(0, 0, lines);
+    if (num_visible_points)
+    {
+        QString summary = QString::number(num_converged_points) + " of " + QString::number(num_visible_points)
+                + " points within +/-" + QString::number(100.0 * GetTargetRelativeConfidence(), 'g', 3) + "%, widest 95% CI: ";
+        if (std::isinf(widest_relative_confidence))
+            summary += "not enough runs";
+        else
+            summary += "+/-" + QString::number(100.0 * widest_relative_confidence, 'f', 2) + '%';
+        my_painter.drawText(QRectF(label_width, 0.0, lines_size.width(), text_height), Qt::AlignTop | Qt::AlignRight, summary);
+    }
     highlighted_benchmark = nullptr;
     highlighted_argument = 0;
     int highlighted_color = 0;
@@ -518,25 +967,53 @@ void BenchmarkGraph::paintEvent(QPaintEvent *)
         double last_stddev = 0.0;
         int64_t last_key = 0;
         skb::BenchmarkResults * baseline = highlighted_benchmark->baseline_results;
-        for (const auto & one_point_result : highlighted_benchmark->results)
+        std::shared_ptr<const skb::ResultsSnapshot> snapshot = highlighted_benchmark->GetResults();
+        for (const auto & one_point_result : snapshot->by_argument)
         {
-            if (one_point_result.second.size() < 2)
-            {
-                has_previous = false;
-                continue;
-            }
             double mean = 0.0;
             double std_dev = 0.0;
-            for (const skb::RunResults & result : one_point_result.second)
+            size_t num_values = 0;
+            if (!y_axis_latencies && !y_axis_counter && !normalize_for_memory)
+            {
+                // plain time is what the order statistics keep, so this doesn't
+                // have to look at every run. the baseline only moves the mean
+                const skb::OrderStatisticsSummary & statistics = one_point_result.second->Statistics();
+                num_values = one_point_result.second->size();
+                if (num_values)
+                {
+                    mean = YValueFromResult(one_point_result.second->MedianRun(), baseline) - statistics.median.value + statistics.mean;
+                    std_dev = std::sqrt(statistics.variance);
+                    if (std::isnan(mean))
+                        num_values = 0;
+                }
+            }
+            else
+            {
+                for (const skb::RunResults & result : *one_point_result.second)
+                {
+                    double yval = YValueFromResult(result, baseline);
+                    if (std::isnan(yval))
+                        continue;
+                    mean += yval;
+                    ++num_values;
+                }
+                if (num_values)
+                {
+                    mean /= num_values;
+                    for (const skb::RunResults & result : *one_point_result.second)
+                    {
+                        double yval = YValueFromResult(result, baseline);
+                        if (!std::isnan(yval))
+                            std_dev += squared(mean - yval);
+                    }
+                    std_dev = std::sqrt(std_dev / num_values);
+                }
+            }
+            if (num_values < 2)
             {
-                double yval = yval_from_result(result, baseline);
-                mean += yval;
+                has_previous = false;
+                continue;
             }
-            mean /= one_point_result.second.size();
-            for (const skb::RunResults & result : one_point_result.second)
-                std_dev += squared(mean - yval_from_result(result, baseline));
-            std_dev /= one_point_result.second.size();
-            std_dev = std::sqrt(std_dev);
             if (has_previous)
             {
                 double last_min = position_y(last_mean - last_stddev);
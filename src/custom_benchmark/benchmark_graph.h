@@ -2,8 +2,11 @@
 
 #include "QtGui/QWidget"
 #include "custom_benchmark/custom_benchmark.h"
+#include "custom_benchmark/compare.hpp"
+#include "custom_benchmark/complexity.hpp"
 #include "signals/connection.hpp"
 #include "QtGui/QImage"
+#include <atomic>
 
 QString readable_xvalue(double xvalue);
 
@@ -24,6 +27,24 @@ public:
 
     void SetNormalizeForMemory(bool value);
     void SetDrawAsPoints(bool value);
+    // one row per benchmark and one cell per argument, colored from blue for
+    // the smallest y value to red for the largest. meant for benchmarks that
+    // use AddRange: the rows are sorted by the categories that differ between
+    // them, so the rows follow the second argument
+    void SetDrawAsHeatmap(bool value);
+    // fits O(1), O(log n), O(n) and so on to the medians of every line, in up
+    // to four pieces so that a change from one cache level to the next shows
+    // up as a new piece. draws the fits as dashed curves labeled with the rms
+    void SetFitComplexity(bool value);
+    // plot a hardware counter per item instead of nanoseconds per item. runs
+    // that don't have the counter are left out
+    void SetYAxisCounter(std::optional<skb::RunCounter> counter);
+    // plot the p50 of the per-iteration latencies, with the p99 and p99.9 as
+    // dashed and dotted lines. only benchmarks that use RecordLatencies show up
+    void SetYAxisLatencies(bool value);
+    // marks the points that are significantly faster or slower than the same
+    // benchmark in [executable]. an empty string turns it off
+    void SetCompareAgainst(interned_string executable);
 
     const std::vector<skb::BenchmarkResults *> & GetData() const
     {
@@ -33,6 +54,7 @@ public:
     void SetXLimit(int64_t limit)
     {
         xlimit = limit;
+        ++schedule_generation;
         lines_dirty = true;
         update();
     }
@@ -41,17 +63,49 @@ public:
         return xlimit;
     }
 
+    // a point is done once the 95% confidence interval of its median is within
+    // this fraction of the median. the benchmark threads read this
+    void SetTargetRelativeConfidence(double value);
+    double GetTargetRelativeConfidence() const
+    {
+        return target_relative_confidence.load(std::memory_order_relaxed);
+    }
+    // changes whenever the visible benchmarks, the x limit or the target change,
+    // so that the benchmark threads know to pick their candidates again
+    uint64_t GetScheduleGeneration() const
+    {
+        return schedule_generation.load(std::memory_order_acquire);
+    }
+
     GUI_CS_SIGNAL_1(Public, void RunBenchmarkFirst(skb::BenchmarkResults * benchmark, int64_t argument))
     GUI_CS_SIGNAL_2(RunBenchmarkFirst, benchmark, argument)
 
 private:
 
     int64_t xlimit = 0;
+    std::atomic<double> target_relative_confidence{ 0.01 };
+    std::atomic<uint64_t> schedule_generation{ 0 };
 
     std::vector<skb::BenchmarkResults *> data;
-    std::vector<sig2::Connection<skb::BenchmarkResults *>> callbacks;
+    // the results generations of data and their baselines, two per benchmark,
+    // as of the last check. the benchmark threads never call into the graph,
+    // so it looks for new results this often instead
+    static constexpr int results_poll_milliseconds = 50;
+    std::vector<uint64_t> seen_generations;
     bool normalize_for_memory = false;
     bool draw_as_points = false;
+    bool draw_as_heatmap = false;
+    bool fit_complexity = false;
+    std::map<skb::BenchmarkResults *, std::vector<skb::ComplexityFit>> complexity_fits;
+    std::optional<skb::RunCounter> y_axis_counter;
+    bool y_axis_latencies = false;
+    interned_string compare_against;
+    std::map<std::pair<skb::BenchmarkResults *, int64_t>, skb::ArgumentComparison> compared_points;
+    // what compared_points were computed from. the pairs change with the
+    // visible benchmarks, the snapshots whenever a run arrives on either side
+    std::vector<std::pair<skb::BenchmarkResults *, skb::BenchmarkResults *>> compared_pairs;
+    std::vector<std::shared_ptr<const skb::ResultsSnapshot>> compared_snapshots;
+    bool compared_pairs_dirty = true;
     QImage lines;
     bool lines_dirty = true;
     struct DrawnPoint
@@ -67,6 +121,10 @@ private:
     int64_t xmax = 0;
     double ymin = 0.0;
     double ymax = 0.0;
+    // for the summary in the corner, updated whenever the lines are drawn
+    size_t num_converged_points = 0;
+    size_t num_visible_points = 0;
+    double widest_relative_confidence = 0.0;
 
     skb::BenchmarkResults * highlighted_benchmark = nullptr;
     int64_t highlighted_argument = 0;
@@ -79,6 +137,18 @@ private:
     void mouseMoveEvent(QMouseEvent *event) override;
 
     void EmitBenchmark(skb::BenchmarkResults * benchmark, int64_t argument);
+    // redraws the lines if any of the benchmarks or their baselines got new results
+    void CheckForNewResults();
+    void DrawHeatmap(QPainter & painter, const std::function<double (double)> & position_x, double height);
+    // CompareBenchmarks sorts every run on both sides, so it only runs again
+    // when the pairs or their results have changed since the last time
+    void UpdateComparedPoints();
+    // [latency_percentile] is only used when plotting latencies
+    double YValueFromResult(const skb::RunResults & result, skb::BenchmarkResults * baseline, double latency_percentile = 0.5) const;
+    // the y value of a whole point: of the median run, except that latencies
+    // come from the histograms of all the runs together
+    double YValueFromRuns(const skb::RunSamples & runs, skb::BenchmarkResults * baseline, double latency_percentile = 0.5) const;
+    double NormalizeForMemory(double value, const skb::RunResults & result) const;
 
     enum ClipboardStringType
     {
@@ -0,0 +1,338 @@
+#include "custom_benchmark/compare.hpp"
+#include "custom_benchmark/statistics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+
+namespace skb
+{
+
+// everything that describes the benchmark rather than the build
+static std::string ComparisonKey(const BenchmarkCategories & categories)
+{
+    std::vector<std::pair<std::string_view, std::string_view>> sorted;
+    for (const auto & [category, value] : categories.GetCategories())
+    {
+        if (category == FilenameIndex() || category == BuildIndex() || category == BenchmarkCategories::CompilerIndex() || category == BenchmarkCategories::OptimizerIndex())
+            continue;
+        sorted.emplace_back(category.view(), value.view());
+    }
+    std::sort(sorted.begin(), sorted.end());
+    std::string result;
+    for (const auto & [category, value] : sorted)
+    {
+        result += category;
+        result += '=';
+        result += value;
+        result += '\n';
+    }
+    return result;
+}
+
+std::vector<std::pair<BenchmarkResults *, BenchmarkResults *>> FindComparisonPairs(interned_string before_executable, const std::vector<BenchmarkResults *> & candidates)
+{
+    std::map<std::string, BenchmarkResults *> before_by_key;
+    for (auto & [categories, results] : Benchmark::AllBenchmarks())
+    {
+        if (results.executable == before_executable)
+            before_by_key.emplace(ComparisonKey(categories), &results);
+    }
+    std::vector<std::pair<BenchmarkResults *, BenchmarkResults *>> result;
+    for (BenchmarkResults * candidate : candidates)
+    {
+        if (candidate->executable == before_executable)
+            continue;
+        auto found = before_by_key.find(ComparisonKey(*candidate->categories));
+        if (found != before_by_key.end())
+            result.emplace_back(found->second, candidate);
+    }
+    return result;
+}
+
+// sorted
+static std::map<int64_t, std::vector<double>> NanosecondsPerItemByArgument(const BenchmarkResults & benchmark)
+{
+    std::map<int64_t, std::vector<double>> result;
+    std::shared_ptr<const ResultsSnapshot> snapshot = benchmark.GetResults();
+    for (const auto & [argument, runs] : snapshot->by_argument)
+    {
+        if (argument <= 0 || runs->empty())
+            continue;
+        result[argument] = runs->SortedNanosecondsPerItem();
+    }
+    return result;
+}
+
+static double Median(const std::vector<double> & sorted_values)
+{
+    return sorted_values[(sorted_values.size() - 1) / 2];
+}
+
+std::vector<BenchmarkComparison> CompareBenchmarks(const std::vector<std::pair<BenchmarkResults *, BenchmarkResults *>> & pairs, const ComparisonOptions & options)
+{
+    std::vector<BenchmarkComparison> result;
+    std::vector<double> p_values;
+    for (const auto & [before, after] : pairs)
+    {
+        BenchmarkComparison & comparison = result.emplace_back();
+        comparison.before = before;
+        comparison.after = after;
+        std::map<int64_t, std::vector<double>> before_runs = NanosecondsPerItemByArgument(*before);
+        std::map<int64_t, std::vector<double>> after_runs = NanosecondsPerItemByArgument(*after);
+        for (const auto & [argument, after_nanoseconds] : after_runs)
+        {
+            auto found = before_runs.find(argument);
+            if (found == before_runs.end())
+                continue;
+            const std::vector<double> & before_nanoseconds = found->second;
+            ArgumentComparison & one = comparison.arguments.emplace_back();
+            one.argument = argument;
+            one.num_runs_before = before_nanoseconds.size();
+            one.num_runs_after = after_nanoseconds.size();
+            one.median_before = Median(before_nanoseconds);
+            one.median_after = Median(after_nanoseconds);
+            if (one.median_before != 0.0)
+                one.relative_change = one.median_after / one.median_before - 1.0;
+            if (one.num_runs_before < options.min_runs || one.num_runs_after < options.min_runs)
+                continue;
+            MannWhitneyResult test = MannWhitneyUTest(before_nanoseconds, after_nanoseconds);
+            one.rank_biserial = test.rank_biserial;
+            one.p_value = test.p_value;
+            one.verdict = ArgumentComparison::Unchanged;
+            p_values.push_back(test.p_value);
+        }
+    }
+
+    std::vector<double> adjusted = HolmAdjustedPValues(p_values);
+    auto next_adjusted = adjusted.begin();
+    for (BenchmarkComparison & comparison : result)
+    {
+        for (ArgumentComparison & one : comparison.arguments)
+        {
+            if (one.verdict == ArgumentComparison::NotEnoughRuns)
+                continue;
+            one.adjusted_p_value = *next_adjusted++;
+            if (one.adjusted_p_value >= options.alpha || std::abs(one.relative_change) < options.min_relative_change)
+                continue;
+            one.verdict = one.relative_change < 0.0 ? ArgumentComparison::Faster : ArgumentComparison::Slower;
+        }
+    }
+    return result;
+}
+
+// the first run of every block
+static std::map<int64_t, double> RawNanosecondsPerItemByBlock(const BenchmarkResults & benchmark, int64_t argument)
+{
+    std::map<int64_t, double> result;
+    std::shared_ptr<const ResultsSnapshot> snapshot = benchmark.GetResults();
+    const RunSamples * runs = snapshot->Find(argument);
+    if (!runs)
+        return result;
+    for (const RunResults & run : *runs)
+    {
+        if (run.block != 0)
+            result.emplace(run.block, run.GetNanosecondsPerItem(nullptr));
+    }
+    return result;
+}
+// minus the baseline run of the same block, which has the same block id. the
+// baseline drifts along with everything else, so its median wouldn't do. blocks
+// without a baseline run are left out
+static std::map<int64_t, double> NanosecondsPerItemByBlock(const BenchmarkResults & benchmark, int64_t argument)
+{
+    std::map<int64_t, double> result = RawNanosecondsPerItemByBlock(benchmark, argument);
+    if (!benchmark.baseline_results)
+        return result;
+    std::map<int64_t, double> baseline = RawNanosecondsPerItemByBlock(*benchmark.baseline_results, argument);
+    for (auto it = result.begin(); it != result.end();)
+    {
+        auto found = baseline.find(it->first);
+        if (found == baseline.end())
+            it = result.erase(it);
+        else
+        {
+            it->second -= found->second;
+            ++it;
+        }
+    }
+    return result;
+}
+
+PairedComparison ComparePaired(const BenchmarkResults & a, const BenchmarkResults & b, int64_t argument)
+{
+    std::map<int64_t, double> a_by_block = NanosecondsPerItemByBlock(a, argument);
+    std::map<int64_t, double> b_by_block = NanosecondsPerItemByBlock(b, argument);
+    std::vector<double> relative_differences;
+    for (const auto & [block, a_nanoseconds] : a_by_block)
+    {
+        auto found = b_by_block.find(block);
+        if (found == b_by_block.end() || a_nanoseconds == 0.0)
+            continue;
+        relative_differences.push_back(found->second / a_nanoseconds - 1.0);
+    }
+    PairedComparison result;
+    result.num_pairs = relative_differences.size();
+    result.relative_difference = ComputeMedianConfidenceInterval(relative_differences);
+    return result;
+}
+
+ComparisonSummary PrintComparison(const std::vector<BenchmarkComparison> & comparisons, std::ostream & out)
+{
+    ComparisonSummary summary;
+    for (const BenchmarkComparison & comparison : comparisons)
+    {
+        for (const ArgumentComparison & one : comparison.arguments)
+        {
+            switch (one.verdict)
+            {
+            case ArgumentComparison::NotEnoughRuns:
+                ++summary.num_not_enough_runs;
+                continue;
+            case ArgumentComparison::Unchanged:
+                ++summary.num_unchanged;
+                continue;
+            case ArgumentComparison::Faster:
+                ++summary.num_faster;
+                out << "faster: ";
+                break;
+            case ArgumentComparison::Slower:
+                ++summary.num_slower;
+                out << "slower: ";
+                break;
+            }
+            out << comparison.after->categories->CategoriesString() << '/' << one.argument
+                << ": " << one.median_before << "ns -> " << one.median_after << "ns ("
+                << (one.relative_change > 0.0 ? "+" : "") << 100.0 * one.relative_change << "%"
+                << ", rank-biserial " << one.rank_biserial
+                << ", adjusted p " << one.adjusted_p_value
+                << ", runs " << one.num_runs_before << '/' << one.num_runs_after << ")\n";
+        }
+    }
+    out << summary.num_slower << " slower, " << summary.num_faster << " faster, "
+        << summary.num_unchanged << " unchanged, " << summary.num_not_enough_runs << " without enough runs\n";
+    return summary;
+}
+
+}
+
+#include "test/include_test.hpp"
+
+TEST(compare, detects_regression)
+{
+    skb::BenchmarkCategories before_categories("compare test", "compare_test_benchmark");
+    before_categories.AddCategory(skb::BenchmarkCategories::CompilerIndex(), "gcc");
+    skb::BenchmarkCategories after_categories("compare test", "compare_test_benchmark");
+    after_categories.AddCategory(skb::BenchmarkCategories::CompilerIndex(), "clang");
+    skb::BenchmarkResults before(nullptr);
+    skb::BenchmarkResults after(nullptr);
+    before.categories = &before_categories;
+    after.categories = &after_categories;
+    for (int i = 0; i < 10; ++i)
+    {
+        // argument 1 gets 20% slower, argument 2 stays the same
+        before.AddResult({ 1, 1, std::chrono::nanoseconds(100 + i), 0, 0 });
+        after.AddResult({ 1, 1, std::chrono::nanoseconds(120 + i), 0, 0 });
+        before.AddResult({ 1, 2, std::chrono::nanoseconds(100 + i), 0, 0 });
+        after.AddResult({ 1, 2, std::chrono::nanoseconds(100 + (i * 7) % 10), 0, 0 });
+    }
+    // too few runs to say anything
+    before.AddResult({ 1, 4, std::chrono::nanoseconds(100), 0, 0 });
+    after.AddResult({ 1, 4, std::chrono::nanoseconds(200), 0, 0 });
+
+    std::vector<skb::BenchmarkComparison> comparisons = skb::CompareBenchmarks({ { &before, &after } }, {});
+    ASSERT_EQ(1u, comparisons.size());
+    ASSERT_EQ(3u, comparisons[0].arguments.size());
+    ASSERT_EQ(skb::ArgumentComparison::Slower, comparisons[0].arguments[0].verdict);
+    ASSERT_NEAR(0.2, comparisons[0].arguments[0].relative_change, 0.01);
+    ASSERT_EQ(skb::ArgumentComparison::Unchanged, comparisons[0].arguments[1].verdict);
+    ASSERT_EQ(skb::ArgumentComparison::NotEnoughRuns, comparisons[0].arguments[2].verdict);
+}
+
+TEST(compare, paired_blocks_cancel_drift)
+{
+    skb::BenchmarkResults a(nullptr);
+    skb::BenchmarkResults b(nullptr);
+    for (int i = 0; i < 20; ++i)
+    {
+        // the machine gets 2% slower with every block, b is always 5% slower than a
+        double drift = 1.0 + 0.02 * i;
+        skb::RunResults a_run = { 1, 8, std::chrono::nanoseconds(std::llround(1000 * drift)), 0, 0 };
+        skb::RunResults b_run = { 1, 8, std::chrono::nanoseconds(std::llround(1050 * drift)), 0, 0 };
+        a_run.block = b_run.block = 100 + i;
+        a.AddResult(a_run);
+        b.AddResult(b_run);
+    }
+    // runs outside of a block are never paired
+    a.AddResult({ 1, 8, std::chrono::nanoseconds(500), 0, 0 });
+    b.AddResult({ 1, 8, std::chrono::nanoseconds(5000), 0, 0 });
+
+    skb::PairedComparison paired = skb::ComparePaired(a, b, 8);
+    ASSERT_EQ(20u, paired.num_pairs);
+    ASSERT_TRUE(paired.relative_difference.valid);
+    ASSERT_NEAR(0.05, paired.relative_difference.median, 0.001);
+    ASSERT_NEAR(0.05, paired.relative_difference.low, 0.001);
+    ASSERT_NEAR(0.05, paired.relative_difference.high, 0.001);
+    // the independent medians can't tell the two apart
+    ASSERT_GT(a.GetResults()->Find(8)->GetMedianConfidenceInterval().RelativeHalfWidth(), 0.05);
+    ASSERT_EQ(0u, skb::ComparePaired(a, b, 16).num_pairs);
+}
+
+TEST(compare, executables_with_the_same_name_stay_apart)
+{
+    skb::BenchmarkCategories categories("same name test", "same_name_test_benchmark");
+    std::string listing = "V1\nBenchmarkWithoutBaseline\n" + skb::Benchmark::RangeOfArguments{ 1, 16, 2.0 }.Serialize() + '\n' + categories.Serialize() + '\n';
+    interned_string first("/tmp/build_a/same_name_test");
+    interned_string second("/tmp/build_b/same_name_test");
+    skb::LoadAllBenchmarks(first, listing);
+    skb::LoadAllBenchmarks(second, listing);
+    std::map<interned_string, skb::BenchmarkResults *, interned_string::pointer_less> by_executable;
+    for (auto & [loaded_categories, results] : skb::Benchmark::AllBenchmarks())
+    {
+        if (loaded_categories.GetName() != "same_name_test_benchmark")
+            continue;
+        ASSERT_EQ(interned_string("same_name_test"), loaded_categories.GetCategories().find(skb::FilenameIndex())->second);
+        by_executable.emplace(results.executable, &results);
+    }
+    ASSERT_EQ(2u, by_executable.size());
+    // only the one that came second needs the directory
+    ASSERT_FALSE(by_executable[first]->categories->GetCategories().count(skb::BuildIndex()));
+    ASSERT_EQ(interned_string("/tmp/build_b"), by_executable[second]->categories->GetCategories().find(skb::BuildIndex())->second);
+
+    std::vector<std::pair<skb::BenchmarkResults *, skb::BenchmarkResults *>> pairs = skb::FindComparisonPairs(first, { by_executable[second] });
+    ASSERT_EQ(1u, pairs.size());
+    ASSERT_EQ(by_executable[first], pairs[0].first);
+}
+
+TEST(compare, paired_blocks_subtract_their_baseline)
+{
+    skb::BenchmarkResults baseline(nullptr);
+    skb::BenchmarkResults a(nullptr);
+    skb::BenchmarkResults b(nullptr);
+    a.baseline_results = &baseline;
+    b.baseline_results = &baseline;
+    for (int i = 0; i < 20; ++i)
+    {
+        // the loop around the benchmark takes 500 of the time, and drifts along
+        double drift = 1.0 + 0.02 * i;
+        skb::RunResults baseline_run = { 1, 8, std::chrono::nanoseconds(std::llround(500 * drift)), 0, 0 };
+        skb::RunResults a_run = { 1, 8, std::chrono::nanoseconds(std::llround(1500 * drift)), 0, 0 };
+        skb::RunResults b_run = { 1, 8, std::chrono::nanoseconds(std::llround(1550 * drift)), 0, 0 };
+        baseline_run.block = a_run.block = b_run.block = 200 + i;
+        // a and b both ran the baseline in the block
+        baseline.AddResult(baseline_run);
+        baseline.AddResult(baseline_run);
+        a.AddResult(a_run);
+        b.AddResult(b_run);
+    }
+    // a block without a baseline run can't be paired
+    skb::RunResults a_run = { 1, 8, std::chrono::nanoseconds(1500), 0, 0 };
+    skb::RunResults b_run = { 1, 8, std::chrono::nanoseconds(3000), 0, 0 };
+    a_run.block = b_run.block = 300;
+    a.AddResult(a_run);
+    b.AddResult(b_run);
+
+    skb::PairedComparison paired = skb::ComparePaired(a, b, 8);
+    ASSERT_EQ(20u, paired.num_pairs);
+    // 1050 / 1000, not 1550 / 1500
+    ASSERT_NEAR(0.05, paired.relative_difference.median, 0.001);
+}
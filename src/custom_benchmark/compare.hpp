@@ -0,0 +1,82 @@
+#pragma once
+
+#include "custom_benchmark/custom_benchmark.h"
+#include <iosfwd>
+
+namespace skb
+{
+struct ComparisonOptions
+{
+    // the chance of reporting even one change that isn't real, across all
+    // arguments of all the benchmarks that are compared together
+    double alpha = 0.05;
+    // smaller changes of the median are not reported even if they are significant
+    double min_relative_change = 0.01;
+    // arguments where either side has fewer runs are skipped
+    size_t min_runs = 6;
+};
+
+struct ArgumentComparison
+{
+    enum Verdict
+    {
+        NotEnoughRuns,
+        Unchanged,
+        Faster,
+        Slower
+    };
+
+    int64_t argument = 0;
+    size_t num_runs_before = 0;
+    size_t num_runs_after = 0;
+    double median_before = 0.0;
+    double median_after = 0.0;
+    // median_after / median_before - 1
+    double relative_change = 0.0;
+    // positive if the runs after the change tend to be slower
+    double rank_biserial = 0.0;
+    double p_value = 1.0;
+    double adjusted_p_value = 1.0;
+    Verdict verdict = NotEnoughRuns;
+};
+
+struct BenchmarkComparison
+{
+    BenchmarkResults * before = nullptr;
+    BenchmarkResults * after = nullptr;
+    std::vector<ArgumentComparison> arguments;
+};
+
+// pairs up benchmarks from two builds: two benchmarks belong together if all
+// their categories except for the filename, the compiler and the optimizer match.
+// every benchmark in [candidates] that is not from [before_executable] and has a
+// partner from [before_executable] gets a pair
+std::vector<std::pair<BenchmarkResults *, BenchmarkResults *>> FindComparisonPairs(interned_string before_executable, const std::vector<BenchmarkResults *> & candidates);
+
+// runs a Mann-Whitney U test on the nanoseconds per item of each argument that
+// both sides have, then corrects the p-values of all the tests together
+std::vector<BenchmarkComparison> CompareBenchmarks(const std::vector<std::pair<BenchmarkResults *, BenchmarkResults *>> & pairs, const ComparisonOptions & options);
+
+struct PairedComparison
+{
+    size_t num_pairs = 0;
+    // of the nanoseconds per item of b / a - 1, over the blocks in which both
+    // ran, each with the baseline run of its block subtracted. the drift
+    // between blocks cancels out, so this interval is much narrower than the
+    // intervals of the two medians on their own
+    MedianConfidenceInterval relative_difference;
+};
+// pairs up the runs of [a] and [b] at [argument] that ran in the same block.
+// see BenchmarkResults::NewBlockId
+PairedComparison ComparePaired(const BenchmarkResults & a, const BenchmarkResults & b, int64_t argument);
+
+struct ComparisonSummary
+{
+    size_t num_faster = 0;
+    size_t num_slower = 0;
+    size_t num_unchanged = 0;
+    size_t num_not_enough_runs = 0;
+};
+// one line per significant change, plus the counts at the end
+ComparisonSummary PrintComparison(const std::vector<BenchmarkComparison> & comparisons, std::ostream & out);
+}
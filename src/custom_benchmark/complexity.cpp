@@ -0,0 +1,286 @@
+#include "custom_benchmark/complexity.hpp"
+#include "debug/assert.hpp"
+#include <cmath>
+#include <limits>
+
+namespace skb
+{
+
+std::string_view ComplexityName(Complexity complexity)
+{
+    switch (complexity)
+    {
+    case Complexity::Constant:
+        return "O(1)";
+    case Complexity::LogN:
+        return "O(log n)";
+    case Complexity::N:
+        return "O(n)";
+    case Complexity::NLogN:
+        return "O(n log n)";
+    case Complexity::NSquared:
+        return "O(n^2)";
+    case Complexity::NCubed:
+        return "O(n^3)";
+    }
+    CHECK_FOR_PROGRAMMER_ERROR(false);
+    return "";
+}
+
+double ComplexityFunction(Complexity complexity, double n)
+{
+    switch (complexity)
+    {
+    case Complexity::Constant:
+        return 1.0;
+    case Complexity::LogN:
+        return std::log2(n);
+    case Complexity::N:
+        return n;
+    case Complexity::NLogN:
+        return n * std::log2(n);
+    case Complexity::NSquared:
+        return n * n;
+    case Complexity::NCubed:
+        return n * n * n;
+    }
+    CHECK_FOR_PROGRAMMER_ERROR(false);
+    return 0.0;
+}
+
+namespace
+{
+// running sums for one complexity, so that the fit of any range of points is
+// a subtraction instead of a loop. the functions grow, so the sums before a
+// range are never much larger than the range itself and don't cancel badly
+struct FitSums
+{
+    double value = 0.0;
+    double value_squared = 0.0;
+    double value_times_function = 0.0;
+    double function_squared = 0.0;
+
+    FitSums operator-(const FitSums & other) const
+    {
+        return { value - other.value, value_squared - other.value_squared, value_times_function - other.value_times_function, function_squared - other.function_squared };
+    }
+};
+
+struct PrefixSums
+{
+    PrefixSums(const std::vector<ComplexityPoint> & points)
+        : points(points)
+    {
+        for (Complexity complexity : all_complexities)
+        {
+            std::vector<FitSums> & sums = by_complexity[static_cast<int>(complexity)];
+            sums.reserve(points.size() + 1);
+            FitSums running;
+            sums.push_back(running);
+            for (const ComplexityPoint & point : points)
+            {
+                double function = ComplexityFunction(complexity, static_cast<double>(point.argument));
+                running.value += point.value;
+                running.value_squared += point.value * point.value;
+                running.value_times_function += point.value * function;
+                running.function_squared += function * function;
+                sums.push_back(running);
+            }
+        }
+    }
+
+    // for the points in [begin, end)
+    ComplexityFit Fit(size_t begin, size_t end, Complexity complexity) const
+    {
+        const std::vector<FitSums> & sums = by_complexity[static_cast<int>(complexity)];
+        FitSums range = sums[end] - sums[begin];
+        ComplexityFit result;
+        result.complexity = complexity;
+        result.first_argument = points[begin].argument;
+        result.last_argument = points[end - 1].argument;
+        result.num_points = end - begin;
+        double count = static_cast<double>(end - begin);
+        double squared_error = range.value_squared;
+        if (range.function_squared > 0.0)
+        {
+            result.coefficient = range.value_times_function / range.function_squared;
+            squared_error -= result.coefficient * range.value_times_function;
+        }
+        double mean = range.value / count;
+        if (mean == 0.0)
+            result.rms = squared_error > 0.0 ? std::numeric_limits<double>::infinity() : 0.0;
+        else
+            result.rms = std::sqrt(std::max(0.0, squared_error) / count) / std::abs(mean);
+        return result;
+    }
+    ComplexityFit BestFit(size_t begin, size_t end) const
+    {
+        ComplexityFit best = Fit(begin, end, Complexity::Constant);
+        for (Complexity complexity : all_complexities)
+        {
+            ComplexityFit fit = Fit(begin, end, complexity);
+            // strictly less, so that a tie goes to the simpler complexity
+            if (fit.rms < best.rms)
+                best = fit;
+        }
+        return best;
+    }
+
+    const std::vector<ComplexityPoint> & points;
+    std::vector<FitSums> by_complexity[std::size(all_complexities)];
+};
+
+// the sum of the squared relative residuals
+double Cost(const ComplexityFit & fit)
+{
+    return fit.rms * fit.rms * fit.num_points;
+}
+}
+
+ComplexityFit FitComplexity(const std::vector<ComplexityPoint> & points, Complexity complexity)
+{
+    CHECK_FOR_PROGRAMMER_ERROR(!points.empty());
+    return PrefixSums(points).Fit(0, points.size(), complexity);
+}
+ComplexityFit FitComplexity(const std::vector<ComplexityPoint> & points)
+{
+    CHECK_FOR_PROGRAMMER_ERROR(!points.empty());
+    return PrefixSums(points).BestFit(0, points.size());
+}
+
+std::vector<ComplexityFit> FitPiecewiseComplexity(const std::vector<ComplexityPoint> & points, int max_pieces, size_t min_points_per_piece)
+{
+    if (points.empty())
+        return {};
+    min_points_per_piece = std::max(size_t(1), min_points_per_piece);
+    size_t num_points = points.size();
+    max_pieces = std::max(1, std::min(max_pieces, static_cast<int>(num_points / min_points_per_piece)));
+    PrefixSums sums(points);
+
+    // best_cost[k][end] is the lowest cost of splitting the first [end] points
+    // into k + 1 pieces, and split[k][end] is where the last of those pieces begins
+    static constexpr double no_split = std::numeric_limits<double>::infinity();
+    std::vector<std::vector<double>> best_cost(max_pieces, std::vector<double>(num_points + 1, no_split));
+    std::vector<std::vector<size_t>> split(max_pieces, std::vector<size_t>(num_points + 1, 0));
+    for (size_t end = min_points_per_piece; end <= num_points; ++end)
+        best_cost[0][end] = Cost(sums.BestFit(0, end));
+    for (int k = 1; k < max_pieces; ++k)
+    {
+        for (size_t end = (k + 1) * min_points_per_piece; end <= num_points; ++end)
+        {
+            for (size_t begin = k * min_points_per_piece; begin + min_points_per_piece <= end; ++begin)
+            {
+                if (best_cost[k - 1][begin] == no_split)
+                    continue;
+                double cost = best_cost[k - 1][begin] + Cost(sums.BestFit(begin, end));
+                if (cost < best_cost[k][end])
+                {
+                    best_cost[k][end] = cost;
+                    split[k][end] = begin;
+                }
+            }
+        }
+    }
+
+    // each piece costs a coefficient, a complexity and a split point. the floor
+    // on the error is far below measurement noise, it only keeps a perfect fit
+    // from being worth any number of pieces
+    static constexpr double parameters_per_piece = 3.0;
+    static constexpr double min_squared_error_per_point = 1e-6;
+    double n = static_cast<double>(num_points);
+    int best_num_pieces = 1;
+    double best_criterion = std::numeric_limits<double>::infinity();
+    for (int k = 0; k < max_pieces; ++k)
+    {
+        if (best_cost[k][num_points] == no_split)
+            continue;
+        double squared_error = std::max(best_cost[k][num_points], min_squared_error_per_point * n);
+        double criterion = n * std::log(squared_error / n) + (k + 1) * parameters_per_piece * std::log(n);
+        if (criterion < best_criterion)
+        {
+            best_criterion = criterion;
+            best_num_pieces = k + 1;
+        }
+    }
+    if (best_criterion == std::numeric_limits<double>::infinity())
+        return { sums.BestFit(0, num_points) };
+
+    std::vector<ComplexityFit> result(best_num_pieces);
+    size_t end = num_points;
+    for (int k = best_num_pieces - 1; k >= 0; --k)
+    {
+        size_t begin = split[k][end];
+        result[k] = sums.BestFit(begin, end);
+        end = begin;
+    }
+    return result;
+}
+
+std::vector<ComplexityPoint> MedianNanosecondsPerItem(const BenchmarkResults & results)
+{
+    std::vector<ComplexityPoint> points;
+    std::shared_ptr<const ResultsSnapshot> snapshot = results.GetResults();
+    for (const auto & [argument, runs] : snapshot->by_argument)
+    {
+        if (argument <= 0 || runs->empty())
+            continue;
+        double nanoseconds = runs->MedianRun().GetNanosecondsPerItem(results.baseline_results);
+        // the baseline hasn't run at this argument yet
+        if (std::isnan(nanoseconds))
+            continue;
+        points.push_back({ argument, nanoseconds });
+    }
+    return points;
+}
+
+}
+
+#include "test/include_test.hpp"
+
+TEST(complexity, single_fit)
+{
+    std::vector<skb::ComplexityPoint> points;
+    for (int64_t n = 4; n <= (1 << 20); n *= 2)
+        points.push_back({ n, 2.0 * n * std::log2(n) });
+    skb::ComplexityFit fit = skb::FitComplexity(points);
+    ASSERT_EQ(skb::Complexity::NLogN, fit.complexity);
+    ASSERT_NEAR(2.0, fit.coefficient, 1e-9);
+    ASSERT_NEAR(0.0, fit.rms, 1e-6);
+    ASSERT_EQ(4, fit.first_argument);
+    ASSERT_EQ(1 << 20, fit.last_argument);
+    ASSERT_NEAR(2.0 * 1024 * 10, fit.Evaluate(1024), 1e-6);
+
+    skb::ComplexityFit forced = skb::FitComplexity(points, skb::Complexity::Constant);
+    ASSERT_GT(forced.rms, 1.0);
+}
+
+TEST(complexity, piecewise_finds_the_regime_change)
+{
+    // logarithmic while it fits in cache, then every item costs a miss that
+    // grows with the size
+    std::vector<skb::ComplexityPoint> points;
+    for (int64_t n = 4; n <= (1 << 12); n *= 2)
+        points.push_back({ n, 5.0 * std::log2(n) });
+    for (int64_t n = 1 << 13; n <= (1 << 22); n *= 2)
+        points.push_back({ n, 0.01 * n });
+    std::vector<skb::ComplexityFit> fits = skb::FitPiecewiseComplexity(points);
+    ASSERT_EQ(2u, fits.size());
+    ASSERT_EQ(skb::Complexity::LogN, fits[0].complexity);
+    ASSERT_NEAR(5.0, fits[0].coefficient, 1e-9);
+    ASSERT_EQ(1 << 12, fits[0].last_argument);
+    ASSERT_EQ(skb::Complexity::N, fits[1].complexity);
+    ASSERT_EQ(1 << 13, fits[1].first_argument);
+    ASSERT_NEAR(0.01, fits[1].coefficient, 1e-9);
+}
+
+TEST(complexity, piecewise_does_not_split_noise)
+{
+    std::vector<skb::ComplexityPoint> points;
+    for (int i = 0; i < 20; ++i)
+        points.push_back({ int64_t(4) << i, 10.0 * (1.0 + ((i * 7) % 5 - 2) * 0.01) });
+    std::vector<skb::ComplexityFit> fits = skb::FitPiecewiseComplexity(points);
+    ASSERT_EQ(1u, fits.size());
+    ASSERT_EQ(skb::Complexity::Constant, fits[0].complexity);
+    ASSERT_LT(fits[0].rms, 0.02);
+    ASSERT_TRUE(skb::FitPiecewiseComplexity({}).empty());
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "custom_benchmark/custom_benchmark.h"
+#include <string_view>
+#include <vector>
+
+namespace skb
+{
+// the same candidates as the complexity fitting in libs/benchmark. the fits
+// below are of whatever is plotted, which is usually the time per item, so
+// O(log n) means that every item takes logarithmic time
+enum class Complexity
+{
+    Constant,
+    LogN,
+    N,
+    NLogN,
+    NSquared,
+    NCubed
+};
+inline constexpr Complexity all_complexities[] = { Complexity::Constant, Complexity::LogN, Complexity::N, Complexity::NLogN, Complexity::NSquared, Complexity::NCubed };
+
+std::string_view ComplexityName(Complexity complexity);
+double ComplexityFunction(Complexity complexity, double n);
+
+struct ComplexityPoint
+{
+    int64_t argument = 0;
+    double value = 0.0;
+};
+
+struct ComplexityFit
+{
+    Complexity complexity = Complexity::Constant;
+    double coefficient = 0.0;
+    // the root mean square of the residuals divided by the mean of the values,
+    // the way google benchmark reports it
+    double rms = 0.0;
+    // the range of arguments that this fit covers
+    int64_t first_argument = 0;
+    int64_t last_argument = 0;
+    size_t num_points = 0;
+
+    double Evaluate(double n) const
+    {
+        return coefficient * ComplexityFunction(complexity, n);
+    }
+};
+
+// least squares fit of value = coefficient * f(argument). the points have to be
+// sorted by argument
+ComplexityFit FitComplexity(const std::vector<ComplexityPoint> & points, Complexity complexity);
+// tries every complexity and returns the one with the lowest rms
+ComplexityFit FitComplexity(const std::vector<ComplexityPoint> & points);
+
+// splits the sorted points into up to [max_pieces] ranges of consecutive
+// arguments that each get their own best fit. this finds where a benchmark
+// falls out of a cache level: the time per item jumps or changes its shape.
+// every additional piece has to pay for itself by explaining much more of the
+// variation (the bayesian information criterion), so smooth curves stay in one
+// piece and noise doesn't get split up
+std::vector<ComplexityFit> FitPiecewiseComplexity(const std::vector<ComplexityPoint> & points, int max_pieces = 4, size_t min_points_per_piece = 4);
+
+// the median nanoseconds per item of every argument
+std::vector<ComplexityPoint> MedianNanosecondsPerItem(const BenchmarkResults & results);
+}
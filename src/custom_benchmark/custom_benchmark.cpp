@@ -1,5 +1,7 @@
 #include "custom_benchmark/custom_benchmark.h"
+#include <algorithm>
 #include <charconv>
+#include <cmath>
 #include <cstring>
 #include <string_view>
 #include <iostream>
@@ -7,9 +9,20 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/personality.h>
+#include <csignal>
+#include <atomic>
+#include <deque>
+#include <set>
 #include <sstream>
+#include <thread>
 #include "util/random_seed_seq.hpp"
 #include "custom_benchmark/profile_mode.hpp"
+#include "custom_benchmark/run_record.hpp"
+#include "custom_benchmark/perf_counters.hpp"
 
 thread_local std::mt19937_64 global_randomness(random_seed_seq::get_instance());
 
@@ -21,6 +34,9 @@ double global_double = 0.0;
 
 const char * const LIST_ALL_BENCHMARKS = "--list-all-benchmarks";
 const char * const RUN_BENCHMARK_THEN_EXIT = "--run-benchmark-then-exit";
+const char * const RUN_AS_WORKER = "--run-as-worker";
+const char * const RUN_AS_FORK_SERVER = "--fork-server";
+const char * const MEASURE_SPAWN_LATENCY = "--measure-spawn-latency";
 
 const float BenchmarkResults::default_run_time = 0.25f;
 
@@ -49,6 +65,165 @@ State::State(int num_iterations, int64_t argument)
 {
 }
 
+int64_t State::ChronoTimerOverhead()
+{
+    static const int64_t result = []
+    {
+        std::vector<int64_t> overheads;
+        for (int i = 0; i < 255; ++i)
+        {
+            int64_t start = ReadChronoTimer();
+            overheads.push_back(ReadChronoTimer() - start);
+        }
+        std::nth_element(overheads.begin(), overheads.begin() + overheads.size() / 2, overheads.end());
+        return overheads[overheads.size() / 2];
+    }();
+    return result;
+}
+
+double State::TicksToNanoseconds(int64_t ticks, int num_intervals) const
+{
+    // every interval between a start and a stop read contains the cost of one read
+    if (timer == ChronoTimer)
+        return static_cast<double>(std::max(int64_t(0), ticks - ChronoTimerOverhead() * num_intervals));
+    const CycleClock::Calibration & calibration = CycleClock::GetCalibration();
+    ticks = std::max(int64_t(0), ticks - calibration.overhead_ticks * num_intervals);
+    return ticks * calibration.nanoseconds_per_tick;
+}
+
+std::chrono::nanoseconds State::GetTotalTime() const
+{
+    return std::chrono::nanoseconds(std::llround(TicksToNanoseconds(total_ticks - paused_ticks, num_pauses + num_timed_intervals)));
+}
+
+int State::NextBatch()
+{
+    if (finished)
+        return 0;
+    int64_t stop = ReadTimerStop();
+    total_ticks += stop - start;
+    ++num_timed_intervals;
+    if (perf_counters)
+        PauseCounters();
+    if (latencies)
+    {
+        int64_t batch_ticks = stop - start - (paused_ticks - batch_start_paused_ticks);
+        double nanoseconds = TicksToNanoseconds(batch_ticks, 1 + num_pauses - batch_start_num_pauses);
+        latencies->Record(static_cast<uint64_t>(std::llround(nanoseconds / current_batch_size)));
+    }
+    if (iterations_not_started == 0)
+    {
+        finished = true;
+        loop_stop = stop;
+        if (perf_counters)
+            StopCounters();
+        return 0;
+    }
+    current_batch_size = std::min(latency_batch_size, iterations_not_started);
+    iterations_not_started -= current_batch_size;
+    batch_start_paused_ticks = paused_ticks;
+    batch_start_num_pauses = num_pauses;
+    if (perf_counters)
+        ResumeCounters();
+    start = ReadTimerStart();
+    return current_batch_size;
+}
+
+RunResults State::CombineThreadResults(const std::vector<State> & threads)
+{
+    CHECK_FOR_PROGRAMMER_ERROR(!threads.empty());
+    // the first thread is the one that has the counters and the latencies
+    RunResults result = threads.front().GetResults();
+    int64_t first_start = threads.front().loop_start;
+    int64_t last_stop = threads.front().loop_stop;
+    std::chrono::nanoseconds thread_time = result.time;
+    for (auto it = threads.begin() + 1; it != threads.end(); ++it)
+    {
+        first_start = std::min(first_start, it->loop_start);
+        last_stop = std::max(last_stop, it->loop_stop);
+        thread_time += it->GetTotalTime();
+        result.num_items_processed += it->num_items_processed;
+        // TrackAllocations only measures on the first thread, so these only
+        // add up numbers that the benchmark set itself
+        result.num_bytes_used += it->num_bytes_used;
+        result.peak_bytes = std::max(result.peak_bytes, it->peak_bytes);
+        result.num_allocations += it->num_allocations;
+    }
+    result.num_threads = static_cast<int>(threads.size());
+    result.thread_time = thread_time / result.num_threads;
+    result.time = std::chrono::nanoseconds(std::llround(threads.front().TicksToNanoseconds(last_stop - first_start, 1)));
+    return result;
+}
+
+void State::StartCounters()
+{
+    perf_counters->Start();
+}
+void State::PauseCounters()
+{
+    perf_counters->Pause();
+}
+void State::ResumeCounters()
+{
+    perf_counters->Resume();
+}
+void State::StopCounters()
+{
+    perf_counters->Pause();
+    perf_counters->ReadInto(counters);
+}
+void State::LockMemory()
+{
+    // only what is mapped now. with MCL_FUTURE every allocation in the loop
+    // would fail once it goes over RLIMIT_MEMLOCK
+    memory_locked = mlockall(MCL_CURRENT) == 0;
+}
+
+std::string RunEnvironment::ToString() const
+{
+    std::string result;
+    auto add = [&](std::string_view part)
+    {
+        if (!result.empty())
+            result += ", ";
+        result += part;
+    };
+    if (Has(NoAslr))
+        add("no aslr");
+    if (Has(FifoScheduling))
+        add("fifo");
+    if (Has(FixedEnvironment))
+        add("fixed env");
+    if (Has(LockedMemory))
+        add("mlock");
+    if (cpu != -1)
+        add("cpu " + std::to_string(cpu));
+    return result;
+}
+
+std::string_view RunCounterName(RunCounter counter)
+{
+    switch (counter)
+    {
+    case CpuCycles:
+        return "cycles";
+    case Instructions:
+        return "instructions";
+    case L1DataMisses:
+        return "L1D misses";
+    case LastLevelCacheMisses:
+        return "LLC misses";
+    case BranchMisses:
+        return "branch misses";
+    case DataTlbMisses:
+        return "dTLB misses";
+    case NumRunCounters:
+        break;
+    }
+    CHECK_FOR_PROGRAMMER_ERROR(false);
+    return "";
+}
+
 const interned_string & BenchmarkCategories::TypeIndex()
 {
     static const interned_string result = "type";
@@ -74,11 +249,23 @@ const interned_string & FilenameIndex()
     static const interned_string result = "filename";
     return result;
 }
+const interned_string & BuildIndex()
+{
+    static const interned_string result = "build";
+    return result;
+}
+const interned_string & Benchmark::ThreadsIndex()
+{
+    static const interned_string result = "threads";
+    return result;
+}
 BenchmarkCategories::BenchmarkCategories() = default;
 BenchmarkCategories::BenchmarkCategories(interned_string type, interned_string name)
 {
     categories[TypeIndex()] = type;
     categories[NameIndex()] = name;
+    InsertSorted(TypeIndex(), type);
+    InsertSorted(NameIndex(), name);
 }
 const interned_string & BenchmarkCategories::GetName() const
 {
@@ -110,6 +297,7 @@ void BenchmarkCategories::AddCategory(interned_string category, interned_string
     CHECK_FOR_PROGRAMMER_ERROR(category.view().find('\n') == std::string::npos);
     CHECK_FOR_PROGRAMMER_ERROR(value.view().find('\n') == std::string::npos);
     CHECK_FOR_PROGRAMMER_ERROR(categories.find(category) == categories.end());
+    InsertSorted(category, value);
     categories.emplace(std::move(category), std::move(value));
 }
 BenchmarkCategories BenchmarkCategories::AddCategoryCopy(interned_string category, interned_string value) const &
@@ -124,6 +312,17 @@ BenchmarkCategories BenchmarkCategories::AddCategoryCopy(interned_string categor
     copy.AddCategory(category, value);
     return copy;
 }
+BenchmarkCategories BenchmarkCategories::WithoutCategory(const interned_string & category) const
+{
+    CHECK_FOR_PROGRAMMER_ERROR(category != TypeIndex() && category != NameIndex());
+    BenchmarkCategories copy = *this;
+    copy.categories.erase(category);
+    copy.sorted_categories.erase(std::remove_if(copy.sorted_categories.begin(), copy.sorted_categories.end(), [&](const std::pair<interned_string, interned_string> & entry)
+    {
+        return entry.first == category;
+    }), copy.sorted_categories.end());
+    return copy;
+}
 
 struct NestedPointerLess : interned_string::pointer_less
 {
@@ -141,13 +340,19 @@ struct NestedPointerLess : interned_string::pointer_less
     }
 };
 
+void BenchmarkCategories::InsertSorted(const interned_string & category, const interned_string & value)
+{
+    std::pair<interned_string, interned_string> entry(category, value);
+    auto position = std::upper_bound(sorted_categories.begin(), sorted_categories.end(), entry, NestedPointerLess());
+    sorted_categories.insert(position, std::move(entry));
+}
 bool BenchmarkCategories::operator<(const BenchmarkCategories & other) const
 {
-    return std::lexicographical_compare(categories.begin(), categories.end(), other.categories.begin(), other.categories.end(), NestedPointerLess());
+    return std::lexicographical_compare(sorted_categories.begin(), sorted_categories.end(), other.sorted_categories.begin(), other.sorted_categories.end(), NestedPointerLess());
 }
 bool BenchmarkCategories::operator==(const BenchmarkCategories & other) const
 {
-    return categories == other.categories;
+    return sorted_categories == other.sorted_categories;
 }
 
 CategoryBuilder CategoryBuilder::AddCategory(interned_string category, interned_string value) const &
@@ -197,8 +402,12 @@ static std::vector<std::pair<BenchmarkResults *, LambdaBenchmark *>> & AllBenchm
 Benchmark::Benchmark(BenchmarkCategories categories)
 {
     BenchmarkCategories compiler_categories = categories;
-    compiler_categories.AddCategory(BenchmarkCategories::CompilerIndex(), CurrentCompiler());
-    compiler_categories.AddCategory(BenchmarkCategories::OptimizerIndex(), DebugOrRelease());
+    // copies made by SetThreads already have them
+    if (!categories.GetCategories().count(BenchmarkCategories::CompilerIndex()))
+    {
+        compiler_categories.AddCategory(BenchmarkCategories::CompilerIndex(), CurrentCompiler());
+        compiler_categories.AddCategory(BenchmarkCategories::OptimizerIndex(), DebugOrRelease());
+    }
     AddToAllBenchmarks(compiler_categories);
     results->my_global_index = AllBenchmarksNumbered().size();
 }
@@ -225,6 +434,74 @@ void Benchmark::AddToAllBenchmarks(const BenchmarkCategories & categories)
     }
 }
 
+void Benchmark::AddCategoryToRegisteredBenchmark(interned_string category, interned_string value)
+{
+    // the node keeps its address, so the pointers to the results and to the
+    // categories stay valid
+    auto & all_benchmarks = AllBenchmarks();
+    auto node = all_benchmarks.extract(*results->categories);
+    CHECK_FOR_PROGRAMMER_ERROR(!node.empty());
+    node.key().AddCategory(category, value);
+    auto inserted = all_benchmarks.insert(std::move(node));
+    CHECK_FOR_PROGRAMMER_ERROR(inserted.inserted);
+    RAW_VERIFY(AllCategories()[category][value].insert(results).second);
+}
+
+Benchmark * Benchmark::CopyWithCategories(BenchmarkCategories) const
+{
+    CHECK_FOR_PROGRAMMER_ERROR(false, "Only benchmarks that run in this process can be copied");
+    return nullptr;
+}
+
+void Benchmark::ExpandCategory(const interned_string & category, const std::vector<int64_t> & values, const std::function<void (Benchmark &, int64_t)> & apply)
+{
+    CHECK_FOR_PROGRAMMER_ERROR(!values.empty());
+    std::vector<Benchmark *> to_copy = copies;
+    to_copy.insert(to_copy.begin(), this);
+    for (Benchmark * original : to_copy)
+    {
+        BenchmarkCategories categories = *original->results->categories;
+        for (size_t i = 1; i < values.size(); ++i)
+        {
+            Benchmark * copy = original->CopyWithCategories(categories.AddCategoryCopy(category, to_interned_string(values[i])));
+            copy->results->baseline_results = original->results->baseline_results;
+            copy->range_begin = original->range_begin;
+            copy->range_end = original->range_end;
+            copy->range_multiplier = original->range_multiplier;
+            copy->isolation = original->isolation;
+            copy->timer = original->timer;
+            copy->latency_batch_size = original->latency_batch_size;
+            copy->num_threads = original->num_threads;
+            copy->extra_arguments = original->extra_arguments;
+            apply(*copy, values[i]);
+            copies.push_back(copy);
+        }
+        original->AddCategoryToRegisteredBenchmark(category, to_interned_string(values.front()));
+        apply(*original, values.front());
+    }
+}
+
+Benchmark * Benchmark::SetThreads(const std::vector<int> & thread_counts)
+{
+    CHECK_FOR_PROGRAMMER_ERROR(num_threads == 1);
+    for (int count : thread_counts)
+        CHECK_FOR_PROGRAMMER_ERROR(count >= 1);
+    ExpandCategory(ThreadsIndex(), std::vector<int64_t>(thread_counts.begin(), thread_counts.end()), [](Benchmark & benchmark, int64_t count)
+    {
+        benchmark.num_threads = static_cast<int>(count);
+    });
+    return this;
+}
+
+Benchmark * Benchmark::AddRange(interned_string name, int64_t range_begin, int64_t range_end, double multiplier)
+{
+    ExpandCategory(name, RangeOfArguments{ range_begin, range_end, multiplier }.Values(), [](Benchmark & benchmark, int64_t value)
+    {
+        benchmark.extra_arguments.push_back(value);
+    });
+    return this;
+}
+
 Benchmark * Benchmark::SetBaseline(interned_string name_of_baseline_benchmark)
 {
     auto & baselines = AllBaselineBenchmarks();
@@ -238,6 +515,10 @@ Benchmark * Benchmark::SetBaseline(interned_string name_of_baseline_benchmark)
             continue;
         if (baseline->categories->GetOptimizer() != results->categories->GetOptimizer())
             continue;
+        // an executable with the same name from another build has its own
+        // baseline with the same name
+        if (baseline->executable != results->executable)
+            continue;
 
         results->baseline_results = baseline;
         found_it = true;
@@ -350,61 +631,95 @@ Benchmark::~Benchmark()
 {
 }
 
+// scales the iterations of [closest] so that they take [desired_running_time]
+static int NumIterationsLike(const RunResults & closest, float desired_running_time)
+{
+    double closest_time = closest.time.count() / 1000000000.0;
+    double num_iterations = closest.num_iterations * (desired_running_time / closest_time);
+    num_iterations = std::min(num_iterations, static_cast<double>(std::numeric_limits<int>::max()));
+    return static_cast<int>(num_iterations);
+}
+
 int BenchmarkResults::FindGoodNumberOfIterations(int64_t argument, float desired_running_time) const
 {
-    auto found = results.find(argument);
-    if (found == results.end() || found->second.empty())
+    std::shared_ptr<const ResultsSnapshot> snapshot = GetResults();
+    const RunSamples * runs = snapshot->Find(argument);
+    if (!runs || runs->empty())
     {
-        RunResults one_iteration = RunInNewProcess(1, argument);
-        double in_seconds = one_iteration.time.count() / 1000000000.0;
+        // if a run fails, the real run will fail the same way and report it
+        std::optional<RunResults> one_iteration = RunInNewProcess(1, argument);
+        if (!one_iteration)
+            return 1;
+        double in_seconds = one_iteration->time.count() / 1000000000.0;
         double estimated_num_iterations = desired_running_time / in_seconds;
         if (estimated_num_iterations < 2.0)
             return 1.0;
         int rerun_iterations = static_cast<int>(std::min(10000.0, estimated_num_iterations));
-        RunResults first_estimate = RunInNewProcess(rerun_iterations, argument);
-        double estimate_result = first_estimate.time.count() / 1000000000.0;
+        std::optional<RunResults> first_estimate = RunInNewProcess(rerun_iterations, argument);
+        if (!first_estimate)
+            return rerun_iterations;
+        double estimate_result = first_estimate->time.count() / 1000000000.0;
         double num_iterations = rerun_iterations * (desired_running_time / estimate_result);
         num_iterations = std::min(num_iterations, static_cast<double>(std::numeric_limits<int>::max()));
         return static_cast<int>(num_iterations);
     }
-    auto closest = found->second.begin();
-    double closest_time = closest->time.count() / 1000000000.0;
-    double num_iterations = closest->num_iterations * (desired_running_time / closest_time);
-    num_iterations = std::min(num_iterations, static_cast<double>(std::numeric_limits<int>::max()));
-    return static_cast<int>(num_iterations);
+    return NumIterationsLike(runs->MedianRun(), desired_running_time);
+}
+double BenchmarkResults::EstimateRunSeconds(int64_t argument, float desired_running_time) const
+{
+    double result = 0.0;
+    std::shared_ptr<const ResultsSnapshot> snapshot = GetResults();
+    const RunSamples * runs = snapshot->Find(argument);
+    if (!runs || runs->empty())
+        result = desired_running_time;
+    else
+    {
+        const RunResults & closest = runs->MedianRun();
+        double seconds_per_iteration = closest.time.count() / (1000000000.0 * closest.num_iterations);
+        int num_iterations = std::max(1, NumIterationsLike(closest, desired_running_time));
+        result = num_iterations * seconds_per_iteration + closest.warmup_time.count() / 1000000000.0;
+    }
+    if (baseline_results)
+        result += baseline_results->EstimateRunSeconds(argument, desired_running_time);
+    return result;
 }
 
 std::vector<int64_t> Benchmark::GetAllArguments() const
 {
     std::lock_guard<std::mutex> lock(arguments_mutex);
     if (all_arguments.empty())
+        all_arguments = GetArgumentRange().Values();
+    return all_arguments;
+}
+
+std::vector<int64_t> Benchmark::RangeOfArguments::Values() const
+{
+    if (begin == 0 && end == 0)
+        return {0};
+    if (begin == end)
+        return {begin};
+    double multiplier = this->multiplier;
+    if (multiplier <= 1.0)
+        multiplier = 8.0;
+    std::vector<int64_t> result;
+    result.push_back(begin);
+    for (double i = begin * multiplier; i < end;)
     {
-        if (range_begin == 0 && range_end == 0)
-            return {0};
-        if (range_begin == range_end)
-            return {range_begin};
-        double multiplier = range_multiplier;
-        if (multiplier <= 1.0)
-            multiplier = 8.0;
-        all_arguments.push_back(range_begin);
-        for (double i = range_begin * multiplier; i < range_end;)
+        int64_t rounded = static_cast<int64_t>(i + 0.5f);
+        if (rounded <= result.back())
+            result.push_back(result.back() + 1);
+        else
+            result.push_back(rounded);
+        for (;;)
         {
-            int64_t rounded = static_cast<int64_t>(i + 0.5f);
-            if (rounded <= all_arguments.back())
-                all_arguments.push_back(all_arguments.back() + 1);
-            else
-                all_arguments.push_back(rounded);
-            for (;;)
-            {
-                i = i * multiplier;
-                if (i >= all_arguments.back())
-                    break;
-            }
+            i = i * multiplier;
+            if (i >= result.back())
+                break;
         }
-        if (all_arguments.back() != range_end)
-            all_arguments.push_back(range_end);
     }
-    return all_arguments;
+    if (result.back() != end)
+        result.push_back(end);
+    return result;
 }
 
 Benchmark::RangeOfArguments Benchmark::GetArgumentRange() const
@@ -452,51 +767,217 @@ ska::flat_hash_map<interned_string, ska::flat_hash_map<interned_string, ska::fla
     return result;
 }
 
+// runs that were requested with RequestRun, oldest first, and all the requested
+// runs that haven't been added yet. a run stays in the set while it runs, so
+// that repainting in the meantime doesn't request it a second time
+static std::mutex requested_runs_mutex;
+static std::deque<std::pair<BenchmarkResults *, int64_t>> requested_runs;
+static std::set<std::pair<BenchmarkResults *, int64_t>> outstanding_requested_runs;
+
+void BenchmarkResults::RequestRun(int64_t argument)
+{
+    std::lock_guard<std::mutex> lock(requested_runs_mutex);
+    if (outstanding_requested_runs.insert({ this, argument }).second)
+        requested_runs.emplace_back(this, argument);
+}
+std::optional<std::pair<BenchmarkResults *, int64_t>> BenchmarkResults::TakeRequestedRun()
+{
+    std::lock_guard<std::mutex> lock(requested_runs_mutex);
+    if (requested_runs.empty())
+        return std::nullopt;
+    std::pair<BenchmarkResults *, int64_t> result = requested_runs.front();
+    requested_runs.pop_front();
+    return result;
+}
+void BenchmarkResults::FinishRequestedRun(int64_t argument)
+{
+    std::lock_guard<std::mutex> lock(requested_runs_mutex);
+    outstanding_requested_runs.erase({ this, argument });
+}
+
 void BenchmarkResults::AddResult(RunResults result)
 {
+    int64_t argument = result.argument;
     {
-        std::lock_guard<std::mutex> lock(results_mutex);
-        std::vector<RunResults> & this_results = results[result.argument];
-        this_results.push_back(std::move(result));
-        MoveMedianToFront(this_results);
+        std::lock_guard<std::mutex> lock(write_mutex);
+        // the new version of the runs at this argument shares all their chunks
+        // with the old one, so this is a few pointers per argument
+        std::shared_ptr<ResultsSnapshot> new_version = std::make_shared<ResultsSnapshot>(*results.load(std::memory_order_relaxed));
+        std::shared_ptr<const RunSamples> & runs = new_version->by_argument[argument];
+        std::shared_ptr<RunSamples> new_runs = runs ? std::make_shared<RunSamples>(*runs) : std::make_shared<RunSamples>();
+        new_runs->push_back(std::move(result), order_statistics[argument]);
+        runs = std::move(new_runs);
+        results.store(std::move(new_version), std::memory_order_release);
+        results_generation.fetch_add(1, std::memory_order_release);
+    }
+    // only after the result is visible, so that a repaint in between can't
+    // request the same run again
+    {
+        std::lock_guard<std::mutex> lock(requested_runs_mutex);
+        outstanding_requested_runs.erase({ this, argument });
     }
-    results_added_signal.emit(this);
 }
-void BenchmarkResults::MoveMedianToFront(std::vector<RunResults> & results)
+void RunSamples::push_back(RunResults run, OrderStatistics & statistics)
 {
-    if (results.empty())
-        return;
-    auto begin = results.begin();
-    auto median = begin + (results.size() - 1) / 2;
-    std::nth_element(begin, median, results.end(), [](const RunResults & a, const RunResults & b)
+    CHECK_FOR_PROGRAMMER_ERROR(statistics.size() == num_runs);
+    const LatencyHistogram * evicted_latencies = num_runs == max_runs ? (*this)[0].latencies.get() : nullptr;
+    if (run.latencies || evicted_latencies)
     {
-        return a.GetNanosecondsPerItem(nullptr) < b.GetNanosecondsPerItem(nullptr);
-    });
-    std::iter_swap(begin, median);
+        // a copy, because older versions still have the old one
+        std::shared_ptr<MergedLatencyHistogram> merged = latencies ? std::make_shared<MergedLatencyHistogram>(*latencies) : std::make_shared<MergedLatencyHistogram>();
+        if (evicted_latencies)
+            merged->Subtract(*evicted_latencies);
+        if (run.latencies)
+            merged->Add(*run.latencies);
+        latencies = merged->empty() ? nullptr : std::move(merged);
+    }
+    if (num_runs == max_runs)
+    {
+        statistics.Erase({ (*this)[0].GetNanosecondsPerItem(nullptr), first_id });
+        ++first_id;
+        --num_runs;
+        if (++first_in_chunk == runs_per_chunk)
+        {
+            chunks.erase(chunks.begin());
+            first_in_chunk = 0;
+        }
+    }
+    statistics.Insert({ run.GetNanosecondsPerItem(nullptr), first_id + num_runs });
+    size_t in_last_chunk = (first_in_chunk + num_runs) % runs_per_chunk;
+    if (in_last_chunk == 0)
+    {
+        chunks.push_back(std::make_shared<Chunk>());
+        chunks.back()->reserve(runs_per_chunk);
+    }
+    else if (chunks.back()->size() != in_last_chunk)
+    {
+        // another version that came from the same one already appended to the
+        // chunk, so this one needs its own copy
+        std::shared_ptr<Chunk> copy = std::make_shared<Chunk>();
+        copy->reserve(runs_per_chunk);
+        copy->assign(chunks.back()->begin(), chunks.back()->begin() + in_last_chunk);
+        chunks.back() = std::move(copy);
+    }
+    chunks.back()->push_back(std::move(run));
+    ++num_runs;
+    summary = statistics.Summary();
+}
+void RunSamples::clear()
+{
+    chunks.clear();
+    first_in_chunk = 0;
+    num_runs = 0;
+    first_id = 0;
+    summary = OrderStatisticsSummary();
+    latencies = nullptr;
+}
+std::vector<OrderStatistics::Value> RunSamples::SortedValues() const
+{
+    std::vector<OrderStatistics::Value> result;
+    result.reserve(num_runs);
+    for (size_t i = 0; i < num_runs; ++i)
+        result.push_back({ (*this)[i].GetNanosecondsPerItem(nullptr), first_id + i });
+    std::sort(result.begin(), result.end());
+    return result;
+}
+std::vector<double> RunSamples::SortedNanosecondsPerItem() const
+{
+    std::vector<double> result;
+    result.reserve(num_runs);
+    for (const OrderStatistics::Value & value : SortedValues())
+        result.push_back(value.value);
+    return result;
+}
+std::vector<const RunResults *> RunSamples::RunsAroundMedian(size_t count) const
+{
+    std::vector<OrderStatistics::Value> sorted = SortedValues();
+    // the same window as OrderStatistics::Middle
+    size_t first = count >= sorted.size() ? 0 : (sorted.size() - count) / 2;
+    std::vector<const RunResults *> result;
+    for (size_t i = first; i < sorted.size() && result.size() < count; ++i)
+        result.push_back(&(*this)[sorted[i].id - first_id]);
+    return result;
+}
+
+void BenchmarkResults::AddResults(std::vector<RunResults> new_results)
+{
+    {
+        std::lock_guard<std::mutex> lock(write_mutex);
+        std::shared_ptr<ResultsSnapshot> new_version = std::make_shared<ResultsSnapshot>(*results.load(std::memory_order_relaxed));
+        std::map<int64_t, std::shared_ptr<RunSamples>> changed;
+        for (RunResults & result : new_results)
+        {
+            int64_t argument = result.argument;
+            std::shared_ptr<RunSamples> & new_runs = changed[argument];
+            if (!new_runs)
+            {
+                const RunSamples * old_runs = new_version->Find(argument);
+                new_runs = old_runs ? std::make_shared<RunSamples>(*old_runs) : std::make_shared<RunSamples>();
+            }
+            new_runs->push_back(std::move(result), order_statistics[argument]);
+        }
+        for (auto & [argument, new_runs] : changed)
+            new_version->by_argument[argument] = std::move(new_runs);
+        results.store(std::move(new_version), std::memory_order_release);
+        results_generation.fetch_add(1, std::memory_order_release);
+    }
+}
+
+// shared by all the arguments that haven't been run yet
+static const std::shared_ptr<const RunSamples> & NoRuns()
+{
+    static const std::shared_ptr<const RunSamples> no_runs = std::make_shared<const RunSamples>();
+    return no_runs;
+}
+
+void BenchmarkResults::AddArguments(const std::vector<int64_t> & arguments)
+{
+    std::lock_guard<std::mutex> lock(write_mutex);
+    std::shared_ptr<ResultsSnapshot> new_version = std::make_shared<ResultsSnapshot>(*results.load(std::memory_order_relaxed));
+    for (int64_t argument : arguments)
+        new_version->by_argument.emplace(argument, NoRuns());
+    results.store(std::move(new_version), std::memory_order_release);
+    results_generation.fetch_add(1, std::memory_order_release);
 }
 
 void BenchmarkResults::ClearResults()
 {
     {
-        std::lock_guard<std::mutex> lock(results_mutex);
-        for (auto & result : results)
-            result.second.clear();
+        std::lock_guard<std::mutex> lock(write_mutex);
+        // the arguments stay, so that they get run again
+        std::shared_ptr<ResultsSnapshot> new_version = std::make_shared<ResultsSnapshot>(*results.load(std::memory_order_relaxed));
+        for (auto & [argument, runs] : new_version->by_argument)
+            runs = NoRuns();
+        order_statistics.clear();
+        results.store(std::move(new_version), std::memory_order_release);
+        results_generation.fetch_add(1, std::memory_order_release);
     }
-    results_added_signal.emit(this);
 }
 
-BenchmarkResults::RunAndBaselineResults BenchmarkResults::Run(int64_t argument, RunType run_type)
+int64_t BenchmarkResults::NewBlockId()
+{
+    static std::atomic<int64_t> next_block(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    return next_block++;
+}
+
+BenchmarkResults::RunAndBaselineResults BenchmarkResults::Run(int64_t argument, RunType run_type, RunPlacement placement, int64_t block)
 {
     bool run_baseline_first = baseline_results && [&]
     {
-        std::lock_guard<std::mutex> lock(results_mutex);
-        return (results[argument].size() % 2) != 0;
+        std::shared_ptr<const ResultsSnapshot> snapshot = GetResults();
+        const RunSamples * runs = snapshot->Find(argument);
+        return runs && (runs->size() % 2) != 0;
     }();
     RunAndBaselineResults function_result;
     auto run_baseline = [&]
     {
         int baseline_good_number = baseline_results->FindGoodNumberOfIterations(argument, default_run_time);
-        function_result.baseline_results.reset(new RunResults(baseline_results->RunInNewProcess(baseline_good_number, argument)));
+        std::optional<RunResults> baseline = baseline_results->RunInNewProcess(baseline_good_number, argument);
+        if (!baseline)
+            return;
+        function_result.baseline_results.reset(new RunResults(std::move(*baseline)));
+        function_result.baseline_results->placement = placement;
+        function_result.baseline_results->block = block;
 
     };
     if (run_baseline_first)
@@ -506,22 +987,29 @@ BenchmarkResults::RunAndBaselineResults BenchmarkResults::Run(int64_t argument,
         skb::EnableProfileMode(my_global_index, argument);
     }
     function_result.results = RunInNewProcess(good_number, argument);
+    if (function_result.results)
+    {
+        function_result.results->placement = placement;
+        function_result.results->block = block;
+    }
 
     if (baseline_results)
     {
         if (!run_baseline_first)
             run_baseline();
-        if (run_type != ProfileMode)
+        if (run_type != ProfileMode && function_result.baseline_results)
             baseline_results->AddResult(*function_result.baseline_results);
     }
-    if (run_type != ProfileMode)
-        AddResult(function_result.results);
+    if (run_type != ProfileMode && function_result.results)
+        AddResult(*function_result.results);
     return function_result;
 }
 
 static std::string my_executable_name;
 static std::filesystem::path initial_working_dir;
 
+// only used for the human readable output when a benchmark is run from the
+// command line. the runner gets a RunRecord over a pipe of its own
 static constexpr std::string_view subprocess_start_string = "successfully ran ";
 static constexpr std::string_view subprocess_num_iterations_string = "\nnum_iterations: ";
 static constexpr std::string_view subprocess_time_string = "\ntime: ";
@@ -563,32 +1051,108 @@ struct ChildProcessOutput {
     std::string stdout;
 };
 
-ChildProcessOutput RunProcess(const std::vector<std::string> & arguments, bool forward_stderr)
+static constexpr const char * FIXED_ENVIRONMENT_VARIABLE = "SKB_FIXED_ENVIRONMENT";
+
+// the same variables for every child, padded so that the arguments, the
+// environment and the path of the executable (which the kernel copies a second
+// time) always take up the same space at the top of the stack. otherwise that
+// space moves everything on the stack, which can change timings by a few percent.
+// PATH and LD_LIBRARY_PATH are kept, because without them some executables
+// don't start. they are the same for every child of this process anyway
+static std::vector<std::string> FixedEnvironmentBlock(const std::vector<std::string> & arguments)
 {
-    int communication_pipe[2] = { 0, 0 };
-    check_for_error(pipe(communication_pipe));
-    std::vector<char *> as_char_pointers;
-    as_char_pointers.reserve(arguments.size());
+    static constexpr size_t block_size = 4096;
+    std::vector<std::string> result = { "LC_ALL=C", std::string(FIXED_ENVIRONMENT_VARIABLE) + "=1" };
+    for (const char * name : { "PATH", "LD_LIBRARY_PATH" })
+    {
+        if (const char * value = getenv(name))
+            result.push_back(std::string(name) + '=' + value);
+    }
+    size_t used = arguments.front().size() + 1;
     for (const std::string & str : arguments)
-        as_char_pointers.push_back(const_cast<char *>(str.c_str()));
-    as_char_pointers.push_back(nullptr);
+        used += str.size() + 1;
+    for (const std::string & str : result)
+        used += str.size() + 1;
+    std::string padding = "SKB_PADDING=";
+    used += padding.size() + 1;
+    padding.append(block_size > used ? block_size - used : 0, 'x');
+    result.push_back(std::move(padding));
+    return result;
+}
+
+static std::vector<char *> AsCharPointers(const std::vector<std::string> & strings)
+{
+    std::vector<char *> result;
+    result.reserve(strings.size() + 1);
+    for (const std::string & str : strings)
+        result.push_back(const_cast<char *>(str.c_str()));
+    result.push_back(nullptr);
+    return result;
+}
+
+// the pipes are created with O_CLOEXEC so that a child only ever sees the descriptors that
+// it was explicitly given. otherwise one worker would hold on to the pipes of all the other
+// workers and would keep them from seeing end of file. [environment] are the controls of a
+// benchmark process, see RunEnvironment. they are applied between vfork and exec, and the
+// ones that fail are left out silently: the child reports what it actually got
+pid_t SpawnProcess(const std::vector<std::string> & arguments, int stdin_fd, int stdout_fd, int stderr_fd, int inherited_fd = -1, const RunEnvironment * environment = nullptr)
+{
+    std::vector<char *> as_char_pointers = AsCharPointers(arguments);
+    std::vector<std::string> fixed_environment;
+    if (environment && environment->Has(RunEnvironment::FixedEnvironment))
+        fixed_environment = FixedEnvironmentBlock(arguments);
+    std::vector<char *> environment_pointers = AsCharPointers(fixed_environment);
     pid_t pid = vfork();
     CHECK_FOR_PROGRAMMER_ERROR(pid != -1);
     if (pid == 0)
     {
-        check_for_error(close(communication_pipe[0]));
-        check_for_error(dup2(communication_pipe[1], STDOUT_FILENO));
-        if (forward_stderr)
-            check_for_error(dup2(communication_pipe[1], STDERR_FILENO));
-        check_for_error(close(communication_pipe[1]));
+        if (stdin_fd != -1)
+            check_for_error(dup2(stdin_fd, STDIN_FILENO));
+        if (stdout_fd != -1)
+            check_for_error(dup2(stdout_fd, STDOUT_FILENO));
+        if (stderr_fd != -1)
+            check_for_error(dup2(stderr_fd, STDERR_FILENO));
+        if (inherited_fd != -1)
+            check_for_error(fcntl(inherited_fd, F_SETFD, 0));
+        if (environment)
+        {
+            if (environment->Has(RunEnvironment::NoAslr))
+                personality(personality(0xffffffff) | ADDR_NO_RANDOMIZE);
+            if (environment->cpu != -1)
+            {
+                cpu_set_t cpu_set;
+                CPU_ZERO(&cpu_set);
+                CPU_SET(environment->cpu, &cpu_set);
+                sched_setaffinity(0, sizeof(cpu_set), &cpu_set);
+            }
+            if (environment->Has(RunEnvironment::FifoScheduling))
+            {
+                // the lowest real time priority is enough to never get preempted by
+                // normal processes, and it stays below the threads of the kernel
+                sched_param parameters = {};
+                parameters.sched_priority = sched_get_priority_min(SCHED_FIFO);
+                sched_setscheduler(0, SCHED_FIFO, &parameters);
+            }
+        }
 
         std::filesystem::current_path(initial_working_dir);
-        execv(arguments[0].c_str(), as_char_pointers.data());
+        if (fixed_environment.empty())
+            execv(arguments[0].c_str(), as_char_pointers.data());
+        else
+            execve(arguments[0].c_str(), as_char_pointers.data(), environment_pointers.data());
         // exec will only return if something goes wrong
         const char * error_str = strerror(errno);
         std::cout << "Error: Couldn't launch executable " << arguments[0] << ". Error was " << error_str << std::endl;
         exit(1);
     }
+    return pid;
+}
+
+ChildProcessOutput RunProcess(const std::vector<std::string> & arguments, bool forward_stderr)
+{
+    int communication_pipe[2] = { 0, 0 };
+    check_for_error(pipe2(communication_pipe, O_CLOEXEC));
+    pid_t pid = SpawnProcess(arguments, -1, communication_pipe[1], forward_stderr ? communication_pipe[1] : -1);
     check_for_error(close(communication_pipe[1]));
     std::string result = read_pipe(communication_pipe[0]);
     int child_return_code = 0;
@@ -597,114 +1161,455 @@ ChildProcessOutput RunProcess(const std::vector<std::string> & arguments, bool f
     return { child_return_code, result };
 }
 
-RunResults BenchmarkResults::RunInNewProcess(int num_iterations, int64_t argument) const
+static std::atomic<BenchmarkResults::ChildProcessMode> child_process_mode(BenchmarkResults::ForkServer);
+// bumped whenever an executable gets (re-)loaded, so that workers which are
+// still running an old build of that executable get restarted
+static std::atomic<int> worker_generation(0);
+
+void BenchmarkResults::SetChildProcessMode(ChildProcessMode mode)
 {
-    std::vector<std::string> arguments;
-    if (this->executable.view().empty())
-        arguments.push_back(my_executable_name);
-    else
-        arguments.push_back(std::string(executable.view()));
-    arguments.push_back(RUN_BENCHMARK_THEN_EXIT);
-    arguments.push_back(std::to_string(my_global_index));
-    arguments.push_back(std::string(categories->GetName().view()));
-    arguments.push_back(std::to_string(argument));
-    arguments.push_back(std::to_string(num_iterations));
-    auto [child_return_code, result] = RunProcess(arguments, false);
-    CHECK_FOR_PROGRAMMER_ERROR(WIFEXITED(child_return_code) && WEXITSTATUS(child_return_code) == 0);
-    size_t num_iterations_start = result.find(subprocess_num_iterations_string);
-    CHECK_FOR_PROGRAMMER_ERROR(num_iterations_start != std::string::npos);
-    size_t time_start = result.find(subprocess_time_string, num_iterations_start + subprocess_num_iterations_string.size());
-    CHECK_FOR_PROGRAMMER_ERROR(time_start != std::string::npos);
-    size_t num_items_start = result.find(subprocess_num_items_string, time_start + subprocess_time_string.size());
-    CHECK_FOR_PROGRAMMER_ERROR(num_items_start != std::string::npos);
-    size_t num_bytes_start = result.find(subprocess_num_bytes_string, num_items_start + subprocess_num_items_string.size());
-    CHECK_FOR_PROGRAMMER_ERROR(num_bytes_start != std::string::npos);
-    int actual_num_iterations = 0;
-    RAW_VERIFY(StrToNumber({ result.data() + num_iterations_start + subprocess_num_iterations_string.size(), time_start - num_iterations_start - subprocess_num_iterations_string.size() }, actual_num_iterations));
-    std::chrono::nanoseconds::rep time = 0;
-    RAW_VERIFY(StrToNumber({ result.data() + time_start + subprocess_time_string.size(), num_items_start - time_start - subprocess_time_string.size() }, time));
-    size_t num_items_processed = 0;
-    RAW_VERIFY(StrToNumber({ result.data() + num_items_start + subprocess_num_items_string.size(), num_bytes_start - num_items_start - subprocess_num_items_string.size() }, num_items_processed));
-    size_t num_bytes_used = 0;
-    RAW_VERIFY(StrToNumber({ result.data() + num_bytes_start + subprocess_num_bytes_string.size(), result.size() - 1 - num_bytes_start - subprocess_num_bytes_string.size() }, num_bytes_used));
-    return { actual_num_iterations, argument, std::chrono::nanoseconds(time), num_items_processed, num_bytes_used };
+    child_process_mode = mode;
 }
 
-double RunResults::GetNanosecondsPerItem(BenchmarkResults * baseline_data) const
+static std::atomic<bool> collect_hardware_counters(false);
+
+void BenchmarkResults::SetCollectHardwareCounters(bool value)
 {
-    if (baseline_data)
-    {
-        auto found = baseline_data->results.find(argument);
-        if (found == baseline_data->results.end())
-        {
-            RunResults new_results = baseline_data->RunInNewProcess(baseline_data->FindGoodNumberOfIterations(argument, BenchmarkResults::default_run_time), argument);
-            double diff = GetNanosecondsPerItem(nullptr) - new_results.GetNanosecondsPerItem(nullptr);
-            baseline_data->AddResult(std::move(new_results));
-            return diff;
-        }
-        else
-        {
-            return GetNanosecondsPerItem(nullptr) - found->second.front().GetNanosecondsPerItem(nullptr);
-        }
-    }
-    else if (num_items_processed)
-        return time.count() / static_cast<double>(num_items_processed);
-    else
-        return time.count() / static_cast<double>(num_iterations);
+    collect_hardware_counters = value;
 }
 
-LambdaBenchmark::LambdaBenchmark(std::function<void (State &)> func, BenchmarkCategories categories)
-    : Benchmark(categories), function(std::move(func))
+static std::atomic<RunTimer> default_timer(ChronoTimer);
+
+void BenchmarkResults::SetDefaultTimer(RunTimer timer)
 {
-    AllBenchmarksNumbered().emplace_back(results, this);
+    default_timer = timer;
 }
 
-void LambdaBenchmark::Run(State & state) const
+static std::atomic<bool> warm_up(false);
+
+void BenchmarkResults::SetWarmup(bool value)
 {
-    return function(state);
+    warm_up = value;
 }
 
-BenchmarkInOtherProcess::BenchmarkInOtherProcess(BenchmarkCategories type, Benchmark::RangeOfArguments range, interned_string executable, int index_in_executable)
-    : Benchmark(std::move(type), executable, index_in_executable)
+static std::atomic<RunEnvironment> run_environment;
+// the cpu of the calling benchmark thread when several of them run at once
+static thread_local int runner_cpu = -1;
+
+void BenchmarkResults::SetRunEnvironment(RunEnvironment requested)
 {
-    SetRange(range.begin, range.end);
-    SetRangeMultiplier(range.multiplier);
-    // fill keys in map
-    for (int64_t i : GetAllArguments()) {
-        results->results[i];
-    }
+    CHECK_FOR_PROGRAMMER_ERROR(requested.cpu >= -1 && requested.cpu < CPU_SETSIZE);
+    run_environment = requested;
+    ++worker_generation;
+}
+void BenchmarkResults::SetRunnerCpu(int cpu)
+{
+    CHECK_FOR_PROGRAMMER_ERROR(cpu >= -1 && cpu < CPU_SETSIZE);
+    runner_cpu = cpu;
 }
 
-void ListAllBenchmarks()
+// options for a single run. sent to the child as one word, a comma separated
+// list of the enabled options, or "-" if there are none
+static constexpr std::string_view HARDWARE_COUNTERS_OPTION = "counters";
+static constexpr std::string_view TSC_TIMER_OPTION = "tsc";
+static constexpr std::string_view WARMUP_OPTION = "warmup";
+static constexpr std::string_view LOCK_MEMORY_OPTION = "mlock";
+static constexpr std::string_view NO_OPTIONS = "-";
+
+// returns false if the other side closed the pipe before sending anything
+static bool read_exactly(int fd, void * buffer, size_t size)
 {
-    std::cout << "V1\n";
-    for (const auto &[results, benchmark] : AllBenchmarksNumbered())
+    char * to_fill = static_cast<char *>(buffer);
+    for (size_t num_filled = 0; num_filled < size;)
     {
-        if (results->baseline_results) {
-            std::cout << "BenchmarkWithBaseline\n"
-                      << results->benchmark->GetArgumentRange().Serialize() << '\n'
-                      << results->categories->Serialize() << '\n'
-                      << results->baseline_results->categories->GetName().view() << '\n';
-        } else {
-            std::cout << "BenchmarkWithoutBaseline\n"
-                      << results->benchmark->GetArgumentRange().Serialize() << '\n'
-                      << results->categories->Serialize() << '\n';
+        ssize_t num_read = read(fd, to_fill + num_filled, size - num_filled);
+        check_for_error(num_read);
+        if (num_read == 0)
+        {
+            CHECK_FOR_INVALID_DATA(num_filled == 0, "Got a partial result record");
+            return false;
         }
+        num_filled += num_read;
     }
-    std::cout.flush();
+    return true;
 }
 
-std::vector<std::string> SplitString(const std::string & str, char to_split)
+static RunRecord ToRunRecord(const RunResults & results)
 {
-    std::vector<std::string> result;
-    for (size_t i = 0, found = str.find(to_split);;) {
-        result.push_back(str.substr(i, found - i));
-        if (found == std::string::npos)
-            break;
-        i = found + 1;
-        found = str.find(to_split, i);
-    }
-    return result;
+    RunRecord record;
+    record.num_iterations = results.num_iterations;
+    record.argument = results.argument;
+    record.time_nanoseconds = results.time.count();
+    record.num_items_processed = results.num_items_processed;
+    record.num_bytes_used = results.num_bytes_used;
+    record.timer = results.timer;
+    record.warmup_iterations = results.warmup_iterations;
+    record.warmup_nanoseconds = results.warmup_time.count();
+    record.peak_bytes = results.peak_bytes;
+    record.num_allocations = results.num_allocations;
+    record.num_threads = results.num_threads;
+    record.thread_time_nanoseconds = results.thread_time.count();
+    record.environment_controls = results.environment.controls;
+    record.pinned_cpu = results.environment.cpu;
+    record.counters_present = results.counters.present;
+    std::copy(results.counters.values.begin(), results.counters.values.end(), record.counters);
+    return record;
+}
+static RunResults FromRunRecord(const RunRecord & record)
+{
+    CHECK_FOR_INVALID_DATA(record.IsValid(), "The child process sent a result in a different format. Is it from an older build?");
+    CHECK_FOR_INVALID_DATA(record.num_latency_buckets <= LatencyHistogram::NumBuckets);
+    CHECK_FOR_INVALID_DATA(record.num_threads >= 1);
+    RunResults results =
+    {
+        record.num_iterations,
+        record.argument,
+        std::chrono::nanoseconds(record.time_nanoseconds),
+        static_cast<size_t>(record.num_items_processed),
+        static_cast<size_t>(record.num_bytes_used)
+    };
+    results.timer = record.timer == TscTimer ? TscTimer : ChronoTimer;
+    results.warmup_iterations = record.warmup_iterations;
+    results.warmup_time = std::chrono::nanoseconds(record.warmup_nanoseconds);
+    results.peak_bytes = static_cast<size_t>(record.peak_bytes);
+    results.num_allocations = static_cast<size_t>(record.num_allocations);
+    results.num_threads = record.num_threads;
+    results.thread_time = std::chrono::nanoseconds(record.thread_time_nanoseconds);
+    results.environment.controls = record.environment_controls;
+    results.environment.cpu = record.pinned_cpu;
+    results.counters.present = record.counters_present & ((uint64_t(1) << NumRunCounters) - 1);
+    std::copy(record.counters, record.counters + NumRunCounters, results.counters.values.begin());
+    return results;
+}
+static_assert(NumRunCounters <= RunRecord::max_counters);
+
+// the record and the latency buckets that follow it, in one string so that they
+// go out in a single write
+static std::string SerializeRunResults(const RunResults & results)
+{
+    RunRecord record = ToRunRecord(results);
+    std::string latency_buckets;
+    if (results.latencies)
+    {
+        latency_buckets = results.latencies->Serialize();
+        record.num_latency_buckets = latency_buckets.size() / sizeof(uint32_t);
+    }
+    std::string result(reinterpret_cast<const char *>(&record), sizeof(record));
+    result += latency_buckets;
+    return result;
+}
+
+// nullopt if the other side closed the pipe before sending anything, or if it
+// sent an error. [error] is set to the error of the record if there was one
+static std::optional<RunResults> ReadRunResults(int fd, RunRecord::Error * error = nullptr)
+{
+    RunRecord record;
+    if (!read_exactly(fd, &record, sizeof(record)))
+        return std::nullopt;
+    CHECK_FOR_INVALID_DATA(record.IsValid(), "The child process sent a result in a different format. Is it from an older build?");
+    if (error)
+        *error = static_cast<RunRecord::Error>(record.error);
+    if (record.error != RunRecord::NoError)
+        return std::nullopt;
+    RunResults results = FromRunRecord(record);
+    if (record.num_latency_buckets)
+    {
+        std::string buckets(record.num_latency_buckets * sizeof(uint32_t), '\0');
+        RAW_VERIFY(read_exactly(fd, buckets.data(), buckets.size()), "The result record was cut off");
+        results.latencies = std::make_shared<LatencyHistogram>(LatencyHistogram::Deserialize(buckets));
+    }
+    return results;
+}
+
+void write_all(int fd, std::string_view to_write)
+{
+    while (!to_write.empty())
+    {
+        ssize_t num_written = write(fd, to_write.data(), to_write.size());
+        check_for_error(num_written);
+        to_write.remove_prefix(num_written);
+    }
+}
+
+// reads newline terminated commands from a file descriptor. unlike std::cin
+// this doesn't share a buffer with anything, so it's safe to use across fork()
+struct LineReader
+{
+    explicit LineReader(int fd)
+        : fd(fd)
+    {
+    }
+
+    bool ReadLine(std::string & line)
+    {
+        for (;;)
+        {
+            size_t end = unread.find('\n');
+            if (end != std::string::npos)
+            {
+                line.assign(unread, 0, end);
+                unread.erase(0, end + 1);
+                return true;
+            }
+            constexpr int buffer_size = 1024;
+            char buffer[buffer_size];
+            ssize_t num_read = read(fd, buffer, buffer_size);
+            check_for_error(num_read);
+            if (num_read == 0)
+                return false;
+            unread.append(buffer, buffer + num_read);
+        }
+    }
+
+private:
+    int fd;
+    std::string unread;
+};
+
+// a long-lived copy of a benchmark executable, started with --fork-server or
+// --run-as-worker. it reads one command per line from its stdin and answers each
+// with one RunRecord on the result pipe. its stdout is ours
+struct WorkerProcess
+{
+    WorkerProcess(const std::string & executable, const char * mode_flag, const RunEnvironment & environment)
+        : mode_flag(mode_flag)
+        , generation(worker_generation)
+    {
+        // if the worker dies we want to see the error from write(), not get killed
+        static bool ignore_sigpipe = (signal(SIGPIPE, SIG_IGN), true);
+        static_cast<void>(ignore_sigpipe);
+        int command_pipe[2] = { 0, 0 };
+        check_for_error(pipe2(command_pipe, O_CLOEXEC));
+        int result_pipe[2] = { 0, 0 };
+        check_for_error(pipe2(result_pipe, O_CLOEXEC));
+        pid = SpawnProcess({ executable, mode_flag, std::to_string(result_pipe[1]) }, command_pipe[0], -1, -1, result_pipe[1], &environment);
+        check_for_error(close(command_pipe[0]));
+        check_for_error(close(result_pipe[1]));
+        to_worker = command_pipe[1];
+        from_worker = result_pipe[0];
+    }
+    ~WorkerProcess()
+    {
+        // closing the command pipe is the signal for the worker to exit
+        check_for_error(close(to_worker));
+        check_for_error(close(from_worker));
+        int child_return_code = 0;
+        RAW_VERIFY(waitpid(pid, &child_return_code, 0) == pid);
+    }
+
+    // nullopt if the worker couldn't run the command. it printed why
+    std::optional<RunResults> Run(std::string_view command)
+    {
+        write_all(to_worker, command);
+        RunRecord::Error error = RunRecord::NoError;
+        std::optional<RunResults> results = ReadRunResults(from_worker, &error);
+        RAW_VERIFY(results || error != RunRecord::NoError, "The worker process exited unexpectedly");
+        return results;
+    }
+
+    const char * mode_flag;
+    pid_t pid = -1;
+    int to_worker = -1;
+    int from_worker = -1;
+    int generation = 0;
+};
+
+// one set of workers per thread. a worker inherits the CPU affinity and the
+// scheduling of the thread that started it, and this way no locking is needed
+static WorkerProcess & GetWorker(const std::string & executable, const char * mode_flag, const RunEnvironment & environment)
+{
+    static thread_local std::map<std::string, std::unique_ptr<WorkerProcess>> workers;
+    std::unique_ptr<WorkerProcess> & worker = workers[executable];
+    if (!worker || worker->generation != worker_generation || worker->mode_flag != mode_flag)
+    {
+        worker.reset();
+        worker = std::make_unique<WorkerProcess>(executable, mode_flag, environment);
+    }
+    return *worker;
+}
+
+static RunResults RunWithExec(const BenchmarkResults & benchmark, std::string executable_name, int num_iterations, int64_t argument, const std::string & options, const RunEnvironment & environment)
+{
+    int result_pipe[2] = { 0, 0 };
+    check_for_error(pipe2(result_pipe, O_CLOEXEC));
+    std::vector<std::string> arguments;
+    arguments.push_back(std::move(executable_name));
+    arguments.push_back(RUN_BENCHMARK_THEN_EXIT);
+    arguments.push_back(std::to_string(benchmark.my_global_index));
+    arguments.push_back(std::string(benchmark.categories->GetName().view()));
+    arguments.push_back(std::to_string(argument));
+    arguments.push_back(std::to_string(num_iterations));
+    arguments.push_back(std::to_string(result_pipe[1]));
+    arguments.push_back(options);
+    pid_t pid = SpawnProcess(arguments, -1, -1, -1, result_pipe[1], &environment);
+    check_for_error(close(result_pipe[1]));
+    std::optional<RunResults> results = ReadRunResults(result_pipe[0]);
+    check_for_error(close(result_pipe[0]));
+    int child_return_code = 0;
+    pid_t waited = waitpid(pid, &child_return_code, 0);
+    CHECK_FOR_PROGRAMMER_ERROR(waited == pid);
+    CHECK_FOR_PROGRAMMER_ERROR(WIFEXITED(child_return_code) && WEXITSTATUS(child_return_code) == 0);
+    CHECK_FOR_PROGRAMMER_ERROR(results);
+    return std::move(*results);
+}
+
+std::optional<RunResults> BenchmarkResults::RunInNewProcess(int num_iterations, int64_t argument) const
+{
+    std::string executable_name;
+    if (this->executable.view().empty())
+        executable_name = my_executable_name;
+    else
+        executable_name = std::string(executable.view());
+    bool hardware_counters = collect_hardware_counters;
+    std::string options;
+    auto add_option = [&](std::string_view option)
+    {
+        if (!options.empty())
+            options += ',';
+        options += option;
+    };
+    if (hardware_counters)
+        add_option(HARDWARE_COUNTERS_OPTION);
+    if (default_timer == TscTimer)
+        add_option(TSC_TIMER_OPTION);
+    if (warm_up)
+        add_option(WARMUP_OPTION);
+    RunEnvironment environment = run_environment;
+    // otherwise the children of all the benchmark threads would share one cpu
+    if (environment.cpu != -1 && runner_cpu != -1)
+        environment.cpu = runner_cpu;
+    if (environment.Has(RunEnvironment::LockedMemory))
+        add_option(LOCK_MEMORY_OPTION);
+    if (options.empty())
+        options = NO_OPTIONS;
+    std::optional<RunResults> results;
+    ChildProcessMode mode = child_process_mode;
+    if (mode != ExecPerRun)
+    {
+        std::string command = std::to_string(my_global_index);
+        command += ' ';
+        command += std::to_string(argument);
+        command += ' ';
+        command += std::to_string(num_iterations);
+        command += ' ';
+        command += options;
+        command += ' ';
+        command += categories->GetName().view();
+        command += '\n';
+        const char * mode_flag = mode == ForkServer ? RUN_AS_FORK_SERVER : RUN_AS_WORKER;
+        results = GetWorker(executable_name, mode_flag, environment).Run(command);
+    }
+    else
+        results = RunWithExec(*this, executable_name, num_iterations, argument, options, environment);
+    if (hardware_counters && results && !results->counters.present)
+    {
+        static std::atomic<bool> warned(false);
+        if (!warned.exchange(true))
+            std::cerr << "Hardware counters were requested, but the benchmark process couldn't open any. "
+                         "They need a CPU with a PMU, and /proc/sys/kernel/perf_event_paranoid has to allow "
+                         "user space counting (2 or less, or run with CAP_PERFMON)" << std::endl;
+    }
+    return results;
+}
+
+double RunResults::GetNanosecondsPerItem(BenchmarkResults * baseline_data) const
+{
+    if (baseline_data)
+    {
+        std::shared_ptr<const ResultsSnapshot> baseline_snapshot = baseline_data->GetResults();
+        const RunSamples * baseline_runs = baseline_snapshot->Find(argument);
+        if (!baseline_runs || baseline_runs->empty())
+        {
+            baseline_data->RequestRun(argument);
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        return GetNanosecondsPerItem(nullptr) - baseline_runs->MedianRun().GetNanosecondsPerItem(nullptr);
+    }
+    else if (num_items_processed)
+        return time.count() / static_cast<double>(num_items_processed);
+    else
+        return time.count() / (static_cast<double>(num_iterations) * num_threads);
+}
+
+double RunResults::GetNanosecondsPerItemPerThread() const
+{
+    if (num_threads == 1)
+        return GetNanosecondsPerItem(nullptr);
+    double num_items = num_items_processed ? num_items_processed : static_cast<double>(num_iterations) * num_threads;
+    return thread_time.count() * num_threads / num_items;
+}
+
+double RunResults::GetCounterPerItem(RunCounter counter, BenchmarkResults * baseline_data) const
+{
+    if (!counters.Has(counter))
+        return std::numeric_limits<double>::quiet_NaN();
+    double per_item = counters.Get(counter) / static_cast<double>(num_items_processed ? num_items_processed : num_iterations);
+    if (baseline_data)
+    {
+        // unlike for time, this doesn't request a baseline run if there is none
+        std::shared_ptr<const ResultsSnapshot> baseline_snapshot = baseline_data->GetResults();
+        const RunSamples * baseline_runs = baseline_snapshot->Find(argument);
+        if (!baseline_runs || baseline_runs->empty())
+            return std::numeric_limits<double>::quiet_NaN();
+        per_item -= baseline_runs->MedianRun().GetCounterPerItem(counter, nullptr);
+    }
+    return per_item;
+}
+
+LambdaBenchmark::LambdaBenchmark(std::function<void (State &)> func, BenchmarkCategories categories)
+    : Benchmark(categories), function(std::move(func))
+{
+    AllBenchmarksNumbered().emplace_back(results, this);
+}
+
+void LambdaBenchmark::Run(State & state) const
+{
+    return function(state);
+}
+
+Benchmark * LambdaBenchmark::CopyWithCategories(BenchmarkCategories categories) const
+{
+    return new LambdaBenchmark(function, std::move(categories));
+}
+
+BenchmarkInOtherProcess::BenchmarkInOtherProcess(BenchmarkCategories type, Benchmark::RangeOfArguments range, interned_string executable, int index_in_executable)
+    : Benchmark(std::move(type), executable, index_in_executable)
+{
+    SetRange(range.begin, range.end);
+    SetRangeMultiplier(range.multiplier);
+    results->AddArguments(GetAllArguments());
+}
+
+void ListAllBenchmarks()
+{
+    std::cout << "V1\n";
+    for (const auto &[results, benchmark] : AllBenchmarksNumbered())
+    {
+        if (results->baseline_results) {
+            std::cout << "BenchmarkWithBaseline\n"
+                      << results->benchmark->GetArgumentRange().Serialize() << '\n'
+                      << results->categories->Serialize() << '\n'
+                      << results->baseline_results->categories->GetName().view() << '\n';
+        } else {
+            std::cout << "BenchmarkWithoutBaseline\n"
+                      << results->benchmark->GetArgumentRange().Serialize() << '\n'
+                      << results->categories->Serialize() << '\n';
+        }
+    }
+    std::cout.flush();
+}
+
+std::vector<std::string> SplitString(const std::string & str, char to_split)
+{
+    std::vector<std::string> result;
+    for (size_t i = 0, found = str.find(to_split);;) {
+        result.push_back(str.substr(i, found - i));
+        if (found == std::string::npos)
+            break;
+        i = found + 1;
+        found = str.find(to_split, i);
+    }
+    return result;
 }
 
 std::vector<std::unique_ptr<BenchmarkInOtherProcess>> benchmarks_in_other_files;
@@ -717,25 +1622,53 @@ void LoadAllBenchmarks(interned_string executable, const std::string & run_resul
     }
     std::vector<std::string> lines = SplitString(run_results, '\n');
     CHECK_FOR_INVALID_DATA(lines[0] == "V1");
-    std::vector<std::pair<size_t, interned_string>> baseline_to_fill_in;
-    int benchmark_index_in_other_file = 0;
-    for (size_t line = 1;; ++benchmark_index_in_other_file) {
+    struct BenchmarkToLoad
+    {
+        BenchmarkCategories categories;
+        Benchmark::RangeOfArguments range;
+        std::optional<interned_string> baseline;
+    };
+    std::vector<BenchmarkToLoad> to_load;
+    for (size_t line = 1;;) {
         if (line == lines.size() || (line == lines.size() - 1 && lines[line].empty()))
             break;
         CHECK_FOR_INVALID_DATA(lines.size() > line + 2);
         Benchmark::RangeOfArguments range = Benchmark::RangeOfArguments::Deserialize(lines[line + 1]);
         BenchmarkCategories categories = BenchmarkCategories::Deserialize(lines[line + 2]);
         categories.AddCategory(FilenameIndex(), filename);
+        std::optional<interned_string> baseline;
         if (lines[line] == "BenchmarkWithBaseline") {
             CHECK_FOR_INVALID_DATA(lines.size() > line + 3);
-            baseline_to_fill_in.emplace_back(benchmarks_in_other_files.size(), lines[line + 3]);
+            baseline = interned_string(lines[line + 3]);
             line += 4;
         } else if (lines[line] == "BenchmarkWithoutBaseline") {
             line += 3;
         } else {
             CHECK_FOR_INVALID_DATA(!"Got wrong line", lines[line]);
         }
-        benchmarks_in_other_files.push_back(std::make_unique<BenchmarkInOtherProcess>(std::move(categories), range, executable, benchmark_index_in_other_file));
+        to_load.push_back({ std::move(categories), range, baseline });
+    }
+    // an executable with the same name was loaded from somewhere else, like
+    // the same benchmarks from two build directories. without the directory
+    // their categories would be the same
+    bool same_name_as_other_executable = std::any_of(to_load.begin(), to_load.end(), [&](const BenchmarkToLoad & benchmark)
+    {
+        auto found = Benchmark::AllBenchmarks().find(benchmark.categories);
+        return found != Benchmark::AllBenchmarks().end() && found->second.executable != executable;
+    });
+    std::string_view directory = executable.view().substr(0, executable.view().size() - filename.view().size());
+    if (directory.size() > 1)
+        directory.remove_suffix(1);
+    else if (directory.empty())
+        directory = ".";
+    std::vector<std::pair<size_t, interned_string>> baseline_to_fill_in;
+    for (size_t i = 0; i < to_load.size(); ++i) {
+        BenchmarkToLoad & benchmark = to_load[i];
+        if (same_name_as_other_executable)
+            benchmark.categories.AddCategory(BuildIndex(), interned_string(directory));
+        if (benchmark.baseline)
+            baseline_to_fill_in.emplace_back(benchmarks_in_other_files.size(), *benchmark.baseline);
+        benchmarks_in_other_files.push_back(std::make_unique<BenchmarkInOtherProcess>(std::move(benchmark.categories), benchmark.range, executable, static_cast<int>(i)));
     }
     for (const auto & [index, baseline] : baseline_to_fill_in) {
         benchmarks_in_other_files[index]->SetBaseline(baseline);
@@ -751,82 +1684,517 @@ std::optional<std::string> LoadAllBenchmarksFromFile(std::string_view executable
     if (!WIFEXITED(child_return_code) || WEXITSTATUS(child_return_code) != 0) {
         return {"Error running child process: " + result};
     }
+    ++worker_generation;
     LoadAllBenchmarks(interned_string(executable), result);
     return std::nullopt;
 }
 
-bool RunSingleBenchmarkFromCommandLine(int argc, char * argv[])
+struct RunCommand
 {
-    if (argc < 1)
-        return false;
-    my_executable_name = argv[0];
-    initial_working_dir = std::filesystem::current_path();
-    if (argc < 2)
-        return false;
-    if (std::strcmp(argv[1], LIST_ALL_BENCHMARKS) == 0)
-    {
-        ListAllBenchmarks();
+    int index = 0;
+    int64_t argument = 0;
+    int num_iterations = 0;
+    bool hardware_counters = false;
+    RunTimer default_timer = ChronoTimer;
+    bool warmup = false;
+    bool lock_memory = false;
+};
+
+static bool ParseRunOptions(std::string_view options, RunCommand & command)
+{
+    if (options == NO_OPTIONS)
         return true;
-    }
-    else if (std::strcmp(argv[1], RUN_BENCHMARK_THEN_EXIT) != 0)
-        return false;
-    if (argc < 6)
+    for (const std::string & option : SplitString(std::string(options), ','))
     {
-        std::cout << "Not enough arguments. Format is --run-benchmark-then-exit <index> <name> <argument> <num_iterations>" << std::endl;
-        return true;
+        if (option == HARDWARE_COUNTERS_OPTION)
+            command.hardware_counters = true;
+        else if (option == TSC_TIMER_OPTION)
+            command.default_timer = TscTimer;
+        else if (option == WARMUP_OPTION)
+            command.warmup = true;
+        else if (option == LOCK_MEMORY_OPTION)
+            command.lock_memory = true;
+        else
+        {
+            std::cout << "Error: Unknown run option " << option << std::endl;
+            return false;
+        }
     }
+    return true;
+}
+
+static std::optional<RunCommand> ParseRunCommand(std::string_view index_string, std::string_view name, std::string_view argument_string, std::string_view num_iterations_string)
+{
     const std::vector<std::pair<BenchmarkResults *, LambdaBenchmark *>> & all_benchmarks = AllBenchmarksNumbered();
-    int index = 0;
-    if (!StrToNumber(argv[2], index))
+    RunCommand result;
+    if (!StrToNumber(index_string, result.index))
     {
         std::cout << "Error parsing the benchmark index" << std::endl;
-        return true;
+        return std::nullopt;
     }
-    else if (index < 0)
+    else if (result.index < 0)
     {
         std::cout << "Error: Got a negative benchmark index" << std::endl;
-        return true;
+        return std::nullopt;
     }
-    else if (static_cast<size_t>(index) >= all_benchmarks.size())
+    else if (static_cast<size_t>(result.index) >= all_benchmarks.size())
     {
-        std::cout << "Error: benchmark index is too big. Num benchmarks: " << all_benchmarks.size() << ", index: " << index << std::endl;
-        return true;
+        std::cout << "Error: benchmark index is too big. Num benchmarks: " << all_benchmarks.size() << ", index: " << result.index << std::endl;
+        return std::nullopt;
     }
-    auto [results, benchmark] = all_benchmarks[index];
-    if (results->categories->GetName() != argv[3])
+    BenchmarkResults * results = all_benchmarks[result.index].first;
+    if (results->categories->GetName() != name)
     {
-        std::cout << "Error: the benchmark had a different name than expected. Expected: " << argv[3] << ", actual: " << results->categories->GetName() << std::endl;
-        return true;
+        std::cout << "Error: the benchmark had a different name than expected. Expected: " << name << ", actual: " << results->categories->GetName() << std::endl;
+        return std::nullopt;
     }
-    int64_t argument = 0;
-    if (!StrToNumber(argv[4], argument))
+    if (!StrToNumber(argument_string, result.argument))
     {
         std::cout << "Error parsing the benchmark argument" << std::endl;
-        return true;
+        return std::nullopt;
     }
-    int iteration_count = 0;
-    if (!StrToNumber(argv[5], iteration_count))
+    if (!StrToNumber(num_iterations_string, result.num_iterations))
     {
         std::cout << "Error parsing the benchmark iteration count" << std::endl;
-        return true;
+        return std::nullopt;
     }
+    return result;
+}
 
-    std::cout << subprocess_start_string << argv[3] << subprocess_num_iterations_string << iteration_count;
-    std::cout.flush();
+// where the RunRecords go. -1 if a person started us from the command line, in
+// which case the results are printed in a readable format instead
+static int result_fd = -1;
+
+static bool ParseResultFd(const char * fd_string)
+{
+    if (!StrToNumber(fd_string, result_fd) || result_fd < 0)
+    {
+        std::cout << "Error parsing the result file descriptor" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// counters count the thread that opened them, so a forked child can't use the
+// ones of its parent. ForkChild closes them
+static std::unique_ptr<PerfCounterGroup> process_perf_counters;
+// allocated once, before any timing starts
+static std::unique_ptr<LatencyHistogram> process_latencies;
+
+// [state] belongs to the first thread, which is the calling thread. the other
+// threads get States of their own
+static RunResults RunOnAllThreads(const LambdaBenchmark & benchmark, const State & state, RunTimer timer)
+{
+    int num_threads = benchmark.GetNumThreads();
+    std::vector<State> states;
+    states.reserve(num_threads);
+    states.push_back(state);
+    for (int i = 1; i < num_threads; ++i)
+    {
+        states.emplace_back(state.iterations(), state.GetArgument());
+        states.back().SetTimer(timer);
+    }
+    for (State & thread_state : states)
+        thread_state.SetExtraArguments(benchmark.GetExtraArguments());
+    if (num_threads == 1)
+    {
+        benchmark.Run(states.front());
+        return states.front().GetResults();
+    }
+    std::barrier<> start_together(num_threads);
+    for (int i = 0; i < num_threads; ++i)
+        states[i].SetThread(i, num_threads, &start_together);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; ++i)
+    {
+        threads.emplace_back([&benchmark, &state = states[i]]
+        {
+            benchmark.Run(state);
+        });
+    }
+    benchmark.Run(states.front());
+    for (std::thread & thread : threads)
+        thread.join();
+    return State::CombineThreadResults(states);
+}
+
+// the controls that SpawnProcess applied to this process or to the worker
+// that it was forked from
+static RunEnvironment ReadRunEnvironment()
+{
+    RunEnvironment result;
+    int persona = personality(0xffffffff);
+    if (persona != -1 && (persona & ADDR_NO_RANDOMIZE))
+        result.controls |= RunEnvironment::NoAslr;
+    if (sched_getscheduler(0) == SCHED_FIFO)
+        result.controls |= RunEnvironment::FifoScheduling;
+    if (getenv(FIXED_ENVIRONMENT_VARIABLE))
+        result.controls |= RunEnvironment::FixedEnvironment;
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    if (sched_getaffinity(0, sizeof(cpu_set), &cpu_set) == 0 && CPU_COUNT(&cpu_set) == 1)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &cpu_set))
+                result.cpu = cpu;
+        }
+    }
+    return result;
+}
+
+struct Warmup
+{
+    int64_t iterations = 0;
+    std::chrono::nanoseconds time{ 0 };
+};
+
+// the first iterations pay for page faults on fresh memory, a cold instruction
+// cache and the CPU clocking up. this runs batches of a tenth of the real run
+// until two batches in a row agree on the time per iteration, or until the time
+// limit is up. the batches go through the same timer as the real run so that
+// pauses are left out in the same way
+static Warmup WarmUp(const LambdaBenchmark & benchmark, const RunCommand & command, RunTimer timer)
+{
+    static constexpr double tolerance = 0.02;
+    static constexpr std::chrono::milliseconds time_limit(500);
+    Warmup result;
+    int batch_size = std::max(1, command.num_iterations / 10);
+    double last_per_iteration = -1.0;
+    auto start = std::chrono::steady_clock::now();
+    for (;;)
+    {
+        skb::State batch(batch_size, command.argument);
+        batch.SetTimer(timer);
+        RunResults batch_results = RunOnAllThreads(benchmark, batch, timer);
+        result.iterations += batch_size;
+        double per_iteration = batch_results.time.count() / static_cast<double>(batch_size);
+        bool settled = last_per_iteration >= 0.0 && std::abs(per_iteration - last_per_iteration) <= tolerance * last_per_iteration;
+        last_per_iteration = per_iteration;
+        result.time = std::chrono::steady_clock::now() - start;
+        if (settled || result.time >= time_limit)
+            return result;
+    }
+}
+
+static void RunAndReportResults(const RunCommand & command)
+{
+    if (command.hardware_counters && !process_perf_counters)
+        process_perf_counters = std::make_unique<PerfCounterGroup>();
+    auto [results, benchmark] = AllBenchmarksNumbered()[command.index];
+    if (result_fd == -1)
+    {
+        std::cout << subprocess_start_string << results->categories->GetName() << subprocess_num_iterations_string << command.num_iterations;
+        std::cout.flush();
+    }
+    RunTimer timer = benchmark->GetTimer().value_or(command.default_timer);
+    if (timer == TscTimer && !CycleClock::IsAvailable())
+        timer = ChronoTimer;
+    Warmup warmup;
+    if (command.warmup)
+        warmup = WarmUp(*benchmark, command, timer);
+    int latency_batch_size = benchmark->GetLatencyBatchSize();
+    if (latency_batch_size && !process_latencies)
+        process_latencies = std::make_unique<LatencyHistogram>();
     RunResults run_results;
     do
     {
-        skb::State benchmark_state(iteration_count, argument);
-        benchmark->Run(benchmark_state);
-        run_results = benchmark_state.GetResults();
+        skb::State benchmark_state(command.num_iterations, command.argument);
+        benchmark_state.SetTimer(timer);
+        if (latency_batch_size)
+        {
+            process_latencies->Clear();
+            benchmark_state.SetLatencyHistogram(process_latencies.get(), latency_batch_size);
+        }
+        if (command.hardware_counters && !process_perf_counters->empty())
+            benchmark_state.SetPerfCounters(process_perf_counters.get());
+        benchmark_state.SetLockMemory(command.lock_memory);
+        run_results = RunOnAllThreads(*benchmark, benchmark_state, timer);
+        // a reused worker shouldn't keep the memory of this run locked
+        if (run_results.environment.Has(RunEnvironment::LockedMemory))
+            munlockall();
     }
-    while(skb::IsProfileMode(index, argument));
+    while(skb::IsProfileMode(command.index, command.argument));
+    RunEnvironment environment = ReadRunEnvironment();
+    run_results.environment.controls |= environment.controls;
+    run_results.environment.cpu = environment.cpu;
+    run_results.warmup_iterations = warmup.iterations;
+    run_results.warmup_time = warmup.time;
+    if (latency_batch_size)
+        run_results.latencies = std::make_shared<LatencyHistogram>(*process_latencies);
 
+    if (result_fd != -1)
+    {
+        // whatever the benchmark printed should show up before we report that we're done
+        std::cout.flush();
+        write_all(result_fd, SerializeRunResults(run_results));
+        return;
+    }
     std::cout << subprocess_time_string << run_results.time.count()
               << subprocess_num_items_string << run_results.num_items_processed
-              << subprocess_num_bytes_string << run_results.num_bytes_used
-              << '\n';
+              << subprocess_num_bytes_string << run_results.num_bytes_used;
+    for (int i = 0; i < NumRunCounters; ++i)
+    {
+        RunCounter counter = static_cast<RunCounter>(i);
+        if (run_results.counters.Has(counter))
+            std::cout << '\n' << RunCounterName(counter) << ": " << run_results.counters.Get(counter);
+    }
+    if (run_results.timer == TscTimer)
+        std::cout << "\ntimer: tsc";
+    if (run_results.num_threads != 1)
+        std::cout << "\nthreads: " << run_results.num_threads << "\nthread_time: " << run_results.thread_time.count();
+    if (run_results.peak_bytes || run_results.num_allocations)
+        std::cout << "\npeak_bytes: " << run_results.peak_bytes << "\nnum_allocations: " << run_results.num_allocations;
+    if (run_results.latencies)
+        std::cout << "\np50: " << run_results.latencies->Percentile(0.5) << "ns p99: " << run_results.latencies->Percentile(0.99)
+                  << "ns p99.9: " << run_results.latencies->Percentile(0.999) << "ns";
+    if (run_results.environment.controls || run_results.environment.cpu != -1)
+        std::cout << "\nenvironment: " << run_results.environment.ToString();
+    if (command.warmup)
+        std::cout << "\nwarmup: " << warmup.iterations << " iterations, " << warmup.time.count() << "ns";
+    if (command.hardware_counters && process_perf_counters->empty())
+        std::cout << "\nno hardware counters: " << process_perf_counters->GetError();
+    std::cout << '\n';
+    std::cout.flush();
+}
+
+// answers a command that couldn't be run, so that the runner doesn't wait for
+// a result that never comes
+static void ReportError(RunRecord::Error error)
+{
     std::cout.flush();
+    RunRecord record;
+    record.error = error;
+    write_all(result_fd, std::string_view(reinterpret_cast<const char *>(&record), sizeof(record)));
+}
+
+// commands come in one per line, in the format "<index> <argument> <num_iterations> <options> <name>".
+// the name goes last because it's the only part that may contain spaces
+static std::optional<RunCommand> ParseWorkerCommand(const std::string & line)
+{
+    std::string_view remaining = line;
+    std::string_view parts[4];
+    for (std::string_view & part : parts)
+    {
+        size_t space = remaining.find(' ');
+        if (space == std::string_view::npos)
+        {
+            std::cout << "Error: Couldn't parse the worker command " << line << std::endl;
+            return std::nullopt;
+        }
+        part = remaining.substr(0, space);
+        remaining.remove_prefix(space + 1);
+    }
+    std::optional<RunCommand> command = ParseRunCommand(parts[0], remaining, parts[1], parts[2]);
+    if (command && !ParseRunOptions(parts[3], *command))
+        return std::nullopt;
+    return command;
+}
+
+// global_randomness and the timer calibrations are initialized lazily on first
+// use. do that once in the parent instead of paying for it in every forked child
+static void InitializeBeforeForking()
+{
+    global_randomness();
+    State::ChronoTimerOverhead();
+    if (CycleClock::IsAvailable())
+        CycleClock::GetCalibration();
+}
+
+// for every child of a worker or of the fork server, whether it does one run
+// or becomes the warm worker. returns what fork() returned
+static pid_t ForkChild()
+{
+    // flush first so that the child doesn't print our buffered output a second time
+    std::cout.flush();
+    pid_t pid = fork();
+    CHECK_FOR_PROGRAMMER_ERROR(pid != -1);
+    if (pid == 0)
+    {
+        // every child gets its own random numbers, same as when it was started with exec.
+        // a few words of entropy are enough, filling the whole state from the device is slow
+        random_seed_seq::result_type entropy[4];
+        random_seed_seq::get_instance().generate(std::begin(entropy), std::end(entropy));
+        std::seed_seq seed(std::begin(entropy), std::end(entropy));
+        global_randomness.seed(seed);
+        process_perf_counters.reset();
+    }
+    return pid;
+}
+
+static bool RunInForkedChild(const RunCommand & command)
+{
+    pid_t pid = ForkChild();
+    if (pid == 0)
+    {
+        RunAndReportResults(command);
+        _exit(0);
+    }
+    int child_return_code = 0;
+    pid_t waited = waitpid(pid, &child_return_code, 0);
+    CHECK_FOR_PROGRAMMER_ERROR(waited == pid);
+    return WIFEXITED(child_return_code) && WEXITSTATUS(child_return_code) == 0;
+}
+
+static void RunWorker(int command_fd)
+{
+    InitializeBeforeForking();
+    LineReader commands(command_fd);
+    std::string line;
+    while (commands.ReadLine(line))
+    {
+        std::optional<RunCommand> command = ParseWorkerCommand(line);
+        if (!command)
+        {
+            ReportError(RunRecord::MalformedCommand);
+            continue;
+        }
+        if (AllBenchmarksNumbered()[command->index].second->GetProcessIsolation() == Benchmark::ReuseWorker)
+            RunAndReportResults(*command);
+        else if (!RunInForkedChild(*command))
+            return;
+    }
+}
+
+// the fork server is a zygote: it has done all the dynamic linking and all the
+// static initialization, and then it only ever forks. ForkPerRun benchmarks get
+// a fresh child per run. ReuseWorker benchmarks are forwarded to a warm worker
+// which is itself forked from the server the first time that it's needed
+static void RunForkServer()
+{
+    InitializeBeforeForking();
+    pid_t warm_worker = -1;
+    int to_warm_worker = -1;
+    LineReader commands(STDIN_FILENO);
+    std::string line;
+    while (commands.ReadLine(line))
+    {
+        std::optional<RunCommand> command = ParseWorkerCommand(line);
+        if (!command)
+        {
+            ReportError(RunRecord::MalformedCommand);
+            continue;
+        }
+        if (AllBenchmarksNumbered()[command->index].second->GetProcessIsolation() != Benchmark::ReuseWorker)
+        {
+            if (!RunInForkedChild(*command))
+                break;
+            continue;
+        }
+        if (warm_worker == -1)
+        {
+            int command_pipe[2] = { 0, 0 };
+            check_for_error(pipe2(command_pipe, O_CLOEXEC));
+            warm_worker = ForkChild();
+            if (warm_worker == 0)
+            {
+                check_for_error(close(command_pipe[1]));
+                RunWorker(command_pipe[0]);
+                std::cout.flush();
+                _exit(0);
+            }
+            check_for_error(close(command_pipe[0]));
+            to_warm_worker = command_pipe[1];
+        }
+        // the runner waits for the result before it sends the next command, so
+        // the warm worker can answer directly on the result pipe that we share with it
+        line += '\n';
+        write_all(to_warm_worker, line);
+    }
+    if (warm_worker != -1)
+    {
+        check_for_error(close(to_warm_worker));
+        int child_return_code = 0;
+        RAW_VERIFY(waitpid(warm_worker, &child_return_code, 0) == warm_worker);
+    }
+}
+
+// prints how long the runner has to wait for a single one-iteration run, once for
+// every ChildProcessMode. the first run is listed separately because it includes
+// starting up the worker or the fork server
+static void MeasureSpawnLatency(const RunCommand & command)
+{
+    BenchmarkResults & results = *AllBenchmarksNumbered()[command.index].first;
+    std::pair<BenchmarkResults::ChildProcessMode, const char *> modes[] =
+    {
+        { BenchmarkResults::ExecPerRun, "exec per run" },
+        { BenchmarkResults::PersistentWorker, "persistent worker" },
+        { BenchmarkResults::ForkServer, "fork server" },
+    };
+    int num_samples = std::max(1, command.num_iterations);
+    std::vector<double> microseconds;
+    for (auto [mode, description] : modes)
+    {
+        BenchmarkResults::SetChildProcessMode(mode);
+        microseconds.clear();
+        for (int i = 0; i <= num_samples; ++i)
+        {
+            auto before = std::chrono::steady_clock::now();
+            results.RunInNewProcess(1, command.argument);
+            microseconds.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - before).count());
+        }
+        double first = microseconds.front();
+        microseconds.erase(microseconds.begin());
+        std::sort(microseconds.begin(), microseconds.end());
+        std::cout << description << ": first run " << first << "us, median " << microseconds[microseconds.size() / 2]
+                  << "us, fastest " << microseconds.front() << "us, slowest " << microseconds.back() << "us" << std::endl;
+    }
+}
+
+bool RunSingleBenchmarkFromCommandLine(int argc, char * argv[])
+{
+    if (argc < 1)
+        return false;
+    my_executable_name = argv[0];
+    initial_working_dir = std::filesystem::current_path();
+    if (argc < 2)
+        return false;
+    if (std::strcmp(argv[1], LIST_ALL_BENCHMARKS) == 0)
+    {
+        ListAllBenchmarks();
+        return true;
+    }
+    else if (std::strcmp(argv[1], RUN_AS_WORKER) == 0)
+    {
+        if (argc < 3)
+            std::cout << "Not enough arguments. Format is --run-as-worker <result_fd>" << std::endl;
+        else if (ParseResultFd(argv[2]))
+            RunWorker(STDIN_FILENO);
+        return true;
+    }
+    else if (std::strcmp(argv[1], RUN_AS_FORK_SERVER) == 0)
+    {
+        if (argc < 3)
+            std::cout << "Not enough arguments. Format is --fork-server <result_fd>" << std::endl;
+        else if (ParseResultFd(argv[2]))
+            RunForkServer();
+        return true;
+    }
+    else if (std::strcmp(argv[1], MEASURE_SPAWN_LATENCY) == 0)
+    {
+        if (argc < 6)
+        {
+            std::cout << "Not enough arguments. Format is --measure-spawn-latency <index> <name> <argument> <num_samples>" << std::endl;
+            return true;
+        }
+        if (std::optional<RunCommand> command = ParseRunCommand(argv[2], argv[3], argv[4], argv[5]))
+            MeasureSpawnLatency(*command);
+        return true;
+    }
+    else if (std::strcmp(argv[1], RUN_BENCHMARK_THEN_EXIT) != 0)
+        return false;
+    if (argc < 6)
+    {
+        std::cout << "Not enough arguments. Format is --run-benchmark-then-exit <index> <name> <argument> <num_iterations> [result_fd [options]]" << std::endl;
+        return true;
+    }
+    if (argc >= 7 && !ParseResultFd(argv[6]))
+        return true;
+    std::optional<RunCommand> command = ParseRunCommand(argv[2], argv[3], argv[4], argv[5]);
+    if (command && argc >= 8 && !ParseRunOptions(argv[7], *command))
+        return true;
+    if (command)
+        RunAndReportResults(*command);
     return true;
 }
 
@@ -865,3 +2233,398 @@ TEST(benchmark_serialize, split_string)
     ASSERT_EQ(std::vector<std::string>({"a", "", "bcd", "e"}), skb::SplitString("a--bcd-e", '-'));
     ASSERT_EQ(std::vector<std::string>({"a", "", "bcd", "e", ""}), skb::SplitString("a--bcd-e-", '-'));
 }
+TEST(run_record, roundtrip)
+{
+    skb::RunResults results = { 17, -5, std::chrono::nanoseconds(123456789), 34, 1024 };
+    results.warmup_iterations = 40;
+    results.warmup_time = std::chrono::nanoseconds(5000);
+    results.peak_bytes = 4096;
+    results.num_allocations = 12;
+    results.num_threads = 4;
+    results.thread_time = std::chrono::nanoseconds(30000000);
+    results.environment.controls = skb::RunEnvironment::NoAslr | skb::RunEnvironment::LockedMemory;
+    results.environment.cpu = 3;
+    skb::RunRecord record = skb::ToRunRecord(results);
+    ASSERT_TRUE(record.IsValid());
+    skb::RunResults roundtripped = skb::FromRunRecord(record);
+    ASSERT_EQ(results.num_iterations, roundtripped.num_iterations);
+    ASSERT_EQ(results.argument, roundtripped.argument);
+    ASSERT_EQ(results.time, roundtripped.time);
+    ASSERT_EQ(results.num_items_processed, roundtripped.num_items_processed);
+    ASSERT_EQ(results.num_bytes_used, roundtripped.num_bytes_used);
+    ASSERT_EQ(0u, roundtripped.counters.present);
+    ASSERT_EQ(results.warmup_iterations, roundtripped.warmup_iterations);
+    ASSERT_EQ(results.warmup_time, roundtripped.warmup_time);
+    ASSERT_EQ(results.peak_bytes, roundtripped.peak_bytes);
+    ASSERT_EQ(results.num_allocations, roundtripped.num_allocations);
+    ASSERT_EQ(results.num_threads, roundtripped.num_threads);
+    ASSERT_EQ(results.thread_time, roundtripped.thread_time);
+    ASSERT_EQ(results.environment.controls, roundtripped.environment.controls);
+    ASSERT_EQ(3, roundtripped.environment.cpu);
+    ASSERT_EQ("no aslr, mlock, cpu 3", roundtripped.environment.ToString());
+}
+TEST(run_environment, fixed_environment_block_has_a_fixed_size)
+{
+    auto stack_bytes = [](const std::vector<std::string> & arguments)
+    {
+        size_t result = arguments.front().size() + 1;
+        for (const std::string & str : arguments)
+            result += str.size() + 1;
+        for (const std::string & str : skb::FixedEnvironmentBlock(arguments))
+            result += str.size() + 1;
+        return result;
+    };
+    size_t short_arguments = stack_bytes({ "a.exe", "--fork-server", "5" });
+    size_t long_arguments = stack_bytes({ "/some/much/longer/path/to/benchmark.exe", "--run-benchmark-then-exit", "12", "name", "1024", "100", "17", "warmup" });
+    ASSERT_EQ(short_arguments, long_arguments);
+    if (const char * path = getenv("PATH"))
+    {
+        std::vector<std::string> block = skb::FixedEnvironmentBlock({ "a.exe" });
+        ASSERT_NE(block.end(), std::find(block.begin(), block.end(), std::string("PATH=") + path));
+    }
+}
+TEST(run_record, latencies_follow_the_record)
+{
+    skb::RunResults results = { 4, 1, std::chrono::nanoseconds(1000), 4, 0 };
+    auto latencies = std::make_shared<skb::LatencyHistogram>();
+    latencies->Record(100);
+    latencies->Record(5000);
+    results.latencies = latencies;
+    int fds[2];
+    ASSERT_EQ(0, pipe(fds));
+    skb::write_all(fds[1], skb::SerializeRunResults(results));
+    close(fds[1]);
+    std::optional<skb::RunResults> read_back = skb::ReadRunResults(fds[0]);
+    ASSERT_TRUE(read_back);
+    ASSERT_TRUE(read_back->latencies);
+    ASSERT_EQ(latencies->counts, read_back->latencies->counts);
+    ASSERT_FALSE(skb::ReadRunResults(fds[0]));
+    close(fds[0]);
+}
+TEST(worker, answers_malformed_commands_with_errors)
+{
+    int commands[2];
+    int results[2];
+    ASSERT_EQ(0, pipe(commands));
+    ASSERT_EQ(0, pipe(results));
+    // the worker keeps going after the first one
+    skb::write_all(commands[1], "not a command\n0 1 1 - no_benchmark_has_this_name\n");
+    close(commands[1]);
+    int old_result_fd = skb::result_fd;
+    skb::result_fd = results[1];
+    skb::RunWorker(commands[0]);
+    skb::result_fd = old_result_fd;
+    close(commands[0]);
+    close(results[1]);
+    for (int i = 0; i < 2; ++i)
+    {
+        skb::RunRecord::Error error = skb::RunRecord::NoError;
+        ASSERT_FALSE(skb::ReadRunResults(results[0], &error));
+        ASSERT_EQ(skb::RunRecord::MalformedCommand, error);
+    }
+    skb::RunRecord::Error error = skb::RunRecord::NoError;
+    ASSERT_FALSE(skb::ReadRunResults(results[0], &error));
+    ASSERT_EQ(skb::RunRecord::NoError, error);
+    close(results[0]);
+}
+TEST(state, batches_record_latencies)
+{
+    skb::LatencyHistogram histogram;
+    skb::State state(10, 0);
+    state.SetLatencyHistogram(&histogram, 3);
+    int num_iterations = 0;
+    for (auto _ : state)
+        ++num_iterations;
+    ASSERT_EQ(10, num_iterations);
+    // batches of 3, 3, 3 and 1
+    ASSERT_EQ(4u, histogram.total_count);
+}
+TEST(state, chrono_timer_overhead)
+{
+    int64_t overhead = skb::State::ChronoTimerOverhead();
+    // a clock read takes somewhere between nothing at all and a few microseconds
+    ASSERT_LE(0, overhead);
+    ASSERT_GT(10000, overhead);
+    ASSERT_EQ(overhead, skb::State::ChronoTimerOverhead());
+}
+TEST(state, both_loops_run_num_iterations)
+{
+    skb::State range_for(5, 0);
+    int num_range_for = 0;
+    for (auto _ : range_for)
+        ++num_range_for;
+    ASSERT_EQ(5, num_range_for);
+    skb::State keep_running(5, 0);
+    int num_keep_running = 0;
+    while (keep_running.KeepRunning())
+        ++num_keep_running;
+    ASSERT_EQ(5, num_keep_running);
+    ASSERT_FALSE(keep_running.KeepRunning());
+}
+TEST(state, threads_start_together)
+{
+    static constexpr int num_threads = 3;
+    std::barrier<> start_together(num_threads);
+    std::vector<skb::State> states;
+    for (int i = 0; i < num_threads; ++i)
+    {
+        states.emplace_back(100, 0);
+        states.back().SetThread(i, num_threads, &start_together);
+    }
+    std::vector<std::thread> threads;
+    for (skb::State & state : states)
+    {
+        threads.emplace_back([&state]
+        {
+            for (auto _ : state)
+                std::this_thread::sleep_for(std::chrono::microseconds(10));
+            state.SetItemsProcessed(state.iterations() * (state.thread_index() + 1));
+            state.SetPeakBytes(1000 * (state.thread_index() + 1));
+        });
+    }
+    for (std::thread & thread : threads)
+        thread.join();
+    skb::RunResults combined = skb::State::CombineThreadResults(states);
+    ASSERT_EQ(num_threads, combined.num_threads);
+    ASSERT_EQ(600u, combined.num_items_processed);
+    ASSERT_EQ(3000u, combined.peak_bytes);
+    // the threads ran at the same time, so the wall clock time is less than the
+    // sum of the thread times but at least as long as the average one
+    ASSERT_LE(combined.thread_time, combined.time);
+    ASSERT_GT(combined.thread_time * num_threads, combined.time);
+    ASSERT_NEAR(combined.GetNanosecondsPerItemPerThread(), combined.thread_time.count() / 200.0, 0.001);
+}
+TEST(benchmark, add_range_registers_every_combination)
+{
+    skb::Benchmark * benchmark = SKA_BENCHMARK_NAME([](skb::State & state)
+    {
+        for (auto _ : state)
+            skb::DoNotOptimize(state.range(1) + state.range(2));
+    }, "add range test", "add_range_test_benchmark");
+    benchmark->SetRange(1, 8)->AddRange("first", 2, 8, 2.0)->AddRange("second", 10, 20, 2.0);
+    std::set<std::pair<int64_t, int64_t>> combinations;
+    for (const auto & [categories, results] : skb::Benchmark::AllBenchmarks())
+    {
+        if (categories.GetName() != "add_range_test_benchmark")
+            continue;
+        const std::vector<int64_t> & extra = results.benchmark->GetExtraArguments();
+        ASSERT_EQ(2u, extra.size());
+        ASSERT_EQ(categories.GetCategories().find(interned_string("first"))->second, to_interned_string(extra[0]));
+        ASSERT_EQ(categories.GetCategories().find(interned_string("second"))->second, to_interned_string(extra[1]));
+        ASSERT_EQ(8, results.benchmark->GetArgumentRange().end);
+        combinations.emplace(extra[0], extra[1]);
+    }
+    // 2, 4 and 8 times 10 and 20
+    ASSERT_EQ(6u, combinations.size());
+}
+
+TEST(benchmark_results, missing_baseline_is_requested_once)
+{
+    skb::BenchmarkResults baseline(nullptr);
+    skb::RunResults run;
+    run.argument = 16;
+    run.num_iterations = 10;
+    run.num_items_processed = 0;
+    run.time = std::chrono::nanoseconds(1000);
+    ASSERT_TRUE(std::isnan(run.GetNanosecondsPerItem(&baseline)));
+    ASSERT_TRUE(std::isnan(run.GetNanosecondsPerItem(&baseline)));
+    std::optional<std::pair<skb::BenchmarkResults *, int64_t>> requested = skb::BenchmarkResults::TakeRequestedRun();
+    ASSERT_TRUE(requested);
+    ASSERT_EQ(&baseline, requested->first);
+    ASSERT_EQ(16, requested->second);
+    ASSERT_FALSE(skb::BenchmarkResults::TakeRequestedRun());
+    // still running, so painting again doesn't ask for it again
+    ASSERT_TRUE(std::isnan(run.GetNanosecondsPerItem(&baseline)));
+    ASSERT_FALSE(skb::BenchmarkResults::TakeRequestedRun());
+
+    skb::RunResults baseline_run = run;
+    baseline_run.time = std::chrono::nanoseconds(400);
+    baseline.AddResult(baseline_run);
+    ASSERT_EQ(60.0, run.GetNanosecondsPerItem(&baseline));
+    ASSERT_FALSE(skb::BenchmarkResults::TakeRequestedRun());
+}
+TEST(benchmark_results, failed_requested_run_is_requested_again)
+{
+    skb::BenchmarkResults baseline(nullptr);
+    skb::RunResults run;
+    run.argument = 32;
+    run.num_iterations = 10;
+    run.num_items_processed = 0;
+    run.time = std::chrono::nanoseconds(1000);
+    ASSERT_TRUE(std::isnan(run.GetNanosecondsPerItem(&baseline)));
+    std::optional<std::pair<skb::BenchmarkResults *, int64_t>> requested = skb::BenchmarkResults::TakeRequestedRun();
+    ASSERT_TRUE(requested);
+    // the run finishes without a result
+    baseline.FinishRequestedRun(32);
+    ASSERT_TRUE(std::isnan(run.GetNanosecondsPerItem(&baseline)));
+    requested = skb::BenchmarkResults::TakeRequestedRun();
+    ASSERT_TRUE(requested);
+    ASSERT_EQ(&baseline, requested->first);
+    ASSERT_EQ(32, requested->second);
+    baseline.FinishRequestedRun(32);
+}
+
+TEST(benchmark_results, readers_run_alongside_a_writer)
+{
+    // the parallel run loop asks for the number of iterations and for the
+    // time minus the baseline while other benchmark threads add results
+    skb::BenchmarkResults results(nullptr);
+    skb::BenchmarkResults baseline(nullptr);
+    skb::RunResults run;
+    run.argument = 1;
+    run.num_iterations = 10;
+    run.num_items_processed = 0;
+    run.num_bytes_used = 0;
+    run.time = std::chrono::nanoseconds(1000);
+    skb::RunResults baseline_run = run;
+    baseline_run.time = std::chrono::nanoseconds(400);
+    results.AddResult(run);
+    baseline.AddResult(baseline_run);
+    std::atomic<bool> done{ false };
+    std::thread writer([&]
+    {
+        for (int i = 0; i < 1000; ++i)
+        {
+            results.AddResult(run);
+            baseline.AddResult(baseline_run);
+        }
+        done = true;
+    });
+    size_t num_reads = 0;
+    while (!done || num_reads == 0)
+    {
+        ASSERT_EQ(10000, results.FindGoodNumberOfIterations(1, 0.001f));
+        ASSERT_EQ(60.0, run.GetNanosecondsPerItem(&baseline));
+        ++num_reads;
+    }
+    writer.join();
+    ASSERT_EQ(1001u, results.GetResults()->Find(1)->size());
+}
+
+TEST(run_samples, oldest_runs_make_room)
+{
+    skb::RunSamples samples;
+    auto make_run = [](int64_t nanoseconds)
+    {
+        skb::RunResults run;
+        run.argument = 1;
+        run.num_iterations = 1;
+        run.num_items_processed = 0;
+        run.time = std::chrono::nanoseconds(nanoseconds);
+        return run;
+    };
+    skb::OrderStatistics statistics;
+    for (size_t i = 0; i < skb::RunSamples::max_runs; ++i)
+        samples.push_back(make_run(1000), statistics);
+    // a slower regime pushes all the old runs out
+    for (size_t i = 0; i < skb::RunSamples::max_runs; ++i)
+    {
+        samples.push_back(make_run(2000 + static_cast<int64_t>(i % 100)), statistics);
+        ASSERT_EQ(skb::RunSamples::max_runs, samples.size());
+    }
+    ASSERT_EQ(2000.0, samples.SortedNanosecondsPerItem().front());
+    ASSERT_EQ(2049.0, samples.MedianRun().GetNanosecondsPerItem(nullptr));
+    // 40 times 0 to 99, then 0 to 95
+    ASSERT_NEAR(2000.0 + (40 * 4950 + 95 * 96 / 2) / 4096.0, samples.Statistics().mean, 1e-6);
+    ASSERT_EQ(2004, samples[4].time.count());
+
+    std::vector<const skb::RunResults *> middle = samples.RunsAroundMedian(64);
+    ASSERT_EQ(64u, middle.size());
+    for (const skb::RunResults * run : middle)
+    {
+        ASSERT_GE(run->time.count(), 2049);
+        ASSERT_LE(run->time.count(), 2050);
+    }
+    samples.clear();
+    ASSERT_TRUE(samples.empty());
+}
+
+TEST(run_samples, copies_share_their_runs)
+{
+    auto make_run = [](int64_t nanoseconds)
+    {
+        skb::RunResults run;
+        run.argument = 1;
+        run.num_iterations = 1;
+        run.num_items_processed = 0;
+        run.time = std::chrono::nanoseconds(nanoseconds);
+        return run;
+    };
+    skb::RunSamples original;
+    skb::OrderStatistics original_statistics;
+    for (int64_t i = 1; i <= 100; ++i)
+        original.push_back(make_run(i), original_statistics);
+    skb::RunSamples newer = original;
+    skb::OrderStatistics newer_statistics = original_statistics;
+    newer.push_back(make_run(1000), newer_statistics);
+    ASSERT_EQ(&original[0], &newer[0]);
+    ASSERT_EQ(100u, original.size());
+    ASSERT_EQ(50.0, original.Statistics().median.value);
+    ASSERT_EQ(51.0, newer.Statistics().median.value);
+
+    // a second version from the same original can't append to the same chunk
+    skb::RunSamples other = original;
+    skb::OrderStatistics other_statistics = original_statistics;
+    other.push_back(make_run(2000), other_statistics);
+    ASSERT_EQ(1000, newer[100].time.count());
+    ASSERT_EQ(2000, other[100].time.count());
+    ASSERT_EQ(&original[0], &other[0]);
+    std::vector<int64_t> times;
+    for (const skb::RunResults & run : other)
+        times.push_back(run.time.count());
+    ASSERT_EQ(101u, times.size());
+    ASSERT_EQ(100, times[99]);
+}
+
+TEST(run_samples, latencies_of_all_runs)
+{
+    auto make_run = [](uint64_t latency)
+    {
+        skb::RunResults run;
+        run.argument = 1;
+        run.num_iterations = 100;
+        run.num_items_processed = 0;
+        run.time = std::chrono::nanoseconds(100 * latency);
+        auto latencies = std::make_shared<skb::LatencyHistogram>();
+        for (int i = 0; i < 100; ++i)
+            latencies->Record(latency);
+        run.latencies = std::move(latencies);
+        return run;
+    };
+    skb::RunSamples samples;
+    skb::OrderStatistics statistics;
+    ASSERT_EQ(nullptr, samples.Latencies());
+    samples.push_back(make_run(20), statistics);
+    skb::RunSamples older = samples;
+    // the median run never sees the slow one
+    samples.push_back(make_run(20), statistics);
+    samples.push_back(make_run(5000), statistics);
+    ASSERT_EQ(300u, samples.Latencies()->total_count);
+    ASSERT_NEAR(5000.0, samples.Latencies()->Percentile(0.99), 5000.0 * 0.03);
+    ASSERT_EQ(20.0, samples.MedianRun().latencies->Percentile(0.99));
+    ASSERT_EQ(100u, older.Latencies()->total_count);
+}
+
+TEST(benchmark_results, snapshots_do_not_change)
+{
+    skb::BenchmarkResults results(nullptr);
+    results.AddArguments({ 1, 2 });
+    std::shared_ptr<const skb::ResultsSnapshot> before = results.GetResults();
+    skb::RunResults run;
+    run.argument = 2;
+    run.num_iterations = 1;
+    run.num_items_processed = 0;
+    run.num_bytes_used = 0;
+    run.time = std::chrono::nanoseconds(100);
+    results.AddResult(run);
+    std::shared_ptr<const skb::ResultsSnapshot> after = results.GetResults();
+    ASSERT_TRUE(before->Find(2)->empty());
+    ASSERT_EQ(1u, after->Find(2)->size());
+    // the argument that didn't change is shared
+    ASSERT_EQ(before->by_argument.at(1), after->by_argument.at(1));
+
+    results.ClearResults();
+    ASSERT_EQ(1u, after->Find(2)->size());
+    ASSERT_TRUE(results.GetResults()->Find(2)->empty());
+    ASSERT_EQ(nullptr, results.GetResults()->Find(3));
+}
@@ -1,14 +1,23 @@
 #pragma once
 
 #include <vector>
+#include <array>
+#include <atomic>
+#include <barrier>
+#include <deque>
+#include <iterator>
 #include <chrono>
 #include <string>
 #include <memory>
 #include <map>
 #include <mutex>
+#include <optional>
 #include <signals/connection.hpp>
 #include "benchmark/benchmark.h"
 #include "custom_benchmark/interned_string.hpp"
+#include "custom_benchmark/cycle_clock.hpp"
+#include "custom_benchmark/statistics.hpp"
+#include "custom_benchmark/latency_histogram.hpp"
 #include "container/flat_hash_map.hpp"
 
 namespace skb
@@ -51,6 +60,100 @@ inline void DoNotOptimize(std::string && str)
 
 struct BenchmarkResults;
 
+// optional per-run metrics. they travel in the slots of RunRecord::counters,
+// so new entries go at the end and the order must never change
+enum RunCounter
+{
+    CpuCycles,
+    Instructions,
+    L1DataMisses,
+    LastLevelCacheMisses,
+    BranchMisses,
+    DataTlbMisses,
+    NumRunCounters
+};
+std::string_view RunCounterName(RunCounter counter);
+
+struct RunCounters
+{
+    bool Has(RunCounter counter) const
+    {
+        return present & (uint64_t(1) << counter);
+    }
+    uint64_t Get(RunCounter counter) const
+    {
+        return values[counter];
+    }
+    void Set(RunCounter counter, uint64_t value)
+    {
+        present |= uint64_t(1) << counter;
+        values[counter] = value;
+    }
+
+    uint64_t present = 0;
+    std::array<uint64_t, NumRunCounters> values = {};
+};
+
+// the clock that measured a run. stored with the results, so the numbers
+// must never change
+enum RunTimer
+{
+    // std::chrono::high_resolution_clock
+    ChronoTimer,
+    // the time stamp counter, see CycleClock. falls back to ChronoTimer on
+    // CPUs without an invariant TSC
+    TscTimer
+};
+
+// where a run happened. runs that share the machine with other runs can be
+// slower, so this gets stored with every result
+struct RunPlacement
+{
+    enum Policy
+    {
+        // the scheduler didn't set an affinity. the OS may move the run around
+        Unpinned,
+        // pinned to one hyperthread of a physical core that nothing else runs on
+        DedicatedPhysicalCore
+    };
+
+    int num_parallel_runs = 1;
+    Policy policy = Unpinned;
+};
+
+// the controls against measurement noise that were in effect in the child
+// process, as the child saw them. a control that was asked for but not allowed,
+// like SCHED_FIFO without CAP_SYS_NICE, is left out. this gets stored with every
+// result so that the noise with and without a control can be compared, so the
+// numbers must never change
+struct RunEnvironment
+{
+    enum Control : uint32_t
+    {
+        // personality(ADDR_NO_RANDOMIZE): the stack, the heap and the libraries
+        // are at the same addresses in every child
+        NoAslr = 1 << 0,
+        FifoScheduling = 1 << 1,
+        // the same few environment variables, padded so that the arguments and
+        // the environment always take up the same space at the top of the stack
+        FixedEnvironment = 1 << 2,
+        // mlockall(MCL_CURRENT) right before the loop started, so nothing that
+        // the benchmark set up gets paged out or faults in while it's timed
+        LockedMemory = 1 << 3
+    };
+
+    uint32_t controls = 0;
+    // the only cpu that the child could run on, -1 if it could run on several
+    int cpu = -1;
+
+    bool Has(Control control) const
+    {
+        return (controls & control) != 0;
+    }
+    // for example "no aslr, fifo, cpu 3". empty if there were no controls
+    std::string ToString() const;
+};
+
 struct RunResults
 {
     int num_iterations;
@@ -58,43 +161,312 @@ struct RunResults
     std::chrono::nanoseconds time;
     size_t num_items_processed;
     size_t num_bytes_used;
+    RunCounters counters = {};
+    RunPlacement placement = {};
+    RunEnvironment environment = {};
+    // runs with the same nonzero block ran back to back at the same argument,
+    // in a random order. see BenchmarkResults::NewBlockId
+    int64_t block = 0;
+    RunTimer timer = ChronoTimer;
+    // how long the child warmed up before it started timing. a benchmark that
+    // keeps needing the full time limit never settles down
+    int64_t warmup_iterations = 0;
+    std::chrono::nanoseconds warmup_time{ 0 };
+    // only for benchmarks that use Benchmark::RecordLatencies
+    std::shared_ptr<const LatencyHistogram> latencies = nullptr;
+    // only for benchmarks that use TrackAllocations. the most bytes that the
+    // benchmark had allocated at once, and how often it called new
+    size_t peak_bytes = 0;
+    size_t num_allocations = 0;
+    // for benchmarks that use Benchmark::SetThreads the time is the wall clock
+    // time of all threads together and num_items_processed is the sum over all
+    // threads, so the time per item measures throughput. thread_time is the
+    // average time that one thread spent in its loop. unlike thread_time, the
+    // wall clock time includes the time that threads spent in PauseTiming,
+    // because the pauses of different threads overlap
+    int num_threads = 1;
+    std::chrono::nanoseconds thread_time{ 0 };
+
+    // the peak bytes if the benchmark tracked them, otherwise whatever it
+    // passed to State::SetNumBytes
+    size_t GetMemoryFootprint() const
+    {
+        return peak_bytes ? peak_bytes : num_bytes_used;
+    }
 
+    // with the median of [baseline_data] at the same argument subtracted. this
+    // gets called while painting, so it never starts a process: if the baseline
+    // has no run at this argument yet it requests one with RequestRun and
+    // returns NaN until the run has arrived
     double GetNanosecondsPerItem(BenchmarkResults * baseline_data) const;
+    // how long one thread took for one of its items. the same as
+    // GetNanosecondsPerItem(nullptr) for single threaded benchmarks
+    double GetNanosecondsPerItemPerThread() const;
+    // NaN if the counter wasn't collected for this run or for the baseline
+    double GetCounterPerItem(RunCounter counter, BenchmarkResults * baseline_data) const;
+};
+
+// all the runs of one benchmark at one argument in the order they were added,
+// and their order statistics in nanoseconds per item without a baseline. keeps
+// at most max_runs, after that the oldest run makes room for the new one, so a
+// point that runs for a long time doesn't grow without bounds.
+// the runs are in chunks that a copy shares with the original, and the order
+// statistics are only a summary, so a new version with one more run costs a
+// few pointers and not a copy of every run
+struct RunSamples
+{
+    // enough for the tails of the distribution
+    static constexpr size_t max_runs = 4096;
+    static constexpr size_t runs_per_chunk = 64;
+
+    struct const_iterator
+    {
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = RunResults;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const RunResults *;
+        using reference = const RunResults &;
+
+        const RunResults & operator*() const
+        {
+            return (*samples)[index];
+        }
+        const RunResults * operator->() const
+        {
+            return &(*samples)[index];
+        }
+        const_iterator & operator++()
+        {
+            ++index;
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator result = *this;
+            ++index;
+            return result;
+        }
+        bool operator==(const const_iterator & other) const = default;
+
+        const RunSamples * samples = nullptr;
+        size_t index = 0;
+    };
+
+    // [statistics] have to be the order statistics of exactly the runs in here.
+    // they live outside so that a version that readers may be holding never
+    // has to change, and they are updated along with the runs
+    void push_back(RunResults run, OrderStatistics & statistics);
+    void clear();
+
+    size_t size() const
+    {
+        return num_runs;
+    }
+    bool empty() const
+    {
+        return num_runs == 0;
+    }
+    const_iterator begin() const
+    {
+        return { this, 0 };
+    }
+    const_iterator end() const
+    {
+        return { this, num_runs };
+    }
+    // the oldest run is at index 0
+    const RunResults & operator[](size_t index) const
+    {
+        size_t position = first_in_chunk + index;
+        return (*chunks[position / runs_per_chunk])[position % runs_per_chunk];
+    }
+
+    // the run with the median time. may not be called while it's empty
+    const RunResults & MedianRun() const
+    {
+        return (*this)[summary.median.id - first_id];
+    }
+    const OrderStatisticsSummary & Statistics() const
+    {
+        return summary;
+    }
+    // of the nanoseconds per item without the baseline subtracted. that way it
+    // never has to run the baseline, and a difference close to zero doesn't make
+    // the relative width explode
+    const MedianConfidenceInterval & GetMedianConfidenceInterval() const
+    {
+        return summary.median_interval;
+    }
+    // the latencies of all the runs together. nullptr if none of them recorded
+    // latencies
+    const std::shared_ptr<const MergedLatencyHistogram> & Latencies() const
+    {
+        return latencies;
+    }
+    // O(n log n), for when all of them are needed
+    std::vector<double> SortedNanosecondsPerItem() const;
+    // the [count] runs in the middle, for when not all of them can be kept
+    std::vector<const RunResults *> RunsAroundMedian(size_t count) const;
+
+private:
+    using Chunk = std::vector<RunResults>;
+
+    std::vector<OrderStatistics::Value> SortedValues() const;
+
+    // every chunk has room for runs_per_chunk runs, so appending to one never
+    // moves the runs that an older version is reading
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    // where the oldest run is in chunks.front()
+    size_t first_in_chunk = 0;
+    size_t num_runs = 0;
+    // the id of the oldest run in the statistics. the ids go up by one per run
+    uint64_t first_id = 0;
+    OrderStatisticsSummary summary;
+    std::shared_ptr<const MergedLatencyHistogram> latencies;
+};
+
+// one version of all the runs of a benchmark. it never changes once it has been
+// published: adding a run makes a new version that shares everything except
+// the runs at the argument that the new run is for
+struct ResultsSnapshot
+{
+    std::map<int64_t, std::shared_ptr<const RunSamples>> by_argument;
+
+    // nullptr if there has never been anything at that argument
+    const RunSamples * Find(int64_t argument) const
+    {
+        auto found = by_argument.find(argument);
+        return found == by_argument.end() ? nullptr : found->second.get();
+    }
 };
 
+struct PerfCounterGroup;
+
 struct State
 {
     State(int num_iterations, int64_t argument);
 
-    inline bool KeepRunning()
+    // use as "for (auto _ : state)". the loop counts down a copy of the iteration
+    // count, so every iteration costs one decrement and one compare. the clock is
+    // only read in begin() and after the last iteration. when recording latencies
+    // the iterations are handed out in batches, and the clock is also read
+    // between batches
+    struct Iterator
     {
-        if (current_iterations)
+        struct [[maybe_unused]] Value
         {
-            if (current_iterations == num_iterations)
-            {
-                total_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start);
-                return false;
-            }
-            ++current_iterations;
+        };
+
+        Value operator*() const
+        {
+            return {};
         }
-        else
+        Iterator & operator++()
+        {
+            --remaining;
+            return *this;
+        }
+        bool operator!=(const Iterator &)
+        {
+            if (remaining != 0) [[likely]]
+                return true;
+            remaining = state->NextBatch();
+            return remaining != 0;
+        }
+
+        int remaining;
+        State * state;
+    };
+    Iterator begin()
+    {
+        return { StartLoop(), this };
+    }
+    Iterator end()
+    {
+        return { 0, nullptr };
+    }
+
+    // the older interface, for "while (state.KeepRunning())". it has to check
+    // whether the loop started on every call, so the range-for loop is cheaper
+    inline bool KeepRunning()
+    {
+        if (!started) [[unlikely]]
+            remaining_iterations = StartLoop();
+        if (remaining_iterations == 0) [[unlikely]]
         {
-            current_iterations = 1;
-            start = std::chrono::high_resolution_clock::now();
+            remaining_iterations = NextBatch();
+            if (remaining_iterations == 0)
+                return false;
         }
+        --remaining_iterations;
         return true;
     }
 
-    RunResults GetResults() const
+    // has to be called before the loop starts
+    void SetTimer(RunTimer value)
+    {
+        timer = value;
+    }
+
+    // the counters count only inside the loop, and not while timing is paused
+    void SetPerfCounters(PerfCounterGroup * counters)
+    {
+        perf_counters = counters;
+    }
+
+    // for benchmarks that run on several threads. every thread has its own State
+    // and has to run the loop, because the loop only starts once all threads
+    // arrived at [start_together]. has to be called before the loop starts
+    void SetThread(int index, int num_threads, std::barrier<> * start_together)
+    {
+        thread_index_ = index;
+        threads_ = num_threads;
+        start_barrier = start_together;
+    }
+    int thread_index() const
+    {
+        return thread_index_;
+    }
+    int threads() const
+    {
+        return threads_;
+    }
+    // combines the States of all the threads of one run. see RunResults::num_threads
+    static RunResults CombineThreadResults(const std::vector<State> & threads);
+
+    // see RunEnvironment::LockedMemory. has to be called before the loop starts
+    void SetLockMemory(bool value)
+    {
+        lock_memory = value;
+    }
+
+    // records the average time per iteration of every batch of [batch_size]
+    // iterations. has to be called before the loop starts. the histogram isn't
+    // cleared first
+    void SetLatencyHistogram(LatencyHistogram * histogram, int batch_size)
     {
-        return { num_iterations, argument, GetTotalTime(), num_items_processed, num_bytes_used };
+        latencies = histogram;
+        latency_batch_size = std::max(1, batch_size);
     }
 
-    std::chrono::nanoseconds GetTotalTime() const
+    RunResults GetResults() const
     {
-        return total_time - pause_time;
+        RunResults results = { num_iterations, argument, GetTotalTime(), num_items_processed, num_bytes_used, counters };
+        results.timer = timer;
+        results.peak_bytes = peak_bytes;
+        results.num_allocations = num_allocations;
+        if (memory_locked)
+            results.environment.controls |= RunEnvironment::LockedMemory;
+        return results;
     }
 
+    // with the overhead of reading the clock subtracted once per timed interval
+    std::chrono::nanoseconds GetTotalTime() const;
+    // the median number of nanoseconds between two reads of the ChronoTimer
+    // with nothing in between, like CycleClock::Calibration::overhead_ticks for
+    // the TscTimer. measured on first use
+    static int64_t ChronoTimerOverhead();
+
     int iterations() const
     {
         return num_iterations;
@@ -111,7 +483,7 @@ struct State
     void SetNumBytes(size_t allocated, size_t freed)
     {
         num_bytes_allocated = allocated;
-        num_bytes_used = allocated - freed;
+        num_bytes_used = allocated > freed ? allocated - freed : 0;
     }
     size_t GetNumBytesAllocated() const
     {
@@ -121,6 +493,22 @@ struct State
     {
         return num_bytes_used;
     }
+    void SetPeakBytes(size_t value)
+    {
+        peak_bytes = value;
+    }
+    size_t GetPeakBytes() const
+    {
+        return peak_bytes;
+    }
+    void SetNumAllocations(size_t value)
+    {
+        num_allocations = value;
+    }
+    size_t GetNumAllocations() const
+    {
+        return num_allocations;
+    }
 
     int64_t GetArgument() const
     {
@@ -130,30 +518,115 @@ struct State
     {
         if (which == 0)
             return argument;
+        else if (which <= extra_arguments.size())
+            return extra_arguments[which - 1];
         else
             return 0;
     }
+    // the values for range(1) and up. see Benchmark::AddRange
+    void SetExtraArguments(std::vector<int64_t> values)
+    {
+        extra_arguments = std::move(values);
+    }
 
     void PauseTiming()
     {
-        pause_start = std::chrono::high_resolution_clock::now();
+        pause_start = ReadTimerStop();
+        if (perf_counters)
+            PauseCounters();
     }
     void ResumeTiming()
     {
-        pause_time += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - pause_start);
+        if (perf_counters)
+            ResumeCounters();
+        paused_ticks += ReadTimerStart() - pause_start;
+        ++num_pauses;
     }
 
 private:
-    int current_iterations = 0;
+    bool started = false;
+    bool finished = false;
+    int remaining_iterations = 0;
+    // the iterations that haven't been handed to the loop in a batch yet
+    int iterations_not_started = 0;
     int num_iterations = 1;
     int64_t argument = 0;
-    std::chrono::high_resolution_clock::time_point start;
-    std::chrono::nanoseconds total_time;
-    std::chrono::high_resolution_clock::time_point pause_start;
-    std::chrono::nanoseconds pause_time{0};
+    std::vector<int64_t> extra_arguments;
+    // ticks are nanoseconds for the ChronoTimer and TSC ticks for the TscTimer
+    RunTimer timer = ChronoTimer;
+    int64_t start = 0;
+    int64_t total_ticks = 0;
+    int64_t pause_start = 0;
+    int64_t paused_ticks = 0;
+    int num_pauses = 0;
+    // one per batch. every one of them contains the cost of reading the clock
+    int num_timed_intervals = 0;
+    int current_batch_size = 0;
+    int64_t batch_start_paused_ticks = 0;
+    int batch_start_num_pauses = 0;
+    LatencyHistogram * latencies = nullptr;
+    int latency_batch_size = 0;
     size_t num_items_processed = 0;
     size_t num_bytes_allocated = 0;
     size_t num_bytes_used = 0;
+    size_t peak_bytes = 0;
+    size_t num_allocations = 0;
+    RunCounters counters;
+    PerfCounterGroup * perf_counters = nullptr;
+    int thread_index_ = 0;
+    int threads_ = 1;
+    std::barrier<> * start_barrier = nullptr;
+    // when the loop started and ended, for the wall clock time of several threads
+    int64_t loop_start = 0;
+    int64_t loop_stop = 0;
+    bool lock_memory = false;
+    bool memory_locked = false;
+
+    // returns the size of the first batch
+    int StartLoop()
+    {
+        started = true;
+        current_batch_size = latencies ? std::min(latency_batch_size, num_iterations) : num_iterations;
+        iterations_not_started = num_iterations - current_batch_size;
+        if (lock_memory)
+            LockMemory();
+        if (start_barrier)
+            start_barrier->arrive_and_wait();
+        if (perf_counters)
+            StartCounters();
+        start = ReadTimerStart();
+        loop_start = start;
+        return current_batch_size;
+    }
+    // called when the loop has run out of iterations. returns the size of
+    // the next batch, or zero once all the iterations are done
+    int NextBatch();
+    double TicksToNanoseconds(int64_t ticks, int num_intervals) const;
+    void LockMemory();
+
+    int64_t ReadTimerStart() const
+    {
+        if (timer == TscTimer)
+            return CycleClock::ReadStart();
+        else
+            return ReadChronoTimer();
+    }
+    int64_t ReadTimerStop() const
+    {
+        if (timer == TscTimer)
+            return CycleClock::ReadStop();
+        else
+            return ReadChronoTimer();
+    }
+    static int64_t ReadChronoTimer()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now().time_since_epoch()).count();
+    }
+
+    void StartCounters();
+    void PauseCounters();
+    void ResumeCounters();
+    void StopCounters();
 };
 
 struct Benchmark;
@@ -173,13 +646,37 @@ struct BenchmarkResults
     BenchmarkResults * baseline_results = nullptr;
 
     int FindGoodNumberOfIterations(int64_t argument, float desired_running_time) const;
-    void AddResult(RunResults results);
+    // the seconds that one run at [argument] is going to take with the number of
+    // iterations that FindGoodNumberOfIterations picks, including the warmup and
+    // the run of the baseline. never starts a process, so without any runs yet
+    // this is only the desired running time
+    double EstimateRunSeconds(int64_t argument, float desired_running_time) const;
+    // the runs as of now. this never waits for a writer, so the graph can call it
+    // while painting. the snapshot stays valid and unchanged for as long as the
+    // pointer is held, no matter what gets added in the meantime
+    std::shared_ptr<const ResultsSnapshot> GetResults() const
+    {
+        return results.load(std::memory_order_acquire);
+    }
+    // goes up with every new version of the results. the benchmark threads add
+    // results while the graph and the scheduler use them, so those two check
+    // this for changes instead of being called from the benchmark threads
+    uint64_t GetResultsGeneration() const
+    {
+        return results_generation.load(std::memory_order_acquire);
+    }
+    void AddResult(RunResults result);
+    // as one new version, for loading from the database
+    void AddResults(std::vector<RunResults> new_results);
+    // an entry without runs for every argument, so that the benchmark threads
+    // know that they should run those
+    void AddArguments(const std::vector<int64_t> & arguments);
     void ClearResults();
-    static void MoveMedianToFront(std::vector<RunResults> & results);
 
     struct RunAndBaselineResults
     {
-        RunResults results;
+        // nullopt if the run failed. the child printed why
+        std::optional<RunResults> results;
         std::unique_ptr<RunResults> baseline_results;
     };
 
@@ -189,16 +686,73 @@ struct BenchmarkResults
         ProfileMode
     };
 
-    RunAndBaselineResults Run(int64_t argument, RunType run_type);
-    RunResults RunInNewProcess(int num_iterations, int64_t argument) const;
-
-    sig2::Signal<BenchmarkResults *> results_added_signal;
-
-    mutable std::mutex results_mutex;
-    std::map<int64_t, std::vector<RunResults>> results;
+    enum ChildProcessMode
+    {
+        // execv the executable for every single run
+        ExecPerRun,
+        // keep one long-lived worker per executable and send it commands over a pipe
+        PersistentWorker,
+        // like PersistentWorker, but the long-lived process never runs a benchmark
+        // itself. it only forks, so every forked child starts from a clean state
+        ForkServer
+    };
+    static void SetChildProcessMode(ChildProcessMode mode);
+    // off by default. if the child can't open the counters the results just don't have them
+    static void SetCollectHardwareCounters(bool value);
+    // the timer for benchmarks that don't pick one with Benchmark::SetTimer
+    static void SetDefaultTimer(RunTimer timer);
+    // off by default. if on, the child runs untimed batches of the benchmark until
+    // the time per iteration settles down, and only then times the real run
+    static void SetWarmup(bool value);
+    // the controls to apply to every child process. [cpu] is the cpu to pin the
+    // children to, -1 leaves them with the affinity of the benchmark thread.
+    // with several benchmark threads each one pins its children to its own cpu
+    // instead, see SetRunnerCpu. restarts the workers, because most controls
+    // only take effect when a process starts
+    static void SetRunEnvironment(RunEnvironment requested);
+    // for the calling benchmark thread when several of them run at once: the
+    // cpu that it is pinned to, or -1. if the run environment asks for pinning,
+    // the children of this thread get pinned to this cpu
+    static void SetRunnerCpu(int cpu);
+
+    RunAndBaselineResults Run(int64_t argument, RunType run_type, RunPlacement placement = {}, int64_t block = 0);
+    // for running several benchmarks as one block: once each, at the same
+    // argument, in a random order. slow drift of the machine then affects all
+    // of them alike, and comparing the runs of a block with each other cancels
+    // it out, see ComparePaired. the ids are unique across sessions, so blocks
+    // from the database never mix with new ones
+    static int64_t NewBlockId();
+    // nullopt if the child couldn't run the benchmark. it printed why
+    std::optional<RunResults> RunInNewProcess(int num_iterations, int64_t argument) const;
+
+    // asks the benchmark threads for a run at [argument]. a run that was
+    // already requested and hasn't been added yet isn't requested again, so this
+    // is cheap enough to call on every repaint
+    void RequestRun(int64_t argument);
+    // the oldest requested run that no thread has taken yet. the benchmark
+    // threads run these before anything else
+    static std::optional<std::pair<BenchmarkResults *, int64_t>> TakeRequestedRun();
+    // for when a thread is done with a run that it got from TakeRequestedRun,
+    // whether or not the run added a result. if it didn't, the run can be
+    // requested again
+    void FinishRequestedRun(int64_t argument);
+
+    // only writers take this, so that their new versions don't overwrite each
+    // other. readers go through GetResults
+    std::mutex write_mutex;
+    std::atomic<std::shared_ptr<const ResultsSnapshot>> results{ std::make_shared<const ResultsSnapshot>() };
+    // only goes up after the new version is in results, so whoever sees the
+    // new generation also gets at least that version from GetResults
+    std::atomic<uint64_t> results_generation{ 0 };
+    // the order statistics of the runs in the newest version, by argument.
+    // only for writers, under write_mutex
+    std::map<int64_t, OrderStatistics> order_statistics;
 
     int my_global_index = -1;
     interned_string executable;
+    // whether the runs from the database were added already. only for the
+    // thread that loads them
+    bool loaded_from_db = false;
 };
 
 struct BenchmarkCategories
@@ -208,6 +762,9 @@ struct BenchmarkCategories
     void AddCategory(interned_string category, interned_string value);
     BenchmarkCategories AddCategoryCopy(interned_string category, interned_string value) const &;
     BenchmarkCategories AddCategoryCopy(interned_string category, interned_string value) &&;
+    // a copy without [category], or the same categories if there is none. the
+    // type and the name can't be left out
+    BenchmarkCategories WithoutCategory(const interned_string & category) const;
 
     bool operator==(const BenchmarkCategories & other) const;
     bool operator<(const BenchmarkCategories & other) const;
@@ -233,7 +790,13 @@ struct BenchmarkCategories
 
 private:
     BenchmarkCategories();
+    void InsertSorted(const interned_string & category, const interned_string & value);
+
     ska::flat_hash_map<interned_string, interned_string> categories;
+    // the same pairs, sorted. the order of a hash map depends on how it was
+    // filled and copied, so the comparisons go through these. this is the key
+    // of AllBenchmarks, so they don't sort on every comparison
+    std::vector<std::pair<interned_string, interned_string>> sorted_categories;
 };
 
 struct CategoryBuilder
@@ -271,6 +834,75 @@ struct Benchmark
         return this;
     }
 
+    enum ProcessIsolation
+    {
+        // the worker forks a fresh copy of itself for every run, so nothing
+        // one run leaves behind can change the timing of the next one
+        ForkPerRun,
+        // run directly inside the warm worker. cheapest option, but the heap,
+        // the caches and any static state carry over from previous runs
+        ReuseWorker
+    };
+    Benchmark * SetProcessIsolation(ProcessIsolation value)
+    {
+        isolation = value;
+        return this;
+    }
+    ProcessIsolation GetProcessIsolation() const
+    {
+        return isolation;
+    }
+
+    // overrides the timer that is selected in the GUI
+    Benchmark * SetTimer(RunTimer value)
+    {
+        timer = value;
+        return this;
+    }
+    std::optional<RunTimer> GetTimer() const
+    {
+        return timer;
+    }
+
+    // records the time of every batch of [iterations_per_sample] iterations in a
+    // LatencyHistogram, so that the graph can show percentiles. reading the clock
+    // costs about 20ns with the chrono timer, less with the TSC timer, so use a
+    // batch size that makes that small compared to the batch
+    Benchmark * RecordLatencies(int iterations_per_sample = 1)
+    {
+        latency_batch_size = std::max(1, iterations_per_sample);
+        return this;
+    }
+    // zero if latencies aren't recorded
+    int GetLatencyBatchSize() const
+    {
+        return latency_batch_size;
+    }
+
+    // registers a copy of this benchmark for every one of the [thread_counts]
+    // and adds a "threads" category to all of them, so that the graph can show
+    // how the benchmark scales. this benchmark gets the first thread count. the
+    // copies take the settings that this benchmark has at the time of the call,
+    // so call this last. hardware counters and latencies only come from the
+    // first thread
+    Benchmark * SetThreads(const std::vector<int> & thread_counts);
+    int GetNumThreads() const
+    {
+        return num_threads;
+    }
+    static const interned_string & ThreadsIndex();
+
+    // adds another dimension to the arguments: the first call is for
+    // State::range(1), the next one for range(2) and so on. the x axis stays
+    // range(0). like SetThreads this registers a copy for every value, with the
+    // value in the category [name], so call it after the other settings. calls
+    // to AddRange and SetThreads multiply, every combination gets a copy
+    Benchmark * AddRange(interned_string name, int64_t range_begin, int64_t range_end, double multiplier);
+    const std::vector<int64_t> & GetExtraArguments() const
+    {
+        return extra_arguments;
+    }
+
     std::vector<int64_t> GetAllArguments() const;
 
     struct RangeOfArguments {
@@ -278,6 +910,7 @@ struct Benchmark
         int64_t end;
         double multiplier;
 
+        std::vector<int64_t> Values() const;
         std::string Serialize() const;
         static RangeOfArguments Deserialize(std::string_view);
     };
@@ -289,15 +922,31 @@ private:
     int64_t range_begin = 0;
     int64_t range_end = 0;
     double range_multiplier = 0;
+    ProcessIsolation isolation = ForkPerRun;
+    std::optional<RunTimer> timer;
+    int latency_batch_size = 0;
+    int num_threads = 1;
+    std::vector<int64_t> extra_arguments;
+    // made by SetThreads and AddRange
+    std::vector<Benchmark *> copies;
 
 protected:
     skb::BenchmarkResults * results = nullptr;
 
+    // for SetThreads and AddRange. [categories] already has the compiler and the optimizer
+    virtual Benchmark * CopyWithCategories(BenchmarkCategories categories) const;
+
 private:
     mutable std::mutex arguments_mutex;
     mutable std::vector<int64_t> all_arguments;
 
     void AddToAllBenchmarks(const BenchmarkCategories & categories);
+    // for categories that are added after the benchmark was registered
+    void AddCategoryToRegisteredBenchmark(interned_string category, interned_string value);
+    // copies this benchmark and all the copies that were made before once for
+    // every value after the first, and sets the [category] of all of them.
+    // [apply] gets called with every benchmark and its value
+    void ExpandCategory(const interned_string & category, const std::vector<int64_t> & values, const std::function<void (Benchmark &, int64_t)> & apply);
 };
 struct LambdaBenchmark : Benchmark
 {
@@ -305,6 +954,9 @@ struct LambdaBenchmark : Benchmark
     void Run(State & state) const;
 
     std::function<void (State & state)> function;
+
+protected:
+    Benchmark * CopyWithCategories(BenchmarkCategories categories) const override;
 };
 struct BenchmarkInOtherProcess : Benchmark
 {
@@ -313,6 +965,14 @@ struct BenchmarkInOtherProcess : Benchmark
 
 bool RunSingleBenchmarkFromCommandLine(int argc, char * argv[]);
 std::optional<std::string> LoadAllBenchmarksFromFile(std::string_view filename);
+// what LoadAllBenchmarksFromFile does with the list that the executable printed
+void LoadAllBenchmarks(interned_string executable, const std::string & run_results);
+// the category that LoadAllBenchmarksFromFile adds with the name of the executable
+const interned_string & FilenameIndex();
+// the category that LoadAllBenchmarksFromFile adds with the directory of the
+// executable, but only if one with the same name was loaded from somewhere else.
+// that depends on the order of loading, so the database doesn't store it
+const interned_string & BuildIndex();
 }
 
 #define SKB_CONCAT2(a, b) a ## b
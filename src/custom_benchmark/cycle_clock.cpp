@@ -0,0 +1,78 @@
+#include "custom_benchmark/cycle_clock.hpp"
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#if SKB_HAS_RDTSC
+#include <cpuid.h>
+#endif
+
+namespace skb
+{
+
+bool CycleClock::IsAvailable()
+{
+#if SKB_HAS_RDTSC
+    static const bool result = []
+    {
+        unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+        // rdtscp is bit 27 of edx in leaf 0x80000001, the invariant TSC is bit 8 in leaf 0x80000007
+        if (!__get_cpuid(0x80000001, &eax, &ebx, &ecx, &edx) || !(edx & (1u << 27)))
+            return false;
+        if (!__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+            return false;
+        return (edx & (1u << 8)) != 0;
+    }();
+    return result;
+#else
+    return false;
+#endif
+}
+
+static CycleClock::Calibration Calibrate()
+{
+    CycleClock::Calibration result;
+    std::vector<int64_t> overheads;
+    for (int i = 0; i < 255; ++i)
+    {
+        int64_t start = CycleClock::ReadStart();
+        overheads.push_back(CycleClock::ReadStop() - start);
+    }
+    std::nth_element(overheads.begin(), overheads.begin() + overheads.size() / 2, overheads.end());
+    result.overhead_ticks = overheads[overheads.size() / 2];
+
+    // the steady clock is read right next to the TSC at both ends, so its own
+    // overhead is a small fraction of the millisecond in between
+    auto steady_start = std::chrono::steady_clock::now();
+    int64_t ticks_start = CycleClock::ReadStart();
+    std::chrono::steady_clock::time_point steady_end;
+    do
+        steady_end = std::chrono::steady_clock::now();
+    while (steady_end - steady_start < std::chrono::milliseconds(1));
+    int64_t ticks_end = CycleClock::ReadStop();
+    double nanoseconds = std::chrono::duration<double, std::nano>(steady_end - steady_start).count();
+    result.nanoseconds_per_tick = nanoseconds / std::max(int64_t(1), ticks_end - ticks_start);
+    return result;
+}
+
+const CycleClock::Calibration & CycleClock::GetCalibration()
+{
+    static const Calibration result = Calibrate();
+    return result;
+}
+
+}
+
+#include "test/include_test.hpp"
+
+TEST(cycle_clock, calibration)
+{
+    if (!skb::CycleClock::IsAvailable())
+        return;
+    const skb::CycleClock::Calibration & calibration = skb::CycleClock::GetCalibration();
+    // anything from a 100MHz to a 20GHz counter
+    ASSERT_LT(0.05, calibration.nanoseconds_per_tick);
+    ASSERT_GT(10.0, calibration.nanoseconds_per_tick);
+    ASSERT_LE(0, calibration.overhead_ticks);
+    int64_t start = skb::CycleClock::ReadStart();
+    ASSERT_LE(start, skb::CycleClock::ReadStop());
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SKB_HAS_RDTSC 1
+#else
+#define SKB_HAS_RDTSC 0
+#endif
+
+namespace skb
+{
+// the time stamp counter of the CPU. reading it costs a few nanoseconds instead
+// of the ~20ns of a clock_gettime call, which matters for benchmarks that pause
+// the timer in every iteration. see libs/benchmark/src/cycleclock.h for the
+// same idea without the fences
+struct CycleClock
+{
+    // true if the CPU has an invariant TSC, meaning one that ticks at a constant
+    // rate independent of frequency scaling and sleep states. if it doesn't the
+    // ticks can't be converted to time
+    static bool IsAvailable();
+
+    // the lfences keep the measured code from moving across the reads: nothing
+    // that comes before a start read and nothing that comes after a stop read
+    // gets counted
+    static int64_t ReadStart()
+    {
+#if SKB_HAS_RDTSC
+        _mm_lfence();
+        int64_t result = __rdtsc();
+        _mm_lfence();
+        return result;
+#else
+        return 0;
+#endif
+    }
+    static int64_t ReadStop()
+    {
+#if SKB_HAS_RDTSC
+        unsigned int aux;
+        int64_t result = __rdtscp(&aux);
+        _mm_lfence();
+        return result;
+#else
+        return 0;
+#endif
+    }
+
+    struct Calibration
+    {
+        double nanoseconds_per_tick = 0.0;
+        // the median number of ticks between a start read and a stop read
+        // with nothing in between. every measured interval contains this once
+        int64_t overhead_ticks = 0;
+    };
+    // measured against the steady clock on first use. takes about a millisecond
+    static const Calibration & GetCalibration();
+};
+}
@@ -0,0 +1,158 @@
+#include "custom_benchmark/latency_histogram.hpp"
+#include "debug/assert.hpp"
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace skb
+{
+
+uint64_t LatencyHistogram::BucketBegin(int index)
+{
+    if (index < 2 * SubBucketCount)
+        return static_cast<uint64_t>(index);
+    int shift = index / SubBucketCount - 1;
+    uint64_t sub_bucket = index % SubBucketCount;
+    return (SubBucketCount + sub_bucket) << shift;
+}
+uint64_t LatencyHistogram::BucketEnd(int index)
+{
+    if (index == NumBuckets - 1)
+        return std::numeric_limits<uint64_t>::max();
+    return BucketBegin(index + 1);
+}
+
+// for the counts of a single run and for merged ones
+template<typename Counts>
+static double PercentileOf(const Counts & counts, uint64_t total_count, double fraction)
+{
+    if (total_count == 0)
+        return std::numeric_limits<double>::quiet_NaN();
+    // the rank of the value, starting at 1
+    uint64_t rank = std::max(uint64_t(1), static_cast<uint64_t>(std::ceil(fraction * total_count)));
+    uint64_t seen = 0;
+    for (int i = 0; i < LatencyHistogram::NumBuckets; ++i)
+    {
+        seen += counts[i];
+        if (seen < rank)
+            continue;
+        if (i == LatencyHistogram::NumBuckets - 1)
+            return static_cast<double>(LatencyHistogram::BucketBegin(i));
+        return (LatencyHistogram::BucketBegin(i) + LatencyHistogram::BucketEnd(i) - 1) / 2.0;
+    }
+    return static_cast<double>(LatencyHistogram::BucketBegin(LatencyHistogram::NumBuckets - 1));
+}
+
+double LatencyHistogram::Percentile(double fraction) const
+{
+    return PercentileOf(counts, total_count, fraction);
+}
+
+void LatencyHistogram::Clear()
+{
+    counts.fill(0);
+    total_count = 0;
+}
+
+int LatencyHistogram::NumUsedBuckets() const
+{
+    int result = NumBuckets;
+    while (result > 0 && counts[result - 1] == 0)
+        --result;
+    return result;
+}
+
+std::string LatencyHistogram::Serialize() const
+{
+    static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__);
+    int num_used = NumUsedBuckets();
+    return std::string(reinterpret_cast<const char *>(counts.data()), num_used * sizeof(uint32_t));
+}
+LatencyHistogram LatencyHistogram::Deserialize(std::string_view bytes)
+{
+    LatencyHistogram result;
+    CHECK_FOR_INVALID_DATA(bytes.size() % sizeof(uint32_t) == 0 && bytes.size() <= sizeof(result.counts));
+    std::memcpy(result.counts.data(), bytes.data(), bytes.size());
+    for (uint32_t count : result.counts)
+        result.total_count += count;
+    return result;
+}
+
+void MergedLatencyHistogram::Add(const LatencyHistogram & histogram)
+{
+    for (int i = 0; i < LatencyHistogram::NumBuckets; ++i)
+        counts[i] += histogram.counts[i];
+    total_count += histogram.total_count;
+}
+void MergedLatencyHistogram::Subtract(const LatencyHistogram & histogram)
+{
+    CHECK_FOR_PROGRAMMER_ERROR(histogram.total_count <= total_count);
+    for (int i = 0; i < LatencyHistogram::NumBuckets; ++i)
+        counts[i] -= histogram.counts[i];
+    total_count -= histogram.total_count;
+}
+double MergedLatencyHistogram::Percentile(double fraction) const
+{
+    return PercentileOf(counts, total_count, fraction);
+}
+
+}
+
+#include "test/include_test.hpp"
+
+TEST(latency_histogram, buckets)
+{
+    using skb::LatencyHistogram;
+    for (uint64_t value : { 0ull, 1ull, 31ull, 32ull, 63ull, 64ull, 65ull, 1000ull, 123456789ull, (1ull << 35) + 5 })
+    {
+        int index = LatencyHistogram::BucketIndex(value);
+        ASSERT_LE(LatencyHistogram::BucketBegin(index), value);
+        ASSERT_LT(value, LatencyHistogram::BucketEnd(index));
+        // about 3% precision
+        ASSERT_LE(LatencyHistogram::BucketEnd(index) - LatencyHistogram::BucketBegin(index), std::max(uint64_t(1), value / 16));
+    }
+    ASSERT_EQ(LatencyHistogram::NumBuckets - 1, LatencyHistogram::BucketIndex(1ull << 40));
+    for (int i = 1; i < LatencyHistogram::NumBuckets; ++i)
+        ASSERT_EQ(LatencyHistogram::BucketEnd(i - 1), LatencyHistogram::BucketBegin(i));
+}
+
+TEST(latency_histogram, percentiles)
+{
+    // like a heap pop that is usually fast but sometimes slow
+    skb::LatencyHistogram histogram;
+    for (int i = 0; i < 990; ++i)
+        histogram.Record(20);
+    for (int i = 0; i < 10; ++i)
+        histogram.Record(5000);
+    ASSERT_EQ(20.0, histogram.Percentile(0.5));
+    ASSERT_EQ(20.0, histogram.Percentile(0.99));
+    ASSERT_NEAR(5000.0, histogram.Percentile(0.999), 5000.0 * 0.03);
+
+    skb::LatencyHistogram roundtripped = skb::LatencyHistogram::Deserialize(histogram.Serialize());
+    ASSERT_EQ(histogram.total_count, roundtripped.total_count);
+    ASSERT_EQ(histogram.counts, roundtripped.counts);
+    ASSERT_TRUE(std::isnan(skb::LatencyHistogram().Percentile(0.5)));
+}
+
+TEST(latency_histogram, merged_percentiles)
+{
+    // one run that is always fast and one that is sometimes slow
+    skb::LatencyHistogram fast;
+    skb::LatencyHistogram slow;
+    for (int i = 0; i < 1000; ++i)
+    {
+        fast.Record(20);
+        slow.Record(i < 950 ? 20 : 5000);
+    }
+    skb::MergedLatencyHistogram merged;
+    merged.Add(fast);
+    merged.Add(slow);
+    ASSERT_EQ(2000u, merged.total_count);
+    ASSERT_EQ(20.0, merged.Percentile(0.5));
+    ASSERT_EQ(20.0, merged.Percentile(0.97));
+    ASSERT_NEAR(5000.0, merged.Percentile(0.99), 5000.0 * 0.03);
+    merged.Subtract(slow);
+    ASSERT_EQ(20.0, merged.Percentile(0.99));
+    merged.Subtract(fast);
+    ASSERT_TRUE(merged.empty());
+}
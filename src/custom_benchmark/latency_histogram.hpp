@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace skb
+{
+// a log-linear histogram of nanoseconds in the style of HdrHistogram: values
+// below 64 get a bucket each, above that every power of two is split into 32
+// buckets, so a value is never off by more than about 3%. it's a fixed array,
+// so recording never allocates
+struct LatencyHistogram
+{
+    static constexpr int SubBucketBits = 5;
+    static constexpr int SubBucketCount = 1 << SubBucketBits;
+    // values of 2^MaxValueBits nanoseconds (about 69 seconds) and more all go
+    // in the last bucket
+    static constexpr int MaxValueBits = 36;
+    static constexpr int NumBuckets = (MaxValueBits - SubBucketBits + 1) * SubBucketCount;
+
+    void Record(uint64_t nanoseconds)
+    {
+        ++counts[BucketIndex(nanoseconds)];
+        ++total_count;
+    }
+
+    static int BucketIndex(uint64_t value)
+    {
+        if (value < SubBucketCount)
+            return static_cast<int>(value);
+        int highest_bit = 63 - __builtin_clzll(value);
+        if (highest_bit >= MaxValueBits)
+            return NumBuckets - 1;
+        int shift = highest_bit - SubBucketBits;
+        return (shift + 1) * SubBucketCount + static_cast<int>((value >> shift) & (SubBucketCount - 1));
+    }
+    // the smallest value that goes in the bucket, and the first one that doesn't
+    static uint64_t BucketBegin(int index);
+    static uint64_t BucketEnd(int index);
+
+    // the value that [fraction] of the recorded values are at or below, as the
+    // middle of its bucket. NaN if nothing was recorded
+    double Percentile(double fraction) const;
+
+    bool empty() const
+    {
+        return total_count == 0;
+    }
+    void Clear();
+
+    // the number of buckets up to the last one that isn't empty. only those
+    // have to be sent or stored
+    int NumUsedBuckets() const;
+    // the counts of the used buckets as little endian uint32_t, for the database
+    std::string Serialize() const;
+    static LatencyHistogram Deserialize(std::string_view bytes);
+
+    uint64_t total_count = 0;
+    std::array<uint32_t, NumBuckets> counts = {};
+};
+
+// the histograms of many runs added up, for the percentiles of a whole point.
+// one run's counts fit in 32 bits, the sum of thousands of runs might not
+struct MergedLatencyHistogram
+{
+    void Add(const LatencyHistogram & histogram);
+    // takes out a histogram that was added before
+    void Subtract(const LatencyHistogram & histogram);
+
+    // like LatencyHistogram::Percentile
+    double Percentile(double fraction) const;
+
+    bool empty() const
+    {
+        return total_count == 0;
+    }
+
+    uint64_t total_count = 0;
+    std::array<uint64_t, LatencyHistogram::NumBuckets> counts = {};
+};
+}
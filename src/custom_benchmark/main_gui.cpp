@@ -4,6 +4,8 @@
 #include <QMessageBox>
 #include <QFileDialog>
 #include <QDoubleValidator>
+#include <QIntValidator>
+#include <sched.h>
 #include <QDebug>
 #include "custom_benchmark/profile_mode.hpp"
 
@@ -38,9 +40,25 @@ BenchmarkMainGui::BenchmarkMainGui()
     , reset_current("Delete Current Results")
     , normalize_checkbox("Normalize For Memory")
     , draw_points_checkbox("Draw as Points")
+    , heatmap_checkbox("Draw as Heatmap")
+    , complexity_checkbox("Fit Complexity")
     , profile_mode("Profile Mode")
+    , hardware_counters("Collect Hardware Counters")
+    , tsc_timer("Use TSC Timer")
+    , warmup("Warm Up Before Timing")
+    , interleave("Interleave in Random Blocks")
+    , disable_aslr("Disable ASLR")
+    , fifo_scheduling("SCHED_FIFO If Permitted")
+    , fixed_environment("Fixed Environment Block")
+    , lock_memory("Lock Memory (mlockall)")
+    , y_axis_label("y-axis:")
     , xlimit_label("x-axis limit:")
     , xlimit("0")
+    , target_confidence_label("target CI (+/-%):")
+    , target_confidence("1")
+    , pin_cpu_label("pin runs to cpu:")
+    , pin_cpu("-1")
+    , compare_label("compare to:")
 {
     setLayout(&layout);
 
@@ -98,6 +116,8 @@ BenchmarkMainGui::BenchmarkMainGui()
             init_checkboxes();
             SetCheckboxState(checkbox_state);
             NewFileLoaded(interned_string(as_string));
+            if (compare_against.findText(result) == -1)
+                compare_against.addItem(result);
         }
     });
     QObject::connect(&reset_current, &QPushButton::clicked, this, [&](bool)
@@ -107,6 +127,7 @@ BenchmarkMainGui::BenchmarkMainGui()
         for (skb::BenchmarkResults * results : graph.GetData())
         {
             results->ClearResults();
+            ResultsCleared(results);
         }
     });
 
@@ -118,6 +139,14 @@ BenchmarkMainGui::BenchmarkMainGui()
     {
         graph.SetDrawAsPoints(state != 0);
     });
+    QObject::connect(&heatmap_checkbox, &QCheckBox::stateChanged, this, [&](int state)
+    {
+        graph.SetDrawAsHeatmap(state != 0);
+    });
+    QObject::connect(&complexity_checkbox, &QCheckBox::stateChanged, this, [&](int state)
+    {
+        graph.SetFitComplexity(state != 0);
+    });
     QObject::connect(&profile_mode, &QCheckBox::stateChanged, this, [&](int state)
     {
         if (state == 0) {
@@ -125,6 +154,66 @@ BenchmarkMainGui::BenchmarkMainGui()
         }
     });
 
+    QObject::connect(&hardware_counters, &QCheckBox::stateChanged, this, [&](int state)
+    {
+        skb::BenchmarkResults::SetCollectHardwareCounters(state != 0);
+    });
+    QObject::connect(&tsc_timer, &QCheckBox::stateChanged, this, [&](int state)
+    {
+        skb::BenchmarkResults::SetDefaultTimer(state ? skb::TscTimer : skb::ChronoTimer);
+    });
+    QObject::connect(&warmup, &QCheckBox::stateChanged, this, [&](int state)
+    {
+        skb::BenchmarkResults::SetWarmup(state != 0);
+    });
+    for (QCheckBox * control : { &disable_aslr, &fifo_scheduling, &fixed_environment, &lock_memory })
+    {
+        QObject::connect(control, &QCheckBox::stateChanged, this, [&](int)
+        {
+            UpdateRunEnvironment();
+        });
+    }
+    pin_cpu.setValidator(new QIntValidator(-1, CPU_SETSIZE - 1));
+    // not on every keystroke: changing the cpu restarts all the workers, and
+    // typing "12" would pin them to cpu 1 first
+    QObject::connect(&pin_cpu, &QLineEdit::editingFinished, this, [&]
+    {
+        bool ok = false;
+        int cpu = pin_cpu.text().toInt(&ok);
+        if (!ok || cpu < -1 || cpu >= CPU_SETSIZE || cpu == applied_pin_cpu)
+            return;
+        applied_pin_cpu = cpu;
+        UpdateRunEnvironment();
+    });
+    y_axis.addItem("ns per item");
+    for (int i = 0; i < skb::NumRunCounters; ++i)
+    {
+        std::string name(skb::RunCounterName(static_cast<skb::RunCounter>(i)));
+        name += " per item";
+        y_axis.addItem(QString::fromUtf8(name.c_str()));
+    }
+    y_axis.addItem("latency p50/p99/p99.9");
+    QObject::connect(&y_axis, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, [&](int index)
+    {
+        graph.SetYAxisLatencies(index == skb::NumRunCounters + 1);
+        if (index <= 0 || index > skb::NumRunCounters)
+            graph.SetYAxisCounter(std::nullopt);
+        else
+            graph.SetYAxisCounter(static_cast<skb::RunCounter>(index - 1));
+    });
+
+    compare_against.addItem("nothing");
+    QObject::connect(&compare_against, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, [&](int index)
+    {
+        if (index <= 0)
+            graph.SetCompareAgainst(interned_string());
+        else
+        {
+            QByteArray as_utf8 = compare_against.itemText(index).toUtf8();
+            graph.SetCompareAgainst(interned_string(std::string_view(as_utf8.data(), as_utf8.size())));
+        }
+    });
+
     xlimit.setValidator(new QDoubleValidator());
     xlimit.setSizePolicy(QSizePolicy::Preferred, QSizePolicy::Preferred);
     QObject::connect(&xlimit, &QLineEdit::textChanged, this, [&](const QString & text)
@@ -146,6 +235,15 @@ BenchmarkMainGui::BenchmarkMainGui()
     });
     xlimit.setText("1000000");
 
+    target_confidence.setValidator(new QDoubleValidator(0.0, 100.0, 3));
+    QObject::connect(&target_confidence, &QLineEdit::textChanged, this, [&](const QString & text)
+    {
+        bool ok = false;
+        double percent = text.toDouble(&ok);
+        if (ok)
+            graph.SetTargetRelativeConfidence(percent / 100.0);
+    });
+
     category_checkbox_area.setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
     category_checkbox_area.setHorizontalScrollBarPolicy(Qt::ScrollBarAsNeeded);
     category_checkbox_area.setFrameShape(QFrame::NoFrame);
@@ -162,13 +260,46 @@ BenchmarkMainGui::BenchmarkMainGui()
     rhs_layout->addWidget(&benchmark_checkbox_area, row++, 0, 1, 2);
     rhs_layout->addWidget(&xlimit_label, row, 0);
     rhs_layout->addWidget(&xlimit, row++, 1);
+    rhs_layout->addWidget(&target_confidence_label, row, 0);
+    rhs_layout->addWidget(&target_confidence, row++, 1);
     rhs_layout->addWidget(&normalize_checkbox, row++, 0, 1, 2);
     rhs_layout->addWidget(&draw_points_checkbox, row++, 0, 1, 2);
+    rhs_layout->addWidget(&heatmap_checkbox, row++, 0, 1, 2);
+    rhs_layout->addWidget(&complexity_checkbox, row++, 0, 1, 2);
     rhs_layout->addWidget(&profile_mode, row++, 0, 1, 2);
+    rhs_layout->addWidget(&hardware_counters, row++, 0, 1, 2);
+    rhs_layout->addWidget(&tsc_timer, row++, 0, 1, 2);
+    rhs_layout->addWidget(&warmup, row++, 0, 1, 2);
+    rhs_layout->addWidget(&interleave, row++, 0, 1, 2);
+    rhs_layout->addWidget(&disable_aslr, row++, 0, 1, 2);
+    rhs_layout->addWidget(&fifo_scheduling, row++, 0, 1, 2);
+    rhs_layout->addWidget(&fixed_environment, row++, 0, 1, 2);
+    rhs_layout->addWidget(&lock_memory, row++, 0, 1, 2);
+    rhs_layout->addWidget(&pin_cpu_label, row, 0);
+    rhs_layout->addWidget(&pin_cpu, row++, 1);
+    rhs_layout->addWidget(&y_axis_label, row, 0);
+    rhs_layout->addWidget(&y_axis, row++, 1);
+    rhs_layout->addWidget(&compare_label, row, 0);
+    rhs_layout->addWidget(&compare_against, row++, 1);
     rhs_layout->addWidget(&reset_current, row++, 0, 1, 2);
     layout.addLayout(rhs_layout, 1, 1);
 }
 
+void BenchmarkMainGui::UpdateRunEnvironment()
+{
+    skb::RunEnvironment requested;
+    if (disable_aslr.isChecked())
+        requested.controls |= skb::RunEnvironment::NoAslr;
+    if (fifo_scheduling.isChecked())
+        requested.controls |= skb::RunEnvironment::FifoScheduling;
+    if (fixed_environment.isChecked())
+        requested.controls |= skb::RunEnvironment::FixedEnvironment;
+    if (lock_memory.isChecked())
+        requested.controls |= skb::RunEnvironment::LockedMemory;
+    requested.cpu = applied_pin_cpu;
+    skb::BenchmarkResults::SetRunEnvironment(requested);
+}
+
 void BenchmarkMainGui::OnCategoryChanged(int)
 {
     EnabledBoxes selection = BenchmarksForCurrentCheckboxes();
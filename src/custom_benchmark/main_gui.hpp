@@ -18,6 +18,9 @@ public:
 
     GUI_CS_SIGNAL_1(Public, void NewFileLoaded(interned_string filename))
     GUI_CS_SIGNAL_2(NewFileLoaded, filename)
+    // after the results of the benchmark were deleted
+    GUI_CS_SIGNAL_1(Public, void ResultsCleared(skb::BenchmarkResults * benchmark))
+    GUI_CS_SIGNAL_2(ResultsCleared, benchmark)
 
     BenchmarkGraph & GetGraph()
     {
@@ -27,6 +30,10 @@ public:
     {
         return profile_mode.isChecked();
     }
+    bool InterleaveRuns() const
+    {
+        return interleave.isChecked();
+    }
 
     using checkbox_state = std::map<interned_string, std::map<interned_string, bool, interned_string::pointer_less>, interned_string::pointer_less>;
 
@@ -46,9 +53,29 @@ private:
     QPushButton reset_current;
     QCheckBox normalize_checkbox;
     QCheckBox draw_points_checkbox;
+    QCheckBox heatmap_checkbox;
+    QCheckBox complexity_checkbox;
     QCheckBox profile_mode;
+    QCheckBox hardware_counters;
+    QCheckBox tsc_timer;
+    QCheckBox warmup;
+    QCheckBox interleave;
+    QCheckBox disable_aslr;
+    QCheckBox fifo_scheduling;
+    QCheckBox fixed_environment;
+    QCheckBox lock_memory;
+    QLabel y_axis_label;
+    QComboBox y_axis;
     QLabel xlimit_label;
     QLineEdit xlimit;
+    QLabel target_confidence_label;
+    QLineEdit target_confidence;
+    QLabel pin_cpu_label;
+    QLineEdit pin_cpu;
+    // the last value of pin_cpu that was valid when editing finished
+    int applied_pin_cpu = -1;
+    QLabel compare_label;
+    QComboBox compare_against;
     bool is_formatting_xlimit = false;
 
     BenchmarkGraph graph;
@@ -67,6 +94,7 @@ private:
     std::map<interned_string, CategoryCheckboxes, interned_string::string_less> category_checkboxes;
 
     void OnCategoryChanged(int);
+    void UpdateRunEnvironment();
 
     struct EnabledBoxes
     {
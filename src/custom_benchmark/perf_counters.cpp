@@ -0,0 +1,164 @@
+#include "custom_benchmark/perf_counters.hpp"
+#include "debug/assert.hpp"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace skb
+{
+
+static perf_event_attr CounterAttributes(RunCounter counter)
+{
+    auto cache_event = [](uint64_t cache, uint64_t operation, uint64_t result)
+    {
+        return cache | (operation << 8) | (result << 16);
+    };
+    perf_event_attr attributes;
+    std::memset(&attributes, 0, sizeof(attributes));
+    attributes.size = sizeof(attributes);
+    attributes.type = PERF_TYPE_HARDWARE;
+    switch (counter)
+    {
+    case CpuCycles:
+        attributes.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    case Instructions:
+        attributes.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    case L1DataMisses:
+        attributes.type = PERF_TYPE_HW_CACHE;
+        attributes.config = cache_event(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+        break;
+    case LastLevelCacheMisses:
+        attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+        break;
+    case BranchMisses:
+        attributes.config = PERF_COUNT_HW_BRANCH_MISSES;
+        break;
+    case DataTlbMisses:
+        attributes.type = PERF_TYPE_HW_CACHE;
+        attributes.config = cache_event(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS);
+        break;
+    case NumRunCounters:
+        CHECK_FOR_PROGRAMMER_ERROR(false);
+        break;
+    }
+    attributes.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    return attributes;
+}
+
+PerfCounterGroup::PerfCounterGroup()
+{
+    for (int i = 0; i < NumRunCounters; ++i)
+    {
+        RunCounter counter = static_cast<RunCounter>(i);
+        perf_event_attr attributes = CounterAttributes(counter);
+        // only the leader starts out disabled. the others follow it
+        attributes.disabled = open_counters.empty();
+        int group = open_counters.empty() ? -1 : GroupFd();
+        int fd = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, group, PERF_FLAG_FD_CLOEXEC));
+        if (fd == -1)
+        {
+            if (open_counters.empty() && error.empty())
+            {
+                error = "perf_event_open failed for ";
+                error += RunCounterName(counter);
+                error += ": ";
+                error += std::strerror(errno);
+                if (errno == EACCES || errno == EPERM)
+                    error += ". Check /proc/sys/kernel/perf_event_paranoid";
+            }
+            continue;
+        }
+        uint64_t id = 0;
+        CHECK_FOR_PROGRAMMER_ERROR(ioctl(fd, PERF_EVENT_IOC_ID, &id) != -1);
+        open_counters.push_back({ counter, fd, id });
+    }
+    if (!open_counters.empty())
+        error.clear();
+}
+PerfCounterGroup::~PerfCounterGroup()
+{
+    for (const OpenCounter & counter : open_counters)
+        close(counter.fd);
+}
+
+void PerfCounterGroup::Start()
+{
+    if (empty())
+        return;
+    ioctl(GroupFd(), PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(GroupFd(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+void PerfCounterGroup::Pause()
+{
+    if (!empty())
+        ioctl(GroupFd(), PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+}
+void PerfCounterGroup::Resume()
+{
+    if (!empty())
+        ioctl(GroupFd(), PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+void PerfCounterGroup::ReadInto(RunCounters & counters) const
+{
+    if (empty())
+        return;
+    // the layout for PERF_FORMAT_GROUP | PERF_FORMAT_ID with both times
+    struct
+    {
+        uint64_t num_values;
+        uint64_t time_enabled;
+        uint64_t time_running;
+        struct
+        {
+            uint64_t value;
+            uint64_t id;
+        } values[NumRunCounters];
+    } group_read;
+    ssize_t num_read = read(GroupFd(), &group_read, sizeof(group_read));
+    if (num_read <= 0 || group_read.time_running == 0)
+        return;
+    double scale = static_cast<double>(group_read.time_enabled) / group_read.time_running;
+    for (uint64_t i = 0; i < group_read.num_values && i < NumRunCounters; ++i)
+    {
+        for (const OpenCounter & counter : open_counters)
+        {
+            if (counter.id == group_read.values[i].id)
+                counters.Set(counter.counter, static_cast<uint64_t>(group_read.values[i].value * scale));
+        }
+    }
+}
+
+}
+
+#include "test/include_test.hpp"
+#include <iostream>
+
+TEST(perf_counters, count_instructions)
+{
+    skb::PerfCounterGroup counters;
+    if (counters.empty())
+    {
+        // whether perf_event_open works depends on the machine. this version of
+        // gtest can't skip a test, so say why nothing was checked
+        ASSERT_FALSE(counters.GetError().empty());
+        std::cout << "skipping perf_counters.count_instructions: " << counters.GetError() << std::endl;
+        return;
+    }
+    skb::RunCounters result;
+    counters.Start();
+    int sum = 0;
+    for (int i = 0; i < 1000; ++i)
+        skb::DoNotOptimize(sum += i);
+    counters.Pause();
+    counters.ReadInto(result);
+    ASSERT_TRUE(result.Has(skb::Instructions));
+    ASSERT_LT(1000u, result.Get(skb::Instructions));
+}
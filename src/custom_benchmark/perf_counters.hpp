@@ -0,0 +1,53 @@
+#pragma once
+
+#include "custom_benchmark/custom_benchmark.h"
+#include <vector>
+
+namespace skb
+{
+// hardware counters for the calling thread, opened with perf_event_open as one
+// group so that they all count over exactly the same instructions. counters that
+// the CPU or the kernel don't support are left out. if none can be opened, for
+// example because /proc/sys/kernel/perf_event_paranoid doesn't allow it, the group
+// is empty and all the functions do nothing
+struct PerfCounterGroup
+{
+    PerfCounterGroup();
+    ~PerfCounterGroup();
+    PerfCounterGroup(const PerfCounterGroup &) = delete;
+    PerfCounterGroup & operator=(const PerfCounterGroup &) = delete;
+
+    bool empty() const
+    {
+        return open_counters.empty();
+    }
+
+    // sets all counts back to zero and starts counting
+    void Start();
+    void Pause();
+    void Resume();
+    // the counts are scaled up if the kernel had to multiplex the counters
+    void ReadInto(RunCounters & counters) const;
+
+    // why the first counter couldn't be opened. empty if it could
+    const std::string & GetError() const
+    {
+        return error;
+    }
+
+private:
+    struct OpenCounter
+    {
+        RunCounter counter;
+        int fd;
+        uint64_t id;
+    };
+    std::vector<OpenCounter> open_counters;
+    std::string error;
+
+    int GroupFd() const
+    {
+        return open_counters.front().fd;
+    }
+};
+}
@@ -30,6 +30,19 @@ void DisableProfileMode() {
 }
 
 bool IsProfileMode(int benchmark_index, int64_t argument) {
+    // the runner creates the shared memory. if a benchmark executable was started
+    // from the command line it may not exist, and then nobody can turn on profile mode
+    static bool has_shared_memory = [] {
+        try {
+            InitProfileMode(read_only);
+            return true;
+        } catch (const interprocess_exception &) {
+            return false;
+        }
+    }();
+    if (!has_shared_memory) {
+        return false;
+    }
     shared_memory_object & shm = InitProfileMode(read_only);
     mapped_region region(shm, read_only);
     ProfileModeArgs args = *static_cast<const ProfileModeArgs*>(region.get_address());
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+namespace skb
+{
+// the fixed layout in which a child process sends the results of one run back to
+// the runner. it goes over a pipe of its own, so the benchmark can print whatever it
+// wants to stdout. the runner and the child may be different builds, so the version
+// has to be bumped whenever the layout changes
+struct RunRecord
+{
+    static constexpr uint32_t magic_value = 0x52424b53; // "SKBR"
+    static constexpr uint32_t current_version = 8;
+    static constexpr int max_counters = 32;
+
+    enum Error : int32_t
+    {
+        NoError,
+        // a worker or a fork server couldn't parse the command line that it got.
+        // it printed why, and it keeps reading commands. nothing else in the
+        // record is filled in
+        MalformedCommand
+    };
+
+    uint32_t magic = magic_value;
+    uint32_t version = current_version;
+    uint32_t size = sizeof(RunRecord);
+    int32_t num_iterations = 0;
+    int64_t argument = 0;
+    int64_t time_nanoseconds = 0;
+    uint64_t num_items_processed = 0;
+    uint64_t num_bytes_used = 0;
+    // a skb::RunTimer
+    int32_t timer = 0;
+    // this many uint32_t bucket counts of a LatencyHistogram follow the record.
+    // zero if the benchmark doesn't record latencies
+    uint32_t num_latency_buckets = 0;
+    // the untimed iterations that ran before the timed ones. zero if warmup was off
+    int64_t warmup_iterations = 0;
+    int64_t warmup_nanoseconds = 0;
+    // zero unless the benchmark used TrackAllocations
+    uint64_t peak_bytes = 0;
+    uint64_t num_allocations = 0;
+    // one for benchmarks that don't use Benchmark::SetThreads
+    int32_t num_threads = 1;
+    // a skb::RunEnvironment
+    uint32_t environment_controls = 0;
+    int64_t thread_time_nanoseconds = 0;
+    int32_t pinned_cpu = -1;
+    // a RunRecord::Error
+    int32_t error = NoError;
+    // bit i is set if counters[i] was filled in. the meaning of the slots comes
+    // from skb::RunCounter, so adding a metric doesn't change this layout
+    uint64_t counters_present = 0;
+    uint64_t counters[max_counters] = {};
+
+    bool IsValid() const
+    {
+        return magic == magic_value && version == current_version && size == sizeof(RunRecord);
+    }
+};
+static_assert(std::is_trivially_copyable_v<RunRecord>);
+}
@@ -0,0 +1,332 @@
+#include "custom_benchmark/run_scheduler.hpp"
+#include "math/halton_sequence.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace skb
+{
+
+bool RunScheduler::PriorityLess::operator()(const Priority & a, const Priority & b) const
+{
+    if (a.has_interval != b.has_interval)
+        return a.has_interval;
+    if (!a.has_interval)
+    {
+        if (a.num_runs != b.num_runs)
+            return a.num_runs > b.num_runs;
+        if (a.halton_rank != b.halton_rank)
+            return a.halton_rank > b.halton_rank;
+    }
+    else if (a.gain_per_second != b.gain_per_second)
+        return a.gain_per_second < b.gain_per_second;
+    // ties go to the first benchmark and the smallest argument
+    if (a.benchmark_order != b.benchmark_order)
+        return a.benchmark_order > b.benchmark_order;
+    return a.argument > b.argument;
+}
+
+RunScheduler::RunScheduler(size_t max_runs_per_point)
+    : max_runs_per_point(max_runs_per_point)
+{
+}
+
+void RunScheduler::SetCandidates(const std::vector<BenchmarkResults *> & benchmarks, int64_t xlimit, double target_relative_confidence)
+{
+    this->xlimit = xlimit;
+    this->target_relative_confidence = target_relative_confidence;
+    this->benchmarks = benchmarks;
+    heap.clear();
+    candidates.clear();
+    arguments.clear();
+    for (BenchmarkResults * benchmark : benchmarks)
+    {
+        Candidate & candidate = candidates[benchmark];
+        candidate.order = candidates.size() - 1;
+        candidate.generation = benchmark->GetResultsGeneration();
+        candidate.snapshot = benchmark->GetResults();
+        for (const auto & [argument, runs] : candidate.snapshot->by_argument)
+        {
+            if (InRange(argument))
+                arguments.push_back(argument);
+        }
+    }
+    std::sort(arguments.begin(), arguments.end());
+    arguments.erase(std::unique(arguments.begin(), arguments.end()), arguments.end());
+    RankArguments();
+    // only once all the snapshots are there, because the points look at the
+    // other benchmarks
+    UpdateAllPoints();
+}
+
+void RunScheduler::RankArguments()
+{
+    halton_ranks.clear();
+    for (int64_t argument : shuffle_in_halton_order(arguments))
+        halton_ranks.emplace(argument, halton_ranks.size());
+}
+void RunScheduler::UpdateAllPoints()
+{
+    for (BenchmarkResults * benchmark : benchmarks)
+    {
+        for (const auto & [argument, runs] : candidates.find(benchmark)->second.snapshot->by_argument)
+            UpdatePoint({ benchmark, argument });
+    }
+}
+
+void RunScheduler::StartRun(Point point)
+{
+    ++in_flight[point];
+    UpdatePoint(point);
+}
+void RunScheduler::FinishRun(Point point)
+{
+    auto running = in_flight.find(point);
+    CHECK_FOR_PROGRAMMER_ERROR(running != in_flight.end());
+    if (--running->second == 0)
+        in_flight.erase(running);
+    // if the run failed there is no new result to update the point
+    UpdatePoint(point);
+}
+
+std::optional<RunScheduler::Point> RunScheduler::Next()
+{
+    for (BenchmarkResults * benchmark : benchmarks)
+    {
+        if (benchmark->GetResultsGeneration() != candidates.find(benchmark)->second.generation)
+            UpdateBenchmark(benchmark);
+    }
+    if (heap.empty())
+        return std::nullopt;
+    return heap.top().key;
+}
+
+bool RunScheduler::InRange(int64_t argument) const
+{
+    // todo: why do I ever have this?
+    if (argument <= 0)
+        return false;
+    return xlimit <= 0 || argument <= xlimit;
+}
+
+void RunScheduler::UpdateBenchmark(BenchmarkResults * benchmark)
+{
+    Candidate & candidate = candidates.find(benchmark)->second;
+    std::shared_ptr<const ResultsSnapshot> previous = std::move(candidate.snapshot);
+    candidate.generation = benchmark->GetResultsGeneration();
+    candidate.snapshot = benchmark->GetResults();
+    bool new_arguments = false;
+    for (const auto & [argument, runs] : candidate.snapshot->by_argument)
+    {
+        // the snapshots share the runs of every argument that didn't change
+        auto before = previous->by_argument.find(argument);
+        if (before != previous->by_argument.end() && before->second == runs)
+            continue;
+        if (InRange(argument))
+        {
+            auto position = std::lower_bound(arguments.begin(), arguments.end(), argument);
+            if (position == arguments.end() || *position != argument)
+            {
+                arguments.insert(position, argument);
+                new_arguments = true;
+            }
+        }
+        UpdatePoint({ benchmark, argument });
+        for (BenchmarkResults * other : benchmarks)
+        {
+            if (other != benchmark && candidates.find(other)->second.snapshot->Find(argument))
+                UpdatePoint({ other, argument });
+        }
+    }
+    // a new argument moves the others around in the halton order
+    if (new_arguments)
+    {
+        RankArguments();
+        UpdateAllPoints();
+    }
+}
+
+void RunScheduler::UpdatePoint(Point point)
+{
+    auto [benchmark, argument] = point;
+    if (!InRange(argument))
+        return;
+    auto found = candidates.find(benchmark);
+    if (found == candidates.end())
+        return;
+    const Candidate & candidate = found->second;
+    const RunSamples * runs = candidate.snapshot->Find(argument);
+    if (!runs)
+        return;
+    size_t size = runs->size();
+    size_t num_running = 0;
+    auto running = in_flight.find(point);
+    if (running != in_flight.end())
+        num_running = running->second;
+    MedianConfidenceInterval interval = runs->GetMedianConfidenceInterval();
+    double width = interval.RelativeHalfWidth();
+    if (size + num_running >= max_runs_per_point || width <= target_relative_confidence)
+    {
+        heap.erase(point);
+        return;
+    }
+    Priority priority;
+    priority.benchmark_order = candidate.order;
+    priority.argument = argument;
+    priority.num_runs = size + num_running;
+    auto rank = halton_ranks.find(argument);
+    priority.halton_rank = rank == halton_ranks.end() ? halton_ranks.size() : rank->second;
+    if (!std::isinf(width))
+    {
+        priority.has_interval = true;
+        // the standard error goes down with the square root of the runs. the
+        // variance can come out slightly negative from rounding, and a NaN
+        // would break the order of the heap
+        double variance = std::max(0.0, runs->Statistics().variance);
+        double median = std::abs(interval.median);
+        double relative_deviation = median > 0.0 ? std::sqrt(variance) / median : 0.0;
+        double num_runs = static_cast<double>(size + num_running);
+        double gain = relative_deviation * (1.0 / std::sqrt(num_runs) - 1.0 / std::sqrt(num_runs + 1.0));
+        if (OverlapsOtherBenchmark(point, interval))
+            gain *= overlap_weight;
+        double seconds = benchmark->EstimateRunSeconds(argument, BenchmarkResults::default_run_time);
+        priority.gain_per_second = seconds > 0.0 ? gain / seconds : gain;
+        if (std::isnan(priority.gain_per_second))
+            priority.gain_per_second = 0.0;
+    }
+    heap.set(point, priority);
+}
+
+bool RunScheduler::OverlapsOtherBenchmark(Point point, const MedianConfidenceInterval & interval) const
+{
+    // in nanoseconds per item without the baselines, so for benchmarks with
+    // different baselines this is only a guess
+    for (BenchmarkResults * other : benchmarks)
+    {
+        if (other == point.first)
+            continue;
+        const RunSamples * runs = candidates.find(other)->second.snapshot->Find(point.second);
+        if (!runs)
+            continue;
+        MedianConfidenceInterval other_interval = runs->GetMedianConfidenceInterval();
+        if (other_interval.valid && other_interval.low <= interval.high && interval.low <= other_interval.high)
+            return true;
+    }
+    return false;
+}
+
+}
+
+#include "test/include_test.hpp"
+
+namespace
+{
+skb::RunResults MakeRun(int64_t argument, int64_t nanoseconds)
+{
+    skb::RunResults run;
+    run.num_iterations = 1;
+    run.argument = argument;
+    run.time = std::chrono::nanoseconds(nanoseconds);
+    run.num_items_processed = 0;
+    run.num_bytes_used = 0;
+    return run;
+}
+}
+
+TEST(run_scheduler, first_pass_goes_coarse_to_fine)
+{
+    skb::BenchmarkResults a(nullptr);
+    skb::BenchmarkResults b(nullptr);
+    a.AddArguments({ 1, 2, 3, 4, 5, 6, 7, 8 });
+    b.AddArguments({ 5 });
+    skb::RunScheduler scheduler(20);
+    scheduler.SetCandidates({ &a, &b }, 0, 0.01);
+    ASSERT_EQ(9u, scheduler.NumCandidates());
+    std::vector<skb::RunScheduler::Point> expected =
+    {
+        { &a, 1 }, { &a, 5 }, { &b, 5 }, { &a, 3 }, { &a, 7 }, { &a, 2 }, { &a, 6 }, { &a, 4 }, { &a, 8 },
+        // and once more in the same order
+        { &a, 1 }, { &a, 5 }, { &b, 5 },
+    };
+    for (const skb::RunScheduler::Point & point : expected)
+    {
+        ASSERT_EQ(point, scheduler.Next());
+        scheduler.StartRun(point);
+    }
+
+    // a run that failed doesn't count any more
+    scheduler.FinishRun({ &a, 3 });
+    ASSERT_EQ(skb::RunScheduler::Point(&a, 3), scheduler.Next());
+
+    scheduler.SetCandidates({ &a, &b }, 4, 0.01);
+    ASSERT_EQ(4u, scheduler.NumCandidates());
+    scheduler.SetCandidates({}, 0, 0.01);
+    ASSERT_FALSE(scheduler.Next());
+}
+
+TEST(run_scheduler, more_runs_where_intervals_overlap)
+{
+    skb::BenchmarkResults a(nullptr);
+    skb::BenchmarkResults b(nullptr);
+    skb::BenchmarkResults c(nullptr);
+    for (skb::BenchmarkResults * benchmark : { &a, &b, &c })
+        benchmark->AddArguments({ 1 });
+    skb::RunScheduler scheduler(20);
+    scheduler.SetCandidates({ &a, &b, &c }, 0, 0.01);
+    // six runs are enough for an interval. c varies the most, but a and b
+    // overlap so it's not clear yet which of those is faster
+    for (int i = 0; i < 6; ++i)
+    {
+        a.AddResult(MakeRun(1, 100 + i));
+        b.AddResult(MakeRun(1, 101 + i));
+        c.AddResult(MakeRun(1, 200 + 3 * i));
+    }
+    ASSERT_EQ(skb::RunScheduler::Point(&a, 1), scheduler.Next());
+    scheduler.SetCandidates({ &a, &c }, 0, 0.01);
+    ASSERT_EQ(skb::RunScheduler::Point(&c, 1), scheduler.Next());
+
+    // mostly the same, so that interval gets narrow enough
+    for (int i = 0; i < 30; ++i)
+        c.AddResult(MakeRun(1, 200));
+    ASSERT_EQ(skb::RunScheduler::Point(&a, 1), scheduler.Next());
+    ASSERT_EQ(1u, scheduler.NumCandidates());
+}
+
+TEST(run_scheduler, new_argument_joins_the_halton_order)
+{
+    skb::BenchmarkResults a(nullptr);
+    a.AddArguments({ 1, 2, 3, 4 });
+    skb::RunScheduler scheduler(20);
+    scheduler.SetCandidates({ &a }, 0, 0.01);
+    for (int64_t argument = 1; argument <= 5; ++argument)
+        a.AddResult(MakeRun(argument, 100));
+    // every point has one run, and 5 goes where the halton order of all five
+    // arguments puts it, not behind the four that were there at the start
+    std::vector<int64_t> expected = { 1, 5, 3, 2, 4 };
+    for (int64_t argument : expected)
+    {
+        ASSERT_EQ(skb::RunScheduler::Point(&a, argument), scheduler.Next());
+        scheduler.StartRun({ &a, argument });
+    }
+}
+
+TEST(run_scheduler, candidate_removed_while_its_run_is_in_flight)
+{
+    skb::BenchmarkResults a(nullptr);
+    skb::BenchmarkResults b(nullptr);
+    skb::BenchmarkResults baseline(nullptr);
+    a.AddArguments({ 1 });
+    b.AddArguments({ 1 });
+    baseline.AddArguments({ 1 });
+    skb::RunScheduler scheduler(20);
+    scheduler.SetCandidates({ &a, &b }, 0, 0.01);
+    scheduler.StartRun({ &b, 1 });
+    scheduler.SetCandidates({ &a }, 0, 0.01);
+    scheduler.FinishRun({ &b, 1 });
+    ASSERT_EQ(0u, scheduler.NumPointsInFlight());
+    // requested baseline runs go through the scheduler without ever being candidates
+    scheduler.StartRun({ &baseline, 1 });
+    ASSERT_EQ(1u, scheduler.NumPointsInFlight());
+    scheduler.FinishRun({ &baseline, 1 });
+    ASSERT_EQ(1u, scheduler.NumCandidates());
+    ASSERT_EQ(skb::RunScheduler::Point(&a, 1), scheduler.Next());
+}
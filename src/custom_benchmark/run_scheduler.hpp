@@ -0,0 +1,105 @@
+#pragma once
+
+#include "custom_benchmark/custom_benchmark.h"
+#include "util/indexed_heap.hpp"
+
+namespace skb
+{
+// decides which point the benchmark threads run next. points that don't have
+// enough runs for a confidence interval go first, fewest runs first, and among
+// those with equally few runs the arguments go in halton order. so the first
+// pass over a new sweep goes from coarse to fine and quickly shows the whole
+// range.
+// after that the point where one more run is expected to shrink the relative
+// standard error the most per second of cpu time, until every interval is
+// narrower than the target. points whose interval overlaps the interval of
+// another visible benchmark at the same argument count for more, because that
+// is where it's not clear yet which one is faster. runs that are still in
+// flight count as if they were done already.
+// all the candidates are kept in an indexed heap, so picking one is O(1) and a
+// new result only reorders the points at the arguments that it changed. not
+// thread safe, but other threads can add results to the candidates at any
+// time. Next picks those up by their results generation
+struct RunScheduler
+{
+    using Point = std::pair<BenchmarkResults *, int64_t>;
+
+    // how much more a run at a point with an undecided ranking is worth
+    static constexpr double overlap_weight = 4.0;
+
+    explicit RunScheduler(size_t max_runs_per_point);
+
+    // starts over with these benchmarks. for when the visible benchmarks, the x
+    // limit or the target change
+    void SetCandidates(const std::vector<BenchmarkResults *> & benchmarks, int64_t xlimit, double target_relative_confidence);
+
+    // counted as if they were done already so that two threads don't both pick
+    // the same point. the point doesn't have to be a candidate: requested
+    // baseline runs never are, and a benchmark can stop being one while it runs
+    void StartRun(Point point);
+    void FinishRun(Point point);
+
+    // nullopt once every point is done
+    std::optional<Point> Next();
+
+    size_t NumCandidates() const
+    {
+        return heap.size();
+    }
+    // the points that a benchmark thread is running right now
+    size_t NumPointsInFlight() const
+    {
+        return in_flight.size();
+    }
+
+private:
+    struct Priority
+    {
+        bool has_interval = false;
+        size_t num_runs = 0;
+        // the position of the argument in the halton order of all arguments
+        size_t halton_rank = 0;
+        // the expected shrinking of the relative standard error per second
+        double gain_per_second = 0.0;
+        // the order of the benchmark in the candidates, for ties
+        size_t benchmark_order = 0;
+        int64_t argument = 0;
+    };
+    struct PriorityLess
+    {
+        bool operator()(const Priority & a, const Priority & b) const;
+    };
+    struct PointHash
+    {
+        size_t operator()(const Point & point) const
+        {
+            return std::hash<BenchmarkResults *>()(point.first) ^ (std::hash<int64_t>()(point.second) * 0x9e3779b97f4a7c15ull);
+        }
+    };
+    struct Candidate
+    {
+        size_t order = 0;
+        // read before the snapshot, so the snapshot is at least this new
+        uint64_t generation = 0;
+        std::shared_ptr<const ResultsSnapshot> snapshot;
+    };
+
+    bool InRange(int64_t argument) const;
+    void RankArguments();
+    void UpdateAllPoints();
+    void UpdateBenchmark(BenchmarkResults * benchmark);
+    void UpdatePoint(Point point);
+    bool OverlapsOtherBenchmark(Point point, const MedianConfidenceInterval & interval) const;
+
+    size_t max_runs_per_point;
+    int64_t xlimit = 0;
+    double target_relative_confidence = 0.0;
+    std::vector<BenchmarkResults *> benchmarks;
+    ska::flat_hash_map<BenchmarkResults *, Candidate> candidates;
+    // sorted. every argument in range that any of the candidates has
+    std::vector<int64_t> arguments;
+    ska::flat_hash_map<int64_t, size_t> halton_ranks;
+    ska::flat_hash_map<Point, size_t, PointHash> in_flight;
+    indexed_dary_heap<4, Point, Priority, PriorityLess, PointHash> heap;
+};
+}
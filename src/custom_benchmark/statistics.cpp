@@ -0,0 +1,433 @@
+#include "custom_benchmark/statistics.hpp"
+#include "debug/assert.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace skb
+{
+
+double MedianConfidenceInterval::RelativeHalfWidth() const
+{
+    if (!valid)
+        return std::numeric_limits<double>::infinity();
+    double half_width = std::max(high - median, median - low);
+    if (median == 0.0)
+        return half_width == 0.0 ? 0.0 : std::numeric_limits<double>::infinity();
+    return half_width / std::abs(median);
+}
+
+// the number of values that may lie below the interval: the largest k for which
+// P(X < k) <= 2.5% when X is the number of values below the true median
+static size_t ComputeNumBelowInterval(size_t num_values)
+{
+    double n = static_cast<double>(num_values);
+    double log_half_to_the_n = n * std::log(0.5);
+    double cumulative = 0.0;
+    size_t k = 0;
+    for (; k < num_values; ++k)
+    {
+        double log_choose = std::lgamma(n + 1.0) - std::lgamma(k + 1.0) - std::lgamma(n - k + 1.0);
+        cumulative += std::exp(log_choose + log_half_to_the_n);
+        if (cumulative > 0.025)
+            break;
+    }
+    return k;
+}
+
+// the same numbers, one after the other. going from n to n + 1 values the
+// probabilities follow from P(X_n+1 = k) = (P(X_n = k) + P(X_n = k - 1)) / 2,
+// and k never goes down, so the whole table takes one pass
+static std::vector<uint32_t> TabulateNumBelowInterval(size_t max_num_values)
+{
+    std::vector<uint32_t> result(max_num_values + 1, 0);
+    // for one value: P(X <= 0) = P(X = 0) = 0.5
+    size_t k = 0;
+    double probability_k = 0.5;
+    double cumulative = 0.5;
+    for (size_t n = 1; n <= max_num_values; ++n)
+    {
+        if (n > 1)
+        {
+            double probability_k_minus_one = k == 0 ? 0.0 : probability_k * k / static_cast<double>(n - k);
+            cumulative -= 0.5 * probability_k;
+            probability_k = 0.5 * (probability_k + probability_k_minus_one);
+        }
+        while (cumulative <= 0.025)
+        {
+            probability_k *= static_cast<double>(n - k) / (k + 1);
+            ++k;
+            cumulative += probability_k;
+        }
+        result[n] = static_cast<uint32_t>(k);
+    }
+    return result;
+}
+
+static constexpr size_t num_tabulated_values = 1 << 14;
+
+size_t NumBelowMedianInterval(size_t num_values)
+{
+    static const std::vector<uint32_t> table = TabulateNumBelowInterval(num_tabulated_values);
+    if (num_values < table.size())
+        return table[num_values];
+    return ComputeNumBelowInterval(num_values);
+}
+
+MedianConfidenceInterval ComputeMedianConfidenceInterval(std::vector<double> & values)
+{
+    MedianConfidenceInterval result;
+    result.num_samples = values.size();
+    if (values.empty())
+        return result;
+    auto median = values.begin() + (values.size() - 1) / 2;
+    std::nth_element(values.begin(), median, values.end());
+    result.median = *median;
+    size_t num_below = NumBelowMedianInterval(values.size());
+    if (num_below == 0)
+        return result;
+    auto low = values.begin() + (num_below - 1);
+    auto high = values.end() - num_below;
+    std::nth_element(values.begin(), low, median);
+    std::nth_element(median + 1, high, values.end());
+    result.low = *low;
+    result.high = std::max(*high, result.median);
+    result.valid = true;
+    return result;
+}
+
+OrderStatistics::OrderStatistics(const OrderStatistics & other)
+{
+    *this = other;
+}
+OrderStatistics & OrderStatistics::operator=(const OrderStatistics & other)
+{
+    if (this == &other)
+        return *this;
+    values = other.values;
+    for (Rank * rank : { &median, &first_quartile, &third_quartile, &interval_low, &interval_high })
+        *rank = { values.begin(), 0 };
+    if (!values.empty())
+        MoveToRanks();
+    mean = other.mean;
+    sum_of_squared_differences = other.sum_of_squared_differences;
+    return *this;
+}
+
+void OrderStatistics::Insert(Value value)
+{
+    auto inserted = values.insert(value).first;
+    if (values.size() == 1)
+    {
+        for (Rank * rank : { &median, &first_quartile, &third_quartile, &interval_low, &interval_high })
+            *rank = { inserted, 0 };
+    }
+    else
+    {
+        for (Rank * rank : { &median, &first_quartile, &third_quartile, &interval_low, &interval_high })
+        {
+            if (value < *rank->it)
+                ++rank->rank;
+        }
+    }
+    double difference = value.value - mean;
+    mean += difference / values.size();
+    sum_of_squared_differences += difference * (value.value - mean);
+    MoveToRanks();
+}
+
+void OrderStatistics::Erase(Value value)
+{
+    auto found = values.find(value);
+    CHECK_FOR_PROGRAMMER_ERROR(found != values.end());
+    if (values.size() == 1)
+    {
+        Clear();
+        return;
+    }
+    for (Rank * rank : { &median, &first_quartile, &third_quartile, &interval_low, &interval_high })
+    {
+        if (rank->it == found)
+        {
+            // the next value takes over this rank. at the end, the previous one
+            // does but its rank is one lower
+            if (std::next(found) != values.end())
+                ++rank->it;
+            else
+            {
+                --rank->it;
+                --rank->rank;
+            }
+        }
+        else if (value < *rank->it)
+            --rank->rank;
+    }
+    values.erase(found);
+    double size = static_cast<double>(values.size());
+    double new_mean = mean + (mean - value.value) / size;
+    sum_of_squared_differences = std::max(0.0, sum_of_squared_differences - (value.value - mean) * (value.value - new_mean));
+    mean = new_mean;
+    MoveToRanks();
+}
+
+void OrderStatistics::Clear()
+{
+    values.clear();
+    median = first_quartile = third_quartile = interval_low = interval_high = Rank();
+    mean = 0.0;
+    sum_of_squared_differences = 0.0;
+}
+
+void OrderStatistics::MoveToRanks()
+{
+    size_t size = values.size();
+    size_t quarter = size / 4;
+    size_t num_below = NumBelowMedianInterval(size);
+    auto move_to = [](Rank & rank, size_t target)
+    {
+        for (; rank.rank < target; ++rank.rank)
+            ++rank.it;
+        for (; rank.rank > target; --rank.rank)
+            --rank.it;
+    };
+    // the same ranks as ComputeMedianConfidenceInterval and the error bars
+    move_to(median, (size - 1) / 2);
+    move_to(first_quartile, quarter);
+    move_to(third_quartile, size - std::max(size_t(1), quarter));
+    move_to(interval_low, num_below == 0 ? 0 : num_below - 1);
+    move_to(interval_high, size - std::max(size_t(1), num_below));
+}
+
+MedianConfidenceInterval OrderStatistics::GetMedianConfidenceInterval() const
+{
+    MedianConfidenceInterval result;
+    result.num_samples = values.size();
+    if (values.empty())
+        return result;
+    result.median = median.it->value;
+    if (NumBelowMedianInterval(values.size()) == 0)
+        return result;
+    result.low = interval_low.it->value;
+    result.high = std::max(interval_high.it->value, result.median);
+    result.valid = true;
+    return result;
+}
+
+OrderStatisticsSummary OrderStatistics::Summary() const
+{
+    OrderStatisticsSummary result;
+    result.median_interval = GetMedianConfidenceInterval();
+    if (values.empty())
+        return result;
+    result.median = Median();
+    result.first_quartile = FirstQuartile();
+    result.third_quartile = ThirdQuartile();
+    result.mean = Mean();
+    result.variance = Variance();
+    return result;
+}
+
+std::vector<OrderStatistics::Value> OrderStatistics::Middle(size_t count) const
+{
+    std::vector<Value> result;
+    if (count >= values.size())
+    {
+        result.assign(values.begin(), values.end());
+        return result;
+    }
+    auto it = median.it;
+    for (size_t rank = median.rank, first = (values.size() - count) / 2; rank > first; --rank)
+        --it;
+    result.reserve(count);
+    for (; result.size() < count; ++it)
+        result.push_back(*it);
+    return result;
+}
+
+MannWhitneyResult MannWhitneyUTest(const std::vector<double> & a, const std::vector<double> & b)
+{
+    MannWhitneyResult result;
+    if (a.empty() || b.empty())
+        return result;
+    struct Value
+    {
+        double value;
+        bool from_a;
+    };
+    std::vector<Value> combined;
+    combined.reserve(a.size() + b.size());
+    for (double value : a)
+        combined.push_back({ value, true });
+    for (double value : b)
+        combined.push_back({ value, false });
+    std::sort(combined.begin(), combined.end(), [](const Value & l, const Value & r)
+    {
+        return l.value < r.value;
+    });
+    double rank_sum_a = 0.0;
+    double tie_correction = 0.0;
+    for (size_t i = 0; i < combined.size();)
+    {
+        size_t tie_end = i + 1;
+        while (tie_end < combined.size() && combined[tie_end].value == combined[i].value)
+            ++tie_end;
+        // ranks start at 1, tied values all get the average of their ranks
+        double rank = (i + 1 + tie_end) / 2.0;
+        for (size_t j = i; j < tie_end; ++j)
+        {
+            if (combined[j].from_a)
+                rank_sum_a += rank;
+        }
+        double num_tied = static_cast<double>(tie_end - i);
+        tie_correction += num_tied * num_tied * num_tied - num_tied;
+        i = tie_end;
+    }
+    double n_a = static_cast<double>(a.size());
+    double n_b = static_cast<double>(b.size());
+    double n = n_a + n_b;
+    result.u = rank_sum_a - n_a * (n_a + 1.0) / 2.0;
+    double mean = n_a * n_b / 2.0;
+    result.rank_biserial = 1.0 - result.u / mean;
+    double variance = n_a * n_b / 12.0 * ((n + 1.0) - tie_correction / (n * (n - 1.0)));
+    if (variance <= 0.0)
+        return result;
+    double distance = std::max(0.0, std::abs(result.u - mean) - 0.5);
+    result.p_value = std::erfc(distance / std::sqrt(2.0 * variance));
+    return result;
+}
+
+std::vector<double> HolmAdjustedPValues(const std::vector<double> & p_values)
+{
+    std::vector<size_t> order(p_values.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t l, size_t r)
+    {
+        return p_values[l] < p_values[r];
+    });
+    std::vector<double> result(p_values.size());
+    double running_max = 0.0;
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        double adjusted = std::min(1.0, p_values[order[i]] * (order.size() - i));
+        running_max = std::max(running_max, adjusted);
+        result[order[i]] = running_max;
+    }
+    return result;
+}
+
+}
+
+#include "test/include_test.hpp"
+
+TEST(statistics, median_confidence_interval)
+{
+    std::vector<double> values = { 5.0, 1.0, 4.0, 2.0, 3.0 };
+    skb::MedianConfidenceInterval too_few = skb::ComputeMedianConfidenceInterval(values);
+    ASSERT_FALSE(too_few.valid);
+    ASSERT_EQ(3.0, too_few.median);
+    ASSERT_TRUE(std::isinf(too_few.RelativeHalfWidth()));
+
+    values = { 6.0, 5.0, 1.0, 4.0, 2.0, 3.0 };
+    skb::MedianConfidenceInterval six = skb::ComputeMedianConfidenceInterval(values);
+    ASSERT_TRUE(six.valid);
+    ASSERT_EQ(1.0, six.low);
+    ASSERT_EQ(6.0, six.high);
+
+    // for 100 values the interval goes from the 40th to the 61st value
+    values.clear();
+    for (int i = 100; i > 0; --i)
+        values.push_back(i);
+    skb::MedianConfidenceInterval hundred = skb::ComputeMedianConfidenceInterval(values);
+    ASSERT_EQ(50.0, hundred.median);
+    ASSERT_EQ(40.0, hundred.low);
+    ASSERT_EQ(61.0, hundred.high);
+    ASSERT_DOUBLE_EQ(11.0 / 50.0, hundred.RelativeHalfWidth());
+}
+
+TEST(statistics, mann_whitney)
+{
+    std::vector<double> a = { 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0, 8.0 };
+    std::vector<double> b = { 11.0, 12.0, 13.0, 14.0, 15.0, 16.0, 17.0, 18.0 };
+    skb::MannWhitneyResult separate = skb::MannWhitneyUTest(a, b);
+    ASSERT_EQ(0.0, separate.u);
+    ASSERT_EQ(1.0, separate.rank_biserial);
+    // the exact p-value is 2/12870
+    ASSERT_GT(0.001, separate.p_value);
+    skb::MannWhitneyResult reversed = skb::MannWhitneyUTest(b, a);
+    ASSERT_EQ(-1.0, reversed.rank_biserial);
+    ASSERT_DOUBLE_EQ(separate.p_value, reversed.p_value);
+
+    skb::MannWhitneyResult same = skb::MannWhitneyUTest(a, a);
+    ASSERT_EQ(0.0, same.rank_biserial);
+    ASSERT_EQ(1.0, same.p_value);
+
+    std::vector<double> all_tied(8, 1.0);
+    ASSERT_EQ(1.0, skb::MannWhitneyUTest(all_tied, all_tied).p_value);
+}
+
+TEST(statistics, holm)
+{
+    std::vector<double> adjusted = skb::HolmAdjustedPValues({ 0.04, 0.01, 0.03, 0.5 });
+    ASSERT_DOUBLE_EQ(0.09, adjusted[0]);
+    ASSERT_DOUBLE_EQ(0.04, adjusted[1]);
+    ASSERT_DOUBLE_EQ(0.09, adjusted[2]);
+    ASSERT_DOUBLE_EQ(0.5, adjusted[3]);
+}
+
+TEST(statistics, tabulated_interval_ranks)
+{
+    for (size_t n = 0; n < 1000; ++n)
+        ASSERT_EQ(skb::ComputeNumBelowInterval(n), skb::NumBelowMedianInterval(n)) << n;
+}
+
+TEST(statistics, order_statistics_follow_inserts_and_erases)
+{
+    // ties on purpose, and values leave again in a different order than they
+    // came in, like the oldest runs making room for new ones
+    skb::OrderStatistics statistics;
+    std::vector<skb::OrderStatistics::Value> inserted;
+    for (uint64_t id = 0; id < 300; ++id)
+    {
+        skb::OrderStatistics::Value value{ static_cast<double>((id * 37) % 50), id };
+        statistics.Insert(value);
+        inserted.push_back(value);
+        if (id % 3 == 2)
+        {
+            statistics.Erase(inserted.front());
+            inserted.erase(inserted.begin());
+        }
+        std::vector<double> values;
+        for (const skb::OrderStatistics::Value & v : inserted)
+            values.push_back(v.value);
+        std::sort(values.begin(), values.end());
+        size_t quarter = values.size() / 4;
+        ASSERT_EQ(values.size(), statistics.size());
+        ASSERT_EQ(values[(values.size() - 1) / 2], statistics.Median().value);
+        ASSERT_EQ(values[quarter], statistics.FirstQuartile());
+        ASSERT_EQ(values[values.size() - std::max(size_t(1), quarter)], statistics.ThirdQuartile());
+        double mean = 0.0;
+        for (double v : values)
+            mean += v;
+        mean /= values.size();
+        double variance = 0.0;
+        for (double v : values)
+            variance += (v - mean) * (v - mean);
+        variance /= values.size();
+        ASSERT_NEAR(mean, statistics.Mean(), 1e-9);
+        ASSERT_NEAR(variance, statistics.Variance(), 1e-6);
+        skb::MedianConfidenceInterval expected = skb::ComputeMedianConfidenceInterval(values);
+        skb::MedianConfidenceInterval interval = statistics.GetMedianConfidenceInterval();
+        ASSERT_EQ(expected.valid, interval.valid);
+        ASSERT_EQ(expected.median, interval.median);
+        ASSERT_EQ(expected.low, interval.low);
+        ASSERT_EQ(expected.high, interval.high);
+    }
+    while (!inserted.empty())
+    {
+        statistics.Erase(inserted.back());
+        inserted.pop_back();
+    }
+    ASSERT_TRUE(statistics.empty());
+    ASSERT_FALSE(statistics.GetMedianConfidenceInterval().valid);
+}
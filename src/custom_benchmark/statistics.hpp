@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <set>
+#include <vector>
+
+namespace skb
+{
+// a 95% confidence interval for the median that doesn't assume a distribution.
+// the ranks of the two ends come from the binomial distribution with p = 0.5,
+// so it works just as well for the skewed timings that benchmarks produce
+struct MedianConfidenceInterval
+{
+    double median = 0.0;
+    double low = 0.0;
+    double high = 0.0;
+    size_t num_samples = 0;
+    // fewer than six samples are never enough for a 95% interval
+    bool valid = false;
+
+    // the larger of the two distances from the median to an end, relative to the
+    // median. infinite if there is no interval yet
+    double RelativeHalfWidth() const;
+};
+
+// reorders the values
+MedianConfidenceInterval ComputeMedianConfidenceInterval(std::vector<double> & values);
+// the number of values that may lie below the interval, and as many lie above
+// it. zero if there are too few values for an interval. looked up in a table
+// for anything up to a few thousand values
+size_t NumBelowMedianInterval(size_t num_values);
+
+// the median, the quartiles, the ends of the 95% interval for the median, the
+// mean and the variance of a set of values that changes one value at a time.
+// the values are kept in a sorted tree, and each of the order statistics is an
+// iterator into it that moves a step or two after every insert or erase, so
+// changes are O(log n) and all the statistics can be read in O(1). every value
+// comes with an id to find the thing it was measured from, and to tell equal
+// values apart
+struct OrderStatisticsSummary;
+
+struct OrderStatistics
+{
+    struct Value
+    {
+        double value = 0.0;
+        uint64_t id = 0;
+
+        bool operator<(const Value & other) const
+        {
+            if (value != other.value)
+                return value < other.value;
+            return id < other.id;
+        }
+    };
+
+    OrderStatistics() = default;
+    // the copy gets its own iterators
+    OrderStatistics(const OrderStatistics & other);
+    OrderStatistics & operator=(const OrderStatistics & other);
+
+    void Insert(Value value);
+    // the value has to have been inserted with the same id
+    void Erase(Value value);
+    void Clear();
+
+    size_t size() const
+    {
+        return values.size();
+    }
+    bool empty() const
+    {
+        return values.empty();
+    }
+    // the sorted values
+    std::set<Value>::const_iterator begin() const
+    {
+        return values.begin();
+    }
+    std::set<Value>::const_iterator end() const
+    {
+        return values.end();
+    }
+
+    // the lower one for an even number of values. none of these may be called
+    // while it's empty
+    const Value & Median() const
+    {
+        return *median.it;
+    }
+    double FirstQuartile() const
+    {
+        return first_quartile.it->value;
+    }
+    double ThirdQuartile() const
+    {
+        return third_quartile.it->value;
+    }
+    double Mean() const
+    {
+        return mean;
+    }
+    // of the values themselves, not of the mean, so divided by n
+    double Variance() const
+    {
+        return values.empty() ? 0.0 : sum_of_squared_differences / values.size();
+    }
+    // the same as ComputeMedianConfidenceInterval of all the values
+    MedianConfidenceInterval GetMedianConfidenceInterval() const;
+    // all of the above as plain values, for readers that don't get the tree
+    OrderStatisticsSummary Summary() const;
+    // the [count] values in the middle in sorted order, or all of them if there
+    // aren't more than that. O(count), it starts at the median
+    std::vector<Value> Middle(size_t count) const;
+
+private:
+    struct Rank
+    {
+        std::set<Value>::const_iterator it;
+        size_t rank = 0;
+    };
+    // the ranks that the iterators should be at for the current size
+    void MoveToRanks();
+
+    std::set<Value> values;
+    Rank median;
+    Rank first_quartile;
+    Rank third_quartile;
+    Rank interval_low;
+    Rank interval_high;
+    // Welford's running mean, which can also take values out again
+    double mean = 0.0;
+    double sum_of_squared_differences = 0.0;
+};
+
+// the order statistics of one moment. small and cheap to copy, so every
+// version of a set of runs can have its own. empty values if there were none
+struct OrderStatisticsSummary
+{
+    OrderStatistics::Value median;
+    double first_quartile = 0.0;
+    double third_quartile = 0.0;
+    double mean = 0.0;
+    double variance = 0.0;
+    MedianConfidenceInterval median_interval;
+};
+
+struct MannWhitneyResult
+{
+    double u = 0.0;
+    // two-sided, from the normal approximation with a correction for ties. that
+    // is accurate enough once both sides have about six values
+    double p_value = 1.0;
+    // the probability that a value from b is larger than one from a, minus the
+    // probability that it's smaller. between -1 and 1, 0 means no shift
+    double rank_biserial = 0.0;
+};
+MannWhitneyResult MannWhitneyUTest(const std::vector<double> & a, const std::vector<double> & b);
+
+// Holm's step-down correction: controls the chance of even a single false
+// positive across all the tests without assuming that they are independent
+std::vector<double> HolmAdjustedPValues(const std::vector<double> & p_values);
+}
@@ -0,0 +1,65 @@
+#include "custom_benchmark/utils.hpp"
+#include "memory/metrics.hpp"
+
+TrackAllocations::TrackAllocations(skb::State & state)
+    : state(state)
+    , num_bytes_allocated_before(memory_metrics::total_allocated.load(std::memory_order_relaxed))
+    , num_bytes_freed_before(memory_metrics::total_freed.load(std::memory_order_relaxed))
+    , num_allocations_before(memory_metrics::allocations.load(std::memory_order_relaxed))
+    , live_bytes_before(memory_metrics::LiveBytes())
+{
+    if (state.thread_index() == 0)
+        memory_metrics::ResetPeakLiveBytes();
+}
+TrackAllocations::~TrackAllocations()
+{
+    if (state.thread_index() != 0)
+        return;
+    size_t allocated = memory_metrics::total_allocated.load(std::memory_order_relaxed) - num_bytes_allocated_before;
+    size_t freed = memory_metrics::total_freed.load(std::memory_order_relaxed) - num_bytes_freed_before;
+    state.SetNumBytes(allocated, freed);
+    size_t peak = memory_metrics::peak_live_bytes.load(std::memory_order_relaxed);
+    state.SetPeakBytes(peak > live_bytes_before ? peak - live_bytes_before : 0);
+    state.SetNumAllocations(memory_metrics::allocations.load(std::memory_order_relaxed) - num_allocations_before);
+}
+
+#include "test/include_test.hpp"
+
+#if !defined(ADDRESS_SANITIZER_BUILD)
+TEST(track_allocations, peak_and_freed_bytes)
+{
+    skb::State state(1, 0);
+    {
+        TrackAllocations track(state);
+        std::vector<std::unique_ptr<char[]>> memory;
+        for (int i = 0; i < 4; ++i)
+            memory.emplace_back(new char[1000]);
+        memory.clear();
+        memory.shrink_to_fit();
+        std::unique_ptr<char[]> smaller(new char[100]);
+        // otherwise the compiler is allowed to leave out the allocation
+        smaller[0] = 1;
+        skb::DoNotOptimize(smaller[0]);
+    }
+    ASSERT_LE(4000u, state.GetPeakBytes());
+    ASSERT_GT(5000u, state.GetPeakBytes());
+    // four arrays, the one smaller array and at least one for the vector
+    ASSERT_LE(6u, state.GetNumAllocations());
+    ASSERT_EQ(0u, state.GetNumBytesUsed());
+    ASSERT_LE(4100u, state.GetNumBytesAllocated());
+}
+TEST(track_allocations, only_the_first_thread_measures)
+{
+    skb::State state(1, 0);
+    state.SetThread(1, 2, nullptr);
+    {
+        TrackAllocations track(state);
+        std::unique_ptr<char[]> memory(new char[1000]);
+        memory[0] = 1;
+        skb::DoNotOptimize(memory[0]);
+    }
+    ASSERT_EQ(0u, state.GetPeakBytes());
+    ASSERT_EQ(0u, state.GetNumAllocations());
+    ASSERT_EQ(0u, state.GetNumBytesAllocated());
+}
+#endif
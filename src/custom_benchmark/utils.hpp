@@ -60,6 +60,12 @@ struct hashtable_benchmark_base
     float max_load_factor = 0.0f;
 };
 
+// counts everything that goes through operator new while this is alive and
+// passes it to the state when it goes out of scope. create it before the
+// container that's being measured so that the container's memory is freed
+// within the scope. the peak is global, so these can't be nested. for the same
+// reason only the first thread of a benchmark with several threads measures,
+// and its numbers include the allocations of the other threads
 struct TrackAllocations
 {
     TrackAllocations(skb::State & state);
@@ -68,6 +74,8 @@ struct TrackAllocations
     skb::State & state;
     size_t num_bytes_allocated_before;
     size_t num_bytes_freed_before;
+    size_t num_allocations_before;
+    size_t live_bytes_before;
 };
 
 template<typename T>
@@ -1,53 +1,335 @@
 #include "db/benchmark_db.hpp"
 #include "debug/assert.hpp"
+#include <ctime>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+// one column per skb::RunCounter, in the same order. NULL if the counter wasn't collected
+static constexpr const char * counter_columns[skb::NumRunCounters] =
+{
+    "cycles",
+    "instructions",
+    "l1d_misses",
+    "llc_misses",
+    "branch_misses",
+    "dtlb_misses",
+};
+
+static std::string HostName()
+{
+    char name[256] = {};
+    if (gethostname(name, sizeof(name) - 1) != 0)
+        return "unknown";
+    return name;
+}
+static std::string OperatingSystem()
+{
+    utsname system;
+    if (uname(&system) != 0)
+        return "unknown";
+    std::string result = system.sysname;
+    result += ' ';
+    result += system.release;
+    result += ' ';
+    result += system.machine;
+    return result;
+}
+// the size and the modification time of the executable. changes with every
+// build, and doesn't need to read the whole file
+static std::string BuildId(std::string_view executable)
+{
+    struct stat file_info;
+    if (stat(std::string(executable).c_str(), &file_info) != 0)
+        return "unknown";
+    return std::to_string(file_info.st_size) + '-' + std::to_string(file_info.st_mtim.tv_sec);
+}
+
+// the version of the tables in the "versions" table. 0 kept all the runs in one
+// "results" table that could only be searched by benchmark. 1 identified a
+// benchmark by its categories alone, so it depended on the build category
+static constexpr const char * schema_version_type = "benchmark_schema";
+static constexpr int schema_version = 2;
+
+// a benchmark is identified by the executable that it is in and its categories.
+// the categories alone aren't enough for executables with the same name in
+// different build directories
+static constexpr const char * benchmarks_columns =
+    "(id INTEGER PRIMARY KEY AUTOINCREMENT, "
+     "filename TEXT NOT NULL, "
+     "categories TEXT, "
+     "UNIQUE (filename, categories))";
+
+// LoadAllBenchmarks only adds the build category if an executable with the same
+// name was loaded before, so it depends on the order in which they were loaded.
+// the filename already tells the builds apart, so the database leaves it out
+static skb::BenchmarkCategories StoredCategories(const skb::BenchmarkCategories & categories)
+{
+    return categories.WithoutCategory(skb::BuildIndex());
+}
+
+// the columns of the samples table after the key, in the order that load_result
+// reads them. the counters follow
+static constexpr const char * sample_columns = "num_iterations, argument, time, num_items_processed, num_bytes_used, num_parallel_runs, placement, timer, warmup_iterations, warmup_time, latencies, peak_bytes, num_allocations, num_threads, thread_time, environment, pinned_cpu, block";
 
 BenchmarkDB::BenchmarkDB(const char * filename)
     : db(filename)
 {
-    db.prepare_and_run("CREATE TABLE IF NOT EXISTS benchmarks "
+    // so that the results can be written while the program runs: readers don't
+    // block the writer, and a commit doesn't have to wait for the disk
+    {
+        SqLiteStatement journal_mode = db.prepare("PRAGMA journal_mode=WAL");
+        journal_mode.step();
+    }
+    db.prepare_and_run("PRAGMA synchronous=NORMAL");
+
+    std::string counter_names;
+    std::string counter_parameters;
+    std::string counter_definitions;
+    for (int i = 0; i < skb::NumRunCounters; ++i)
+    {
+        counter_names += ", ";
+        counter_names += counter_columns[i];
+        counter_parameters += ", ?";
+        counter_parameters += std::to_string(first_counter_parameter + i);
+        counter_definitions += counter_columns[i];
+        counter_definitions += " INTEGER, ";
+    }
+
+    // the gui and the result writer both open the database at startup, and only
+    // one of them may migrate it
+    BeginTransaction();
+    db.prepare_and_run(std::string("CREATE TABLE IF NOT EXISTS benchmarks ") + benchmarks_columns);
+    // the same categories as benchmarks.categories, one row per category, so
+    // that they can be searched without taking the string apart
+    db.prepare_and_run("CREATE TABLE IF NOT EXISTS benchmark_categories "
+                       "(benchmark INTEGER NOT NULL, "
+                        "category TEXT NOT NULL, "
+                        "value TEXT NOT NULL, "
+                        "PRIMARY KEY (benchmark, category)) WITHOUT ROWID");
+    // one row per executable per session of the program
+    db.prepare_and_run("CREATE TABLE IF NOT EXISTS runs "
                        "(id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                        "host TEXT NOT NULL, "
                         "filename TEXT NOT NULL, "
-                        "categories TEXT UNIQUE)");
-    db.prepare_and_run("CREATE TABLE IF NOT EXISTS results "
-                       "(benchmark INTEGER, "
-                        "num_iterations INTEGER, "
-                        "argument INTEGER, "
-                        "time INTEGER, "
-                        "num_items_processed INTEGER, "
-                        "num_bytes_used INTEGER)");
-    db.prepare_and_run("CREATE INDEX IF NOT EXISTS results_benchmark_index "
-                       "ON results (benchmark)");
-    db.prepare_and_run("CREATE INDEX IF NOT EXISTS benchmark_categories_index "
-                       "ON benchmarks (categories)");
-    db.prepare_and_run("CREATE INDEX IF NOT EXISTS benchmark_filename_index "
-                       "ON benchmarks (filename)");
+                        "compiler TEXT NOT NULL, "
+                        "build_id TEXT NOT NULL, "
+                        "environment TEXT NOT NULL, "
+                        "started INTEGER NOT NULL)");
+    // clustered by benchmark and argument, so that loading one benchmark, or
+    // one benchmark at one argument, reads one range of the table. run is NULL
+    // for samples from before runs were recorded
+    db.prepare_and_run("CREATE TABLE IF NOT EXISTS samples "
+                       "(benchmark INTEGER NOT NULL, "
+                        "argument INTEGER NOT NULL, "
+                        "id INTEGER NOT NULL, "
+                        "run INTEGER, "
+                        "num_iterations INTEGER NOT NULL, "
+                        "time INTEGER NOT NULL, "
+                        "num_items_processed INTEGER NOT NULL, "
+                        "num_bytes_used INTEGER NOT NULL, "
+                        "num_parallel_runs INTEGER NOT NULL DEFAULT 1, "
+                        "placement INTEGER NOT NULL DEFAULT 0, "
+                        "timer INTEGER NOT NULL DEFAULT 0, "
+                        "warmup_iterations INTEGER NOT NULL DEFAULT 0, "
+                        "warmup_time INTEGER NOT NULL DEFAULT 0, "
+                        // a serialized skb::LatencyHistogram, NULL for benchmarks that don't record latencies
+                        "latencies BLOB, "
+                        "peak_bytes INTEGER NOT NULL DEFAULT 0, "
+                        "num_allocations INTEGER NOT NULL DEFAULT 0, "
+                        "num_threads INTEGER NOT NULL DEFAULT 1, "
+                        "thread_time INTEGER NOT NULL DEFAULT 0, "
+                        // the controls of a skb::RunEnvironment
+                        "environment INTEGER NOT NULL DEFAULT 0, "
+                        "pinned_cpu INTEGER NOT NULL DEFAULT -1, "
+                        "block INTEGER NOT NULL DEFAULT 0, "
+                        + counter_definitions +
+                        "PRIMARY KEY (benchmark, argument, id)) WITHOUT ROWID");
+    // for counters that were added after the table was first created
+    for (const char * column : counter_columns)
+        AddColumnIfMissing("samples", column, "INTEGER");
+    db.prepare_and_run("CREATE INDEX IF NOT EXISTS benchmark_category_value_index "
+                       "ON benchmark_categories (category, value, benchmark)");
+    db.prepare_and_run("CREATE INDEX IF NOT EXISTS samples_run_index "
+                       "ON samples (run)");
     db.prepare_and_run("CREATE TABLE IF NOT EXISTS checkbox_state "
                        "(category TEXT, "
                         "checkbox TEXT, "
                         "checked INTEGER)");
-    
-    load_result = db.prepare("SELECT num_iterations, argument, time, num_items_processed, num_bytes_used FROM results WHERE benchmark = ?1");
-    get_benchmark_id = db.prepare("SELECT id FROM benchmarks WHERE categories = ?1");
-    insert_benchmark = db.prepare("INSERT INTO benchmarks (filename, categories) VALUES (?1, ?2)");
-    add_result = db.prepare("INSERT INTO results (benchmark, num_iterations, argument, time, num_items_processed, num_bytes_used) VALUES(?1, ?2, ?3, ?4, ?5, ?6)");
-    delete_results = db.prepare(
-        "DELETE FROM results "
-        "WHERE benchmark IN ( "
+    if (db.GetVersion(schema_version_type) < 1)
+        MigrateResultsToSamples(counter_names);
+    if (db.GetVersion(schema_version_type) < 2)
+        MigrateBenchmarksToFilenameAndCategories();
+    db.SetVersion(schema_version_type, schema_version);
+    EndTransaction();
+
+    load_result = db.prepare(std::string("SELECT ") + sample_columns + counter_names + " FROM samples WHERE benchmark = ?1");
+    get_benchmark_id = db.prepare("SELECT id FROM benchmarks WHERE filename = ?1 AND categories = ?2");
+    insert_benchmark = db.prepare("INSERT OR IGNORE INTO benchmarks (filename, categories) VALUES (?1, ?2)");
+    insert_benchmark_category = db.prepare("INSERT OR IGNORE INTO benchmark_categories (benchmark, category, value) VALUES (?1, ?2, ?3)");
+    has_benchmark_categories = db.prepare("SELECT 1 FROM benchmark_categories WHERE benchmark = ?1 LIMIT 1");
+    insert_run = db.prepare("INSERT INTO runs (host, filename, compiler, build_id, environment, started) VALUES (?1, ?2, ?3, ?4, ?5, ?6)");
+    // the ids go up by one per benchmark and argument. finding the last one is a
+    // seek to the end of that range
+    add_result = db.prepare(std::string("INSERT INTO samples (benchmark, id, run, ") + sample_columns + counter_names + ") "
+                            "VALUES(?1, (SELECT ifnull(max(id), 0) + 1 FROM samples WHERE benchmark = ?1 AND argument = ?3), ?" + std::to_string(run_parameter) + ", "
+                            "?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13, ?14, ?15, ?16, ?17, ?18, ?19" + counter_parameters + ")");
+    delete_results = db.prepare("DELETE FROM samples WHERE benchmark = ?1");
+    // the same as skb::RunResults::GetNanosecondsPerItem
+    trim_results = db.prepare(
+        "DELETE FROM samples "
+        "WHERE benchmark = ?1 AND argument = ?2 AND id IN ( "
         "   SELECT id "
-        "   FROM benchmarks "
-        "   WHERE filename = ?1 "
+        "   FROM samples "
+        "   WHERE benchmark = ?1 AND argument = ?2 "
+        "   ORDER BY abs(CAST(time AS REAL) / CASE WHEN num_items_processed > 0 THEN num_items_processed ELSE num_iterations * num_threads END - ?3) "
+        "   LIMIT -1 OFFSET ?4 "
         ")");
-    delete_benchmarks = db.prepare("DELETE FROM benchmarks WHERE filename = ?1");
     read_checkbox = db.prepare("SELECT category, checkbox, checked FROM checkbox_state");
     add_checkbox_state = db.prepare("INSERT INTO checkbox_state (category, checkbox, checked) VALUES(?1, ?2, ?3)");
 }
 
-BenchmarkDB::~BenchmarkDB() {
-    db.prepare_and_run("VACUUM");
+void BenchmarkDB::MigrateResultsToSamples(const std::string & counter_names) {
+    {
+        SqLiteStatement results_table = db.prepare("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'results'");
+        if (!results_table.step())
+            return;
+    }
+    // older versions of the table may not have all the columns yet
+    AddColumnIfMissing("results", "num_parallel_runs", "INTEGER NOT NULL DEFAULT 1");
+    AddColumnIfMissing("results", "placement", "INTEGER NOT NULL DEFAULT 0");
+    AddColumnIfMissing("results", "timer", "INTEGER NOT NULL DEFAULT 0");
+    AddColumnIfMissing("results", "warmup_iterations", "INTEGER NOT NULL DEFAULT 0");
+    AddColumnIfMissing("results", "warmup_time", "INTEGER NOT NULL DEFAULT 0");
+    AddColumnIfMissing("results", "latencies", "BLOB");
+    AddColumnIfMissing("results", "peak_bytes", "INTEGER NOT NULL DEFAULT 0");
+    AddColumnIfMissing("results", "num_allocations", "INTEGER NOT NULL DEFAULT 0");
+    AddColumnIfMissing("results", "num_threads", "INTEGER NOT NULL DEFAULT 1");
+    AddColumnIfMissing("results", "thread_time", "INTEGER NOT NULL DEFAULT 0");
+    AddColumnIfMissing("results", "environment", "INTEGER NOT NULL DEFAULT 0");
+    AddColumnIfMissing("results", "pinned_cpu", "INTEGER NOT NULL DEFAULT -1");
+    AddColumnIfMissing("results", "block", "INTEGER NOT NULL DEFAULT 0");
+    for (const char * column : counter_columns)
+        AddColumnIfMissing("results", column, "INTEGER");
+    // the rowids are unique, so they work as ids. the old categories strings
+    // don't have the names of the categories, so benchmark_categories gets
+    // filled in when a benchmark gets loaded or written again
+    std::string columns = sample_columns + counter_names;
+    db.prepare_and_run("INSERT INTO samples (benchmark, id, run, " + columns + ") "
+                       "SELECT benchmark, rowid, NULL, " + columns + " FROM results");
+    db.prepare_and_run("DROP TABLE results");
+    // the unique constraint on benchmarks.categories has an index already
+    db.prepare_and_run("DROP INDEX IF EXISTS benchmark_categories_index");
+}
+
+void BenchmarkDB::MigrateBenchmarksToFilenameAndCategories() {
+    // sqlite can't drop the unique constraint on categories, so the table has
+    // to be copied. the filename index is dropped with the old table, the new
+    // constraint covers lookups by filename
+    db.prepare_and_run(std::string("CREATE TABLE benchmarks_by_filename ") + benchmarks_columns);
+    db.prepare_and_run("INSERT INTO benchmarks_by_filename (id, filename, categories) SELECT id, filename, categories FROM benchmarks");
+    db.prepare_and_run("DROP TABLE benchmarks");
+    db.prepare_and_run("ALTER TABLE benchmarks_by_filename RENAME TO benchmarks");
+
+    // benchmarks that were stored with the build category get the same
+    // categories as when they are loaded without it. benchmarks that were
+    // migrated from version 0 don't have their categories in
+    // benchmark_categories, but version 0 didn't have the build category either
+    std::vector<int> with_build;
+    {
+        SqLiteStatement find_builds = db.prepare("SELECT benchmark FROM benchmark_categories WHERE category = ?1");
+        find_builds.bind(1, skb::BuildIndex().view());
+        while (find_builds.step())
+            with_build.push_back(find_builds.GetInt(0));
+    }
+    SqLiteStatement read_categories = db.prepare("SELECT category, value FROM benchmark_categories WHERE benchmark = ?1");
+    SqLiteStatement read_filename = db.prepare("SELECT filename FROM benchmarks WHERE id = ?1");
+    SqLiteStatement max_sample_id = db.prepare("SELECT ifnull(max(id), 0) FROM samples WHERE benchmark = ?1");
+    // get_benchmark_id isn't prepared yet while the tables get migrated
+    SqLiteStatement find_benchmark = db.prepare("SELECT id FROM benchmarks WHERE filename = ?1 AND categories = ?2");
+    for (int benchmark_id : with_build)
+    {
+        ska::flat_hash_map<interned_string, interned_string> by_category;
+        read_categories.bind(1, benchmark_id);
+        while (read_categories.step())
+            by_category.emplace(interned_string(read_categories.GetString(0)), interned_string(read_categories.GetString(1)));
+        read_categories.reset();
+        skb::BenchmarkCategories categories(by_category[skb::BenchmarkCategories::TypeIndex()], by_category[skb::BenchmarkCategories::NameIndex()]);
+        for (const auto & [category, value] : by_category)
+        {
+            if (category != skb::BenchmarkCategories::TypeIndex() && category != skb::BenchmarkCategories::NameIndex() && category != skb::BuildIndex())
+                categories.AddCategory(category, value);
+        }
+        read_filename.bind(1, benchmark_id);
+        RAW_VERIFY(read_filename.step());
+        std::string filename = read_filename.GetString(0);
+        read_filename.reset();
+
+        std::string categories_string = categories.CategoriesString();
+        find_benchmark.bind(1, filename);
+        find_benchmark.bind(2, categories_string);
+        int existing = find_benchmark.step() ? find_benchmark.GetInt(0) : -1;
+        find_benchmark.reset();
+        if (existing == -1)
+        {
+            SqLiteStatement rename = db.prepare("UPDATE benchmarks SET categories = ?2 WHERE id = ?1");
+            rename.bind(1, benchmark_id);
+            rename.bind(2, categories_string);
+            RAW_VERIFY(!rename.step());
+        }
+        else
+        {
+            // the same executable was also stored without the build category.
+            // the ids of the samples only have to be unique per benchmark and
+            // argument, so going past the largest one of the other benchmark is enough
+            max_sample_id.bind(1, existing);
+            RAW_VERIFY(max_sample_id.step());
+            int64_t offset = max_sample_id.GetInt64(0);
+            max_sample_id.reset();
+            SqLiteStatement move_samples = db.prepare("UPDATE samples SET benchmark = ?2, id = id + ?3 WHERE benchmark = ?1");
+            move_samples.bind(1, benchmark_id);
+            move_samples.bind(2, existing);
+            move_samples.bind(3, offset);
+            RAW_VERIFY(!move_samples.step());
+            SqLiteStatement delete_benchmark = db.prepare("DELETE FROM benchmarks WHERE id = ?1");
+            delete_benchmark.bind(1, benchmark_id);
+            RAW_VERIFY(!delete_benchmark.step());
+            SqLiteStatement delete_categories = db.prepare("DELETE FROM benchmark_categories WHERE benchmark = ?1");
+            delete_categories.bind(1, benchmark_id);
+            RAW_VERIFY(!delete_categories.step());
+        }
+    }
+    SqLiteStatement delete_builds = db.prepare("DELETE FROM benchmark_categories WHERE category = ?1");
+    delete_builds.bind(1, skb::BuildIndex().view());
+    RAW_VERIFY(!delete_builds.step());
+}
+
+void BenchmarkDB::AddColumnIfMissing(std::string_view table, std::string_view column, std::string_view type_and_default) {
+    std::string table_info = "PRAGMA table_info(";
+    table_info += table;
+    table_info += ")";
+    {
+        // this statement has to be finished before the table can be altered
+        SqLiteStatement columns = db.prepare(table_info);
+        while (columns.step())
+        {
+            if (column == columns.GetString(1))
+                return;
+        }
+    }
+    std::string alter = "ALTER TABLE ";
+    alter += table;
+    alter += " ADD COLUMN ";
+    alter += column;
+    alter += ' ';
+    alter += type_and_default;
+    db.prepare_and_run(alter);
 }
 
 void BenchmarkDB::BeginTransaction() {
-    db.prepare_and_run("BEGIN");
+    // takes the write lock right away. a transaction that starts out reading
+    // can't wait for another writer when it wants to write later
+    db.prepare_and_run("BEGIN IMMEDIATE");
 }
 void BenchmarkDB::EndTransaction() {
     db.prepare_and_run("END");
@@ -55,16 +337,61 @@ void BenchmarkDB::EndTransaction() {
 
 int BenchmarkDB::AddBenchmark(interned_string executable, const skb::BenchmarkCategories & categories) {
     insert_benchmark.bind(1, executable.view());
-    std::string categories_string = categories.CategoriesString();
+    std::string categories_string = StoredCategories(categories).CategoriesString();
     insert_benchmark.bind(2, categories_string);
     RAW_VERIFY(!insert_benchmark.step());
     insert_benchmark.reset();
 
-    return GetBenchmarkId(categories_string);
+    int benchmark_id = GetBenchmarkId(executable.view(), categories_string);
+    InsertBenchmarkCategories(benchmark_id, categories);
+    return benchmark_id;
+}
+
+void BenchmarkDB::FillBenchmarkCategories(int benchmark_id, const skb::BenchmarkCategories & categories) {
+    has_benchmark_categories.bind(1, benchmark_id);
+    bool has_any = has_benchmark_categories.step();
+    has_benchmark_categories.reset();
+    if (!has_any)
+        InsertBenchmarkCategories(benchmark_id, categories);
+}
+
+void BenchmarkDB::InsertBenchmarkCategories(int benchmark_id, const skb::BenchmarkCategories & categories) {
+    skb::BenchmarkCategories stored = StoredCategories(categories);
+    for (const auto & [category, value] : stored.GetCategories())
+    {
+        insert_benchmark_category.bind(1, benchmark_id);
+        insert_benchmark_category.bind(2, category.view());
+        insert_benchmark_category.bind(3, value.view());
+        RAW_VERIFY(!insert_benchmark_category.step());
+        insert_benchmark_category.reset();
+    }
+}
+
+int64_t BenchmarkDB::AddRun(interned_string executable, const skb::BenchmarkCategories & categories) {
+    std::string compiler;
+    for (const interned_string * index : { &skb::BenchmarkCategories::CompilerIndex(), &skb::BenchmarkCategories::OptimizerIndex() })
+    {
+        auto found = categories.GetCategories().find(*index);
+        if (found == categories.GetCategories().end())
+            continue;
+        if (!compiler.empty())
+            compiler += ' ';
+        compiler += found->second.view();
+    }
+    insert_run.bind(1, HostName());
+    insert_run.bind(2, executable.view());
+    insert_run.bind(3, compiler);
+    insert_run.bind(4, BuildId(executable.view()));
+    insert_run.bind(5, OperatingSystem());
+    insert_run.bind(6, static_cast<int64_t>(std::time(nullptr)));
+    RAW_VERIFY(!insert_run.step());
+    insert_run.reset();
+    return db.LastInsertId();
 }
 
-int BenchmarkDB::GetBenchmarkId(std::string_view categories_string) {
-    get_benchmark_id.bind(1, categories_string);
+int BenchmarkDB::GetBenchmarkId(std::string_view executable, std::string_view categories_string) {
+    get_benchmark_id.bind(1, executable);
+    get_benchmark_id.bind(2, categories_string);
     if (!get_benchmark_id.step())
     {
         get_benchmark_id.reset();
@@ -75,21 +402,60 @@ int BenchmarkDB::GetBenchmarkId(std::string_view categories_string) {
     get_benchmark_id.reset();
     return result;
 }
-int BenchmarkDB::GetBenchmarkId(const skb::BenchmarkCategories & categories) {
-    return GetBenchmarkId(categories.CategoriesString());
+int BenchmarkDB::GetBenchmarkId(interned_string executable, const skb::BenchmarkCategories & categories) {
+    return GetBenchmarkId(executable.view(), StoredCategories(categories).CategoriesString());
 }
 
-void BenchmarkDB::AddResult(int benchmark_id, const skb::RunResults & result) {
+void BenchmarkDB::AddResult(int benchmark_id, int64_t run_id, const skb::RunResults & result) {
     add_result.bind(1, benchmark_id);
+    add_result.bind(run_parameter, run_id);
     add_result.bind(2, result.num_iterations);
     add_result.bind(3, result.argument);
     add_result.bind(4, result.time.count());
     add_result.bind(5, static_cast<int64_t>(result.num_items_processed));
     add_result.bind(6, static_cast<int64_t>(result.num_bytes_used));
+    add_result.bind(7, result.placement.num_parallel_runs);
+    add_result.bind(8, static_cast<int>(result.placement.policy));
+    add_result.bind(9, static_cast<int>(result.timer));
+    add_result.bind(10, result.warmup_iterations);
+    add_result.bind(11, result.warmup_time.count());
+    if (result.latencies)
+        add_result.bind_blob(12, result.latencies->Serialize());
+    else
+        add_result.bind_null(12);
+    add_result.bind(13, static_cast<int64_t>(result.peak_bytes));
+    add_result.bind(14, static_cast<int64_t>(result.num_allocations));
+    add_result.bind(15, result.num_threads);
+    add_result.bind(16, result.thread_time.count());
+    add_result.bind(17, static_cast<int64_t>(result.environment.controls));
+    add_result.bind(18, result.environment.cpu);
+    add_result.bind(19, result.block);
+    for (int i = 0; i < skb::NumRunCounters; ++i)
+    {
+        skb::RunCounter counter = static_cast<skb::RunCounter>(i);
+        if (result.counters.Has(counter))
+            add_result.bind(first_counter_parameter + i, static_cast<int64_t>(result.counters.Get(counter)));
+        else
+            add_result.bind_null(first_counter_parameter + i);
+    }
     RAW_VERIFY(!add_result.step());
     add_result.reset();
 }
 
+void BenchmarkDB::ReadCounters(skb::RunCounters & counters) {
+    for (int i = 0; i < skb::NumRunCounters; ++i)
+    {
+        if (!load_result.IsNull(load_result_first_counter + i))
+            counters.Set(static_cast<skb::RunCounter>(i), static_cast<uint64_t>(load_result.GetInt64(load_result_first_counter + i)));
+    }
+}
+
+void BenchmarkDB::ReadLatencies(skb::RunResults & result) {
+    static constexpr int latencies_column = 10;
+    if (!load_result.IsNull(latencies_column))
+        result.latencies = std::make_shared<skb::LatencyHistogram>(skb::LatencyHistogram::Deserialize(load_result.GetBlob(latencies_column)));
+}
+
 void BenchmarkDB::AddCheckboxState(interned_string category, interned_string checkbox, bool state) {
     add_checkbox_state.bind(1, category);
     add_checkbox_state.bind(2, checkbox);
@@ -98,19 +464,205 @@ void BenchmarkDB::AddCheckboxState(interned_string category, interned_string che
     add_checkbox_state.reset();
 }
 
-void BenchmarkDB::DeleteOldResults(interned_string executable) {
-    delete_results.bind(1, executable.view());
+void BenchmarkDB::DeleteResults(int benchmark_id) {
+    delete_results.bind(1, benchmark_id);
     RAW_VERIFY(!delete_results.step());
     delete_results.reset();
 }
 
-void BenchmarkDB::DeleteOldBenchmarks(interned_string executable) {
-    delete_benchmarks.bind(1, executable.view());
-    RAW_VERIFY(!delete_benchmarks.step());
-    delete_benchmarks.reset();
+void BenchmarkDB::TrimResults(int benchmark_id, int64_t argument, double median_nanoseconds_per_item, int64_t num_to_keep) {
+    trim_results.bind(1, benchmark_id);
+    trim_results.bind(2, argument);
+    trim_results.bind(3, median_nanoseconds_per_item);
+    trim_results.bind(4, num_to_keep);
+    RAW_VERIFY(!trim_results.step());
+    trim_results.reset();
 }
 void BenchmarkDB::DeleteCheckboxState() {
     db.prepare_and_run("DELETE FROM checkbox_state");
 }
 
 
+
+#include "test/include_test.hpp"
+#include <filesystem>
+
+TEST(benchmark_db, migrates_the_results_table_of_version_0)
+{
+    std::filesystem::path filename = std::filesystem::temp_directory_path() / ("benchmark_db_test_" + std::to_string(::getpid()) + ".db");
+    skb::BenchmarkCategories categories = skb::CategoryBuilder().AddCategory("operation", "pop").BuildCategories(interned_string("type"), interned_string("name"));
+    {
+        // the tables as the first version of the program created them
+        Database legacy(filename.c_str());
+        legacy.prepare_and_run("CREATE TABLE benchmarks (id INTEGER PRIMARY KEY AUTOINCREMENT, filename TEXT NOT NULL, categories TEXT UNIQUE)");
+        legacy.prepare_and_run("CREATE TABLE results (benchmark INTEGER, num_iterations INTEGER, argument INTEGER, time INTEGER, num_items_processed INTEGER, num_bytes_used INTEGER)");
+        SqLiteStatement insert_benchmark = legacy.prepare("INSERT INTO benchmarks (filename, categories) VALUES ('a.exe', ?1)");
+        insert_benchmark.bind(1, categories.CategoriesString());
+        ASSERT_FALSE(insert_benchmark.step());
+        legacy.prepare_and_run("INSERT INTO results VALUES (1, 10, 64, 1000, 640, 0)");
+        legacy.prepare_and_run("INSERT INTO results VALUES (1, 20, 128, 4000, 2560, 0)");
+    }
+    int num_rows = 0;
+    int64_t time_at_128 = 0;
+    int num_threads_at_128 = 0;
+    int num_categories = 0;
+    bool results_table_left = true;
+    {
+        BenchmarkDB db(filename.c_str());
+        int benchmark_id = db.GetBenchmarkId(interned_string("a.exe"), categories);
+        ASSERT_EQ(1, benchmark_id);
+        db.load_result.bind(1, benchmark_id);
+        while (db.load_result.step())
+        {
+            ++num_rows;
+            if (db.load_result.GetInt64(1) == 128)
+            {
+                time_at_128 = db.load_result.GetInt64(2);
+                num_threads_at_128 = db.load_result.GetInt(13);
+            }
+        }
+        db.load_result.reset();
+        db.FillBenchmarkCategories(benchmark_id, categories);
+        // a second time doesn't add anything
+        db.FillBenchmarkCategories(benchmark_id, categories);
+
+        Database check(filename.c_str());
+        SqLiteStatement count_categories = check.prepare("SELECT count(*) FROM benchmark_categories WHERE benchmark = 1");
+        ASSERT_TRUE(count_categories.step());
+        num_categories = count_categories.GetInt(0);
+        SqLiteStatement results_table = check.prepare("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'results'");
+        results_table_left = results_table.step();
+    }
+    for (const char * suffix : { "", "-wal", "-shm" })
+        std::filesystem::remove(filename.string() + suffix);
+    ASSERT_EQ(2, num_rows);
+    ASSERT_EQ(4000, time_at_128);
+    // columns that the old table didn't have get their defaults
+    ASSERT_EQ(1, num_threads_at_128);
+    ASSERT_EQ(static_cast<int>(categories.GetCategories().size()), num_categories);
+    ASSERT_FALSE(results_table_left);
+}
+
+namespace
+{
+skb::RunResults MakeRun(int64_t time)
+{
+    skb::RunResults run;
+    run.num_iterations = 1;
+    run.argument = 1;
+    run.time = std::chrono::nanoseconds(time);
+    run.num_items_processed = 0;
+    run.num_bytes_used = 0;
+    return run;
+}
+std::vector<int64_t> StoredTimes(BenchmarkDB & db, interned_string executable, const skb::BenchmarkCategories & categories)
+{
+    std::vector<int64_t> result;
+    db.load_result.bind(1, db.GetBenchmarkId(executable, categories));
+    while (db.load_result.step())
+        result.push_back(db.load_result.GetInt64(2));
+    db.load_result.reset();
+    std::sort(result.begin(), result.end());
+    return result;
+}
+}
+
+TEST(benchmark_db, builds_with_the_same_name_keep_their_runs_apart)
+{
+    std::filesystem::path filename = std::filesystem::temp_directory_path() / ("benchmark_db_test_" + std::to_string(::getpid()) + ".db");
+    skb::BenchmarkCategories categories = skb::CategoryBuilder().AddCategory(skb::FilenameIndex(), "bench").BuildCategories(interned_string("type"), interned_string("name"));
+    interned_string build_a("build_a/bench");
+    interned_string build_b("build_b/bench");
+    skb::BenchmarkCategories a_with_build = categories.AddCategoryCopy(skb::BuildIndex(), "build_a");
+    skb::BenchmarkCategories b_with_build = categories.AddCategoryCopy(skb::BuildIndex(), "build_b");
+    auto add_run = [](BenchmarkDB & db, interned_string executable, const skb::BenchmarkCategories & categories, int64_t time)
+    {
+        int benchmark_id = db.AddBenchmark(executable, categories);
+        db.AddResult(benchmark_id, db.AddRun(executable, categories), MakeRun(time));
+    };
+    // every block is one session. an executable only gets the build category
+    // if the other one was loaded before it in the same session
+    {
+        BenchmarkDB db(filename.c_str());
+        add_run(db, build_a, categories, 100);
+    }
+    {
+        BenchmarkDB db(filename.c_str());
+        add_run(db, build_b, categories, 200);
+    }
+    {
+        BenchmarkDB db(filename.c_str());
+        add_run(db, build_a, categories, 101);
+        add_run(db, build_b, b_with_build, 201);
+    }
+    {
+        BenchmarkDB db(filename.c_str());
+        add_run(db, build_b, categories, 202);
+        add_run(db, build_a, a_with_build, 102);
+    }
+    std::vector<int64_t> a_alone, a_second, b_alone, b_second;
+    {
+        BenchmarkDB db(filename.c_str());
+        a_alone = StoredTimes(db, build_a, categories);
+        a_second = StoredTimes(db, build_a, a_with_build);
+        b_alone = StoredTimes(db, build_b, categories);
+        b_second = StoredTimes(db, build_b, b_with_build);
+    }
+    for (const char * suffix : { "", "-wal", "-shm" })
+        std::filesystem::remove(filename.string() + suffix);
+    ASSERT_EQ(std::vector<int64_t>({ 100, 101, 102 }), a_alone);
+    ASSERT_EQ(a_alone, a_second);
+    ASSERT_EQ(std::vector<int64_t>({ 200, 201, 202 }), b_alone);
+    ASSERT_EQ(b_alone, b_second);
+}
+
+TEST(benchmark_db, migrates_benchmarks_that_were_stored_with_the_build)
+{
+    std::filesystem::path filename = std::filesystem::temp_directory_path() / ("benchmark_db_test_" + std::to_string(::getpid()) + ".db");
+    skb::BenchmarkCategories categories = skb::CategoryBuilder().AddCategory(skb::FilenameIndex(), "bench").BuildCategories(interned_string("type"), interned_string("name"));
+    skb::BenchmarkCategories with_build = categories.AddCategoryCopy(skb::BuildIndex(), "build_b");
+    interned_string build_b("build_b/bench");
+    {
+        BenchmarkDB db(filename.c_str());
+    }
+    {
+        // the benchmarks table of version 1. the same executable was stored once
+        // with and once without the build category
+        Database legacy(filename.c_str());
+        legacy.prepare_and_run("DROP TABLE benchmarks");
+        legacy.prepare_and_run("CREATE TABLE benchmarks (id INTEGER PRIMARY KEY AUTOINCREMENT, filename TEXT NOT NULL, categories TEXT UNIQUE)");
+        SqLiteStatement insert_benchmark = legacy.prepare("INSERT INTO benchmarks (id, filename, categories) VALUES (?1, 'build_b/bench', ?2)");
+        insert_benchmark.bind(1, 1);
+        insert_benchmark.bind(2, categories.CategoriesString());
+        ASSERT_FALSE(insert_benchmark.step());
+        insert_benchmark.reset();
+        insert_benchmark.bind(1, 2);
+        insert_benchmark.bind(2, with_build.CategoriesString());
+        ASSERT_FALSE(insert_benchmark.step());
+        SqLiteStatement insert_category = legacy.prepare("INSERT INTO benchmark_categories (benchmark, category, value) VALUES (2, ?1, ?2)");
+        for (const auto & [category, value] : with_build.GetCategories())
+        {
+            insert_category.bind(1, category.view());
+            insert_category.bind(2, value.view());
+            ASSERT_FALSE(insert_category.step());
+            insert_category.reset();
+        }
+        legacy.prepare_and_run("INSERT INTO samples (benchmark, argument, id, num_iterations, time, num_items_processed, num_bytes_used) VALUES (1, 1, 1, 1, 200, 0, 0)");
+        legacy.prepare_and_run("INSERT INTO samples (benchmark, argument, id, num_iterations, time, num_items_processed, num_bytes_used) VALUES (2, 1, 1, 1, 201, 0, 0)");
+        legacy.SetVersion(schema_version_type, 1);
+    }
+    int with_build_id = -1;
+    int without_build_id = -1;
+    std::vector<int64_t> times;
+    {
+        BenchmarkDB db(filename.c_str());
+        with_build_id = db.GetBenchmarkId(build_b, with_build);
+        without_build_id = db.GetBenchmarkId(build_b, categories);
+        times = StoredTimes(db, build_b, with_build);
+    }
+    for (const char * suffix : { "", "-wal", "-shm" })
+        std::filesystem::remove(filename.string() + suffix);
+    ASSERT_EQ(1, with_build_id);
+    ASSERT_EQ(1, without_build_id);
+    ASSERT_EQ(std::vector<int64_t>({ 200, 201 }), times);
+}
@@ -5,31 +5,64 @@
 
 struct BenchmarkDB {
     BenchmarkDB(const char * filename);
-    ~BenchmarkDB();
 
+    // returns the id that the benchmark already has, if it has one. a benchmark
+    // is identified by its executable and its categories without the build
+    // category, so it gets the same id no matter what was loaded before it
     int AddBenchmark(interned_string executable, const skb::BenchmarkCategories & categories);
-    int GetBenchmarkId(std::string_view categories_string);
-    int GetBenchmarkId(const skb::BenchmarkCategories & categories);
+    int GetBenchmarkId(interned_string executable, const skb::BenchmarkCategories & categories);
+    // writes the rows of benchmark_categories for a benchmark that doesn't have
+    // any yet, like the ones that were migrated from schema version 0
+    void FillBenchmarkCategories(int benchmark_id, const skb::BenchmarkCategories & categories);
 
-    void AddResult(int benchmark_id, const skb::RunResults & result);
+    // one row in the runs table for the results that the executable gets in this
+    // session, with the host, the compiler and the build
+    int64_t AddRun(interned_string executable, const skb::BenchmarkCategories & categories);
+    void AddResult(int benchmark_id, int64_t run_id, const skb::RunResults & result);
 
     void AddCheckboxState(interned_string category, interned_string checkbox, bool state);
 
     void BeginTransaction();
     void EndTransaction();
 
-    void DeleteOldResults(interned_string executable);
-    void DeleteOldBenchmarks(interned_string executable);
+    void DeleteResults(int benchmark_id);
+    // keeps the [num_to_keep] runs at [argument] that are closest to the median,
+    // so the fastest and the slowest runs are the first to go
+    void TrimResults(int benchmark_id, int64_t argument, double median_nanoseconds_per_item, int64_t num_to_keep);
     void DeleteCheckboxState();
 
+    // columns 0 to 17 are num_iterations, argument, time, num_items_processed,
+    // num_bytes_used, num_parallel_runs, placement, timer, warmup_iterations,
+    // warmup_time, latencies, peak_bytes, num_allocations, num_threads,
+    // thread_time, environment, pinned_cpu and block. then come the counters
     SqLiteStatement load_result;
+    static constexpr int load_result_first_counter = 18;
+    void ReadLatencies(skb::RunResults & result);
+    void ReadCounters(skb::RunCounters & counters);
     SqLiteStatement read_checkbox;
 private:
     Database db;
+
+    // for columns that were added after a table was first created. existing rows get the default
+    void AddColumnIfMissing(std::string_view table, std::string_view column, std::string_view type_and_default);
+    // copies the results table of schema version 0 into the samples table
+    void MigrateResultsToSamples(const std::string & counter_names);
+    // version 1 had a unique constraint on the categories alone, and stored the
+    // build category if the executable happened to be loaded after another one
+    // with the same name
+    void MigrateBenchmarksToFilenameAndCategories();
+    int GetBenchmarkId(std::string_view executable, std::string_view categories_string);
+    void InsertBenchmarkCategories(int benchmark_id, const skb::BenchmarkCategories & categories);
+
     SqLiteStatement get_benchmark_id;
     SqLiteStatement insert_benchmark;
+    SqLiteStatement insert_benchmark_category;
+    SqLiteStatement has_benchmark_categories;
+    SqLiteStatement insert_run;
     SqLiteStatement add_result;
     SqLiteStatement delete_results;
-    SqLiteStatement delete_benchmarks;
+    SqLiteStatement trim_results;
     SqLiteStatement add_checkbox_state;
+    static constexpr int first_counter_parameter = 20;
+    static constexpr int run_parameter = first_counter_parameter + skb::NumRunCounters;
 };
@@ -0,0 +1,155 @@
+#include "db/result_writer.hpp"
+#include <map>
+
+ResultWriter::ResultWriter(const char * filename, size_t max_runs_per_point, std::chrono::milliseconds max_delay)
+    : db(filename)
+    , max_runs_per_point(max_runs_per_point)
+    , max_delay(max_delay)
+    , thread([this]{ WriteLoop(); })
+{
+}
+
+ResultWriter::~ResultWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake_up.notify_one();
+    thread.join();
+}
+
+void ResultWriter::Add(const skb::BenchmarkResults & benchmark, const skb::RunResults & run)
+{
+    Command command;
+    command.benchmark = &benchmark;
+    command.run = run;
+    std::shared_ptr<const skb::ResultsSnapshot> snapshot = benchmark.GetResults();
+    const skb::RunSamples * runs = snapshot->Find(run.argument);
+    if (runs && !runs->empty())
+        command.median_nanoseconds_per_item = runs->Statistics().median.value;
+    else
+        command.median_nanoseconds_per_item = run.GetNanosecondsPerItem(nullptr);
+    Push(std::move(command));
+}
+void ResultWriter::Clear(const skb::BenchmarkResults & benchmark)
+{
+    Command command;
+    command.benchmark = &benchmark;
+    Push(std::move(command));
+}
+void ResultWriter::Push(Command command)
+{
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(command));
+        // the first one starts the clock for the batch, and a full batch
+        // doesn't have to wait for it
+        wake = queue.size() == 1 || queue.size() == max_batch_size;
+    }
+    if (wake)
+        wake_up.notify_one();
+}
+
+void ResultWriter::WriteLoop()
+{
+    std::deque<Command> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;)
+    {
+        wake_up.wait(lock, [&]{ return stop || !queue.empty(); });
+        // give the batch time to fill up
+        wake_up.wait_for(lock, max_delay, [&]{ return stop || queue.size() >= max_batch_size; });
+        // only ever empty here once it's time to stop
+        if (queue.empty())
+            return;
+        batch.swap(queue);
+        lock.unlock();
+        Write(batch);
+        batch.clear();
+        lock.lock();
+    }
+}
+
+void ResultWriter::Write(const std::deque<Command> & batch)
+{
+    // the newest median of every point that got a run
+    std::map<std::pair<int, int64_t>, double> added;
+    db.BeginTransaction();
+    for (const Command & command : batch)
+    {
+        int benchmark_id = GetBenchmarkId(*command.benchmark);
+        if (command.run)
+        {
+            db.AddResult(benchmark_id, GetRunId(*command.benchmark), *command.run);
+            added[{ benchmark_id, command.run->argument }] = command.median_nanoseconds_per_item;
+        }
+        else
+            db.DeleteResults(benchmark_id);
+    }
+    for (const auto & [point, median] : added)
+        db.TrimResults(point.first, point.second, median, static_cast<int64_t>(max_runs_per_point));
+    db.EndTransaction();
+}
+
+int ResultWriter::GetBenchmarkId(const skb::BenchmarkResults & benchmark)
+{
+    auto found = benchmark_ids.find(&benchmark);
+    if (found != benchmark_ids.end())
+        return found->second;
+    int benchmark_id = db.AddBenchmark(benchmark.executable, *benchmark.categories);
+    benchmark_ids.emplace(&benchmark, benchmark_id);
+    return benchmark_id;
+}
+int64_t ResultWriter::GetRunId(const skb::BenchmarkResults & benchmark)
+{
+    auto found = run_ids.find(benchmark.executable);
+    if (found != run_ids.end())
+        return found->second;
+    int64_t run_id = db.AddRun(benchmark.executable, *benchmark.categories);
+    run_ids.emplace(benchmark.executable, run_id);
+    return run_id;
+}
+
+#include "test/include_test.hpp"
+#include <filesystem>
+#include <unistd.h>
+
+TEST(result_writer, single_run_is_written_within_max_delay)
+{
+    std::filesystem::path filename = std::filesystem::temp_directory_path() / ("result_writer_test_" + std::to_string(::getpid()) + ".db");
+    skb::BenchmarkCategories categories = skb::CategoryBuilder().BuildCategories(interned_string("type"), interned_string("name"));
+    skb::BenchmarkResults results(nullptr);
+    results.categories = &categories;
+    results.executable = interned_string("result_writer_test");
+    skb::RunResults run;
+    run.num_iterations = 1;
+    run.argument = 1;
+    run.time = std::chrono::nanoseconds(100);
+    run.num_items_processed = 0;
+    run.num_bytes_used = 0;
+    results.AddResult(run);
+
+    std::chrono::milliseconds max_delay{ 50 };
+    int num_rows = 0;
+    {
+        ResultWriter writer(filename.c_str(), 64, max_delay);
+        writer.Add(results, run);
+        // the writer is still alive, so the row can only be there if the first
+        // run of the batch woke it up
+        BenchmarkDB db(filename.c_str());
+        auto give_up = std::chrono::steady_clock::now() + max_delay * 40;
+        while (num_rows == 0 && std::chrono::steady_clock::now() < give_up)
+        {
+            std::this_thread::sleep_for(max_delay / 5);
+            db.load_result.bind(1, db.GetBenchmarkId(results.executable, categories));
+            while (db.load_result.step())
+                ++num_rows;
+            db.load_result.reset();
+        }
+    }
+    for (const char * suffix : { "", "-wal", "-shm" })
+        std::filesystem::remove(filename.string() + suffix);
+    ASSERT_EQ(1, num_rows);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "db/benchmark_db.hpp"
+#include "container/flat_hash_map.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+// writes new runs to the database on a thread of its own while the benchmarks
+// are running, so that a crash loses at most the last few seconds and exiting
+// only has to write the tail. the runs are committed in one transaction per
+// batch: when max_batch_size of them are waiting, or max_delay after the first
+// of them arrived. in the same transaction every point that got a new run is
+// trimmed back to the runs closest to its median.
+// has a database connection of its own, so the gui can keep reading from its
+// connection in the meantime
+struct ResultWriter
+{
+    static constexpr size_t max_batch_size = 256;
+    static constexpr std::chrono::milliseconds default_max_delay{ 2000 };
+
+    ResultWriter(const char * filename, size_t max_runs_per_point, std::chrono::milliseconds max_delay = default_max_delay);
+    // writes whatever is still waiting
+    ~ResultWriter();
+
+    // [run] has to be in the results of [benchmark] already, for the median
+    void Add(const skb::BenchmarkResults & benchmark, const skb::RunResults & run);
+    // for when the runs of the benchmark were cleared
+    void Clear(const skb::BenchmarkResults & benchmark);
+
+private:
+    struct Command
+    {
+        const skb::BenchmarkResults * benchmark = nullptr;
+        // nullopt to clear
+        std::optional<skb::RunResults> run;
+        double median_nanoseconds_per_item = 0.0;
+    };
+
+    void Push(Command command);
+    void WriteLoop();
+    void Write(const std::deque<Command> & batch);
+    int GetBenchmarkId(const skb::BenchmarkResults & benchmark);
+    int64_t GetRunId(const skb::BenchmarkResults & benchmark);
+
+    // only used by the writer thread
+    BenchmarkDB db;
+    size_t max_runs_per_point;
+    std::chrono::milliseconds max_delay;
+    ska::flat_hash_map<const skb::BenchmarkResults *, int> benchmark_ids;
+    // one run per executable for as long as the writer exists
+    ska::flat_hash_map<interned_string, int64_t> run_ids;
+
+    std::mutex mutex;
+    std::condition_variable wake_up;
+    std::deque<Command> queue;
+    bool stop = false;
+    // last, so that everything else is there when it starts
+    std::thread thread;
+};
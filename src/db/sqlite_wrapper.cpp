@@ -27,7 +27,11 @@ SqLite::SqLite(const char * filename)
         sqlite3_close(open_db);
     }
     else
+    {
+        // another connection may be writing. in WAL mode that's only ever short
+        sqlite3_busy_timeout(open_db, 10000);
         db.reset(open_db);
+    }
 }
 
 SqLiteStatement SqLite::prepare(std::string_view text)
@@ -53,6 +57,9 @@ std::pair<SqLiteStatement, std::string_view> SqLite::prepare_part(std::string_vi
 void SqLite::prepare_and_run(std::string_view text) {
     RAW_VERIFY(!prepare(text).step());
 }
+int64_t SqLite::LastInsertId() {
+    return sqlite3_last_insert_rowid(*this);
+}
 
 bool SqLiteStatement::step()
 {
@@ -111,6 +118,24 @@ void SqLiteStatement::bind(int index, std::string_view text)
     }
 }
 
+void SqLiteStatement::bind_null(int index)
+{
+    int result = sqlite3_bind_null(statement.get(), index);
+    if (result != SQLITE_OK)
+    {
+        UNHANDLED_ERROR("TODO: handle error of sqlite_bind");
+    }
+}
+
+void SqLiteStatement::bind_blob(int index, std::string_view bytes)
+{
+    int result = sqlite3_bind_blob(statement.get(), index, bytes.data(), bytes.size(), SQLITE_TRANSIENT);
+    if (result != SQLITE_OK)
+    {
+        UNHANDLED_ERROR("TODO: handle error of sqlite_bind");
+    }
+}
+
 int SqLiteStatement::GetInt(int index)
 {
     return sqlite3_column_int(statement.get(), index);
@@ -127,6 +152,16 @@ const char * SqLiteStatement::GetString(int index)
 {
     return reinterpret_cast<const char *>(sqlite3_column_text(statement.get(), index));
 }
+std::string_view SqLiteStatement::GetBlob(int index)
+{
+    // the size has to be asked for after the data
+    const char * data = static_cast<const char *>(sqlite3_column_blob(statement.get(), index));
+    return std::string_view(data, sqlite3_column_bytes(statement.get(), index));
+}
+bool SqLiteStatement::IsNull(int index)
+{
+    return sqlite3_column_type(statement.get(), index) == SQLITE_NULL;
+}
 
 static void init_version_table(SqLite & db)
 {
@@ -140,3 +175,18 @@ Database::Database(const char *filename)
         init_version_table(*this);
 }
 
+int Database::GetVersion(std::string_view type)
+{
+    SqLiteStatement version = prepare("SELECT current FROM versions WHERE type = ?1");
+    version.bind(1, type);
+    if (!version.step())
+        return 0;
+    return version.GetInt(0);
+}
+void Database::SetVersion(std::string_view type, int version)
+{
+    SqLiteStatement set_version = prepare("INSERT OR REPLACE INTO versions (type, current) VALUES (?1, ?2)");
+    set_version.bind(1, type);
+    set_version.bind(2, version);
+    RAW_VERIFY(!set_version.step());
+}
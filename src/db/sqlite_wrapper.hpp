@@ -38,11 +38,15 @@ struct SqLiteStatement
     void bind(int index, int64_t value);
     void bind(int index, double value);
     void bind(int index, std::string_view text);
+    void bind_null(int index);
+    void bind_blob(int index, std::string_view bytes);
 
     int GetInt(int index);
     int64_t GetInt64(int index);
     double GetDouble(int index);
     const char * GetString(int index);
+    std::string_view GetBlob(int index);
+    bool IsNull(int index);
 
 private:
     std::unique_ptr<sqlite3_stmt, StatementDestructor> statement;
@@ -69,6 +73,8 @@ struct SqLite
 
     SqLiteStatement prepare(std::string_view text);
     void prepare_and_run(std::string_view text);
+    // the rowid of the last row that an INSERT added on this connection
+    int64_t LastInsertId();
     std::pair<SqLiteStatement, std::string_view> prepare_part(std::string_view text);
 
 private:
@@ -80,5 +86,9 @@ struct Database : public SqLite
     static std::unique_ptr<Database> test_db;
 
     Database(const char * filename);
+
+    // from the versions table. 0 for a type that never had a version
+    int GetVersion(std::string_view type);
+    void SetVersion(std::string_view type, int version);
 };
 
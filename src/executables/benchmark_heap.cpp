@@ -7,12 +7,13 @@
 
 void benchmark_heap_push(skb::State & state)
 {
+    TrackAllocations track_allocations(state);
     std::vector<int> heap;
     int num_items = state.range(0);
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -25,13 +26,66 @@ void benchmark_heap_push(skb::State & state)
     state.SetItemsProcessed(num_items * state.iterations());
 }
 
+// items of [Bytes] bytes in total, to see how much of the cost of push_heap is
+// moving the items around
+template<size_t Bytes>
+struct HeapItemWithPayload
+{
+    int key;
+    char payload[Bytes - sizeof(int)];
+
+    bool operator<(const HeapItemWithPayload & other) const
+    {
+        return key < other.key;
+    }
+};
+template<size_t Bytes>
+void benchmark_heap_push_payload(skb::State & state)
+{
+    std::vector<HeapItemWithPayload<Bytes>> heap;
+    int num_items = state.range(0);
+    heap.reserve(num_items);
+    std::uniform_int_distribution<int> distribution;
+    std::mt19937_64 & randomness = global_randomness;
+    for (auto _ : state)
+    {
+        heap.clear();
+        for (int i = 0; i < num_items; ++i)
+        {
+            heap.push_back({ no_inline_random_number(distribution, randomness), {} });
+            std::push_heap(heap.begin(), heap.end());
+        }
+        skb::DoNotOptimize(heap.back().key);
+    }
+    state.SetItemsProcessed(num_items * state.iterations());
+}
+// the payload size is the second argument
+void benchmark_heap_push_with_payload(skb::State & state)
+{
+    switch (state.range(1))
+    {
+    case 8:
+        return benchmark_heap_push_payload<8>(state);
+    case 16:
+        return benchmark_heap_push_payload<16>(state);
+    case 32:
+        return benchmark_heap_push_payload<32>(state);
+    case 64:
+        return benchmark_heap_push_payload<64>(state);
+    case 128:
+        return benchmark_heap_push_payload<128>(state);
+    }
+    CHECK_FOR_PROGRAMMER_ERROR(false, "Unsupported payload size");
+}
+
 void benchmark_std_multiset_push(skb::State & state)
 {
+    TrackAllocations track_allocations(state);
     std::multiset<int> heap;
     int num_items = state.range(0);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -43,12 +97,13 @@ void benchmark_std_multiset_push(skb::State & state)
 
 void benchmark_interval_heap_push(skb::State & state)
 {
+    TrackAllocations track_allocations(state);
     std::vector<int> heap;
     int num_items = state.range(0);
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -63,12 +118,13 @@ void benchmark_interval_heap_push(skb::State & state)
 
 void benchmark_minmax_heap_push(skb::State & state)
 {
+    TrackAllocations track_allocations(state);
     std::vector<int> heap;
     int num_items = state.range(0);
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -84,12 +140,13 @@ void benchmark_minmax_heap_push(skb::State & state)
 template<int D>
 void benchmark_push_dary_heap(skb::State & state)
 {
+    TrackAllocations track_allocations(state);
     std::vector<int> heap;
     int num_items = state.range(0);
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -111,7 +168,7 @@ void benchmark_push_dary_heap_grandparent(skb::State & state)
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -132,7 +189,7 @@ void benchmark_push_dary_heap_great_grandparent(skb::State & state)
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -153,7 +210,7 @@ void benchmark_push_dary_heap_great_great_grandparent(skb::State & state)
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -174,7 +231,7 @@ void benchmark_push_binary_heap_binary_search(skb::State & state)
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -195,7 +252,7 @@ void benchmark_push_binary_heap_binary_search_plus_one(skb::State & state)
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -211,12 +268,13 @@ void benchmark_push_binary_heap_binary_search_plus_one(skb::State & state)
 
 void benchmark_pairing_heap_push(skb::State & state)
 {
+    TrackAllocations track_allocations(state);
     PairingHeap<int>::MemoryPool pool;
     PairingHeap<int> heap;
     int num_items = state.range(0);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear(pool);
         for (int i = 0; i < num_items; ++i)
@@ -230,12 +288,13 @@ void benchmark_pairing_heap_push(skb::State & state)
 
 void benchmark_pairing_pair_heap_push(skb::State & state)
 {
+    TrackAllocations track_allocations(state);
     PairingHeapPair<int>::MemoryPool pool;
     PairingHeapPair<int> heap;
     int num_items = state.range(0);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear(pool);
         for (int i = 0; i < num_items; ++i)
@@ -255,7 +314,7 @@ void benchmark_pairing_push_heap_push(skb::State & state)
     int num_items = state.range(0);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear(pool);
         for (int i = 0; i < num_items; ++i)
@@ -274,7 +333,7 @@ void benchmark_make_heap(skb::State & state)
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -292,7 +351,7 @@ void benchmark_make_interval_heap(skb::State & state)
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -310,7 +369,7 @@ void benchmark_make_minmax_heap(skb::State & state)
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -329,7 +388,7 @@ void benchmark_make_dary_heap(skb::State & state)
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -348,7 +407,7 @@ void benchmark_pop_minmax_heap_min(skb::State & state)
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -368,7 +427,7 @@ void benchmark_pop_minmax_heap_max(skb::State & state)
     heap.reserve(num_items);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -388,7 +447,7 @@ void benchmark_pop_heap(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -401,6 +460,32 @@ void benchmark_pop_heap(skb::State & state)
     state.SetItemsProcessed(num_items * state.iterations());
 }
 
+// one iteration is one pop, so that the latencies show how much a single pop
+// varies. refilling the heap once it's empty isn't timed
+void benchmark_pop_heap_each(skb::State & state)
+{
+    int num_items = state.range(0);
+    std::uniform_int_distribution<int> distribution;
+    std::mt19937_64 & randomness = global_randomness;
+    std::vector<int> heap;
+    heap.reserve(num_items);
+    for (auto _ : state)
+    {
+        if (heap.empty())
+        {
+            state.PauseTiming();
+            for (int i = 0; i < num_items; ++i)
+                heap.push_back(no_inline_random_number(distribution, randomness));
+            std::make_heap(heap.begin(), heap.end());
+            state.ResumeTiming();
+        }
+        std::pop_heap(heap.begin(), heap.end());
+        skb::DoNotOptimize(heap.back());
+        heap.pop_back();
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
 void benchmark_pop_std_multiset(skb::State & state)
 {
     int num_items = state.range(0);
@@ -420,7 +505,7 @@ void benchmark_pop_std_multiset(skb::State & state)
         heaps.push_back(std::move(heap));
     }
     std::uniform_int_distribution<int> random_heap(0, num_heaps - 1);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         std::multiset<int> heap = heaps[no_inline_random_number(random_heap, randomness)];
         skb::DoNotOptimize(*heap.begin());
@@ -438,7 +523,7 @@ void benchmark_pop_interval_heap_min(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -458,7 +543,7 @@ void benchmark_pop_interval_heap_max(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -479,7 +564,7 @@ void benchmark_pop_dary_heap(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -501,7 +586,7 @@ void benchmark_pop_dary_heap_linear(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -522,7 +607,7 @@ void benchmark_pop_binary_heap_grandparent(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -543,7 +628,7 @@ void benchmark_pop_quaternary_heap_grandparent(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -564,7 +649,7 @@ void benchmark_pop_binary_heap_unrolled(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -584,7 +669,7 @@ void benchmark_pop_binary_heap_unrolled_grandparent(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -604,7 +689,7 @@ void benchmark_pop_binary_heap_unrolled_8(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -624,7 +709,7 @@ void benchmark_pop_binary_heap_unrolled_2(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -645,7 +730,7 @@ void benchmark_pop_binary_heap_unrolled_no_early_out(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -665,7 +750,7 @@ void benchmark_pop_quaternary_heap_unrolled(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -685,7 +770,7 @@ void benchmark_pop_quaternary_heap_unrolled_2(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -707,7 +792,7 @@ void benchmark_pop_dary_heap_half(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -727,7 +812,7 @@ void benchmark_pop_dary_heap_make_std_heap(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -748,7 +833,7 @@ void benchmark_pop_pairing_heap(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     PairingHeap<int> heap;
     PairingHeap<int>::MemoryPool pool;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear(pool);
         for (int i = 0; i < num_items; ++i)
@@ -767,7 +852,7 @@ void benchmark_pop_pairing_pair_heap(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     PairingHeapPair<int> heap;
     PairingHeapPair<int>::MemoryPool pool;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear(pool);
         for (int i = 0; i < num_items; ++i)
@@ -787,7 +872,7 @@ void benchmark_pop_pairing_push_heap(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     PairingHeapMorePushWork<int, MergeInterval> heap;
     typename PairingHeapMorePushWork<int, MergeInterval>::MemoryPool pool;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear(pool);
         for (int i = 0; i < num_items; ++i)
@@ -806,7 +891,7 @@ void benchmark_pop_pairing_heap_half(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     PairingHeap<int> heap;
     PairingHeap<int>::MemoryPool pool;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear(pool);
         for (int i = 0; i < num_items; ++i)
@@ -823,7 +908,7 @@ void benchmark_heap_baseline(skb::State & state)
     int num_items = state.range(0);
     std::uniform_int_distribution<int> distribution;
     std::mt19937_64 & randomness = global_randomness;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (int i = 0; i < num_items; ++i)
             skb::DoNotOptimize(no_inline_random_number(distribution, randomness));
@@ -839,7 +924,7 @@ void benchmark_make_heap_baseline(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -870,7 +955,7 @@ void benchmark_copy_std_multiset_baseline(skb::State & state)
         heaps.push_back(std::move(heap));
     }
     std::uniform_int_distribution<int> random_heap(0, num_heaps - 1);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         std::multiset<int> heap = heaps[no_inline_random_number(random_heap, randomness)];
         skb::DoNotOptimize(*heap.begin());
@@ -886,7 +971,7 @@ void benchmark_make_minmax_heap_baseline(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -905,7 +990,7 @@ void benchmark_make_interval_heap_baseline(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -924,7 +1009,7 @@ void benchmark_make_pairing_heap_baseline(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     PairingHeap<int> heap;
     PairingHeap<int>::MemoryPool pool;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear(pool);
         for (int i = 0; i < num_items; ++i)
@@ -942,7 +1027,7 @@ void benchmark_make_pairing_pair_heap_baseline(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     PairingHeapPair<int> heap;
     PairingHeapPair<int>::MemoryPool pool;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear(pool);
         for (int i = 0; i < num_items; ++i)
@@ -961,7 +1046,7 @@ void benchmark_make_pairing_push_heap_baseline(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     PairingHeapMorePushWork<int, MergeInterval> heap;
     typename PairingHeapMorePushWork<int, MergeInterval>::MemoryPool pool;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear(pool);
         for (int i = 0; i < num_items; ++i)
@@ -979,7 +1064,7 @@ void benchmark_make_dary_heap_baseline(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> heap;
     heap.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         heap.clear();
         for (int i = 0; i < num_items; ++i)
@@ -1130,7 +1215,7 @@ void benchmark_min_element(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> data;
     data.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         data.clear();
         for (int i = 0; i < num_items; ++i)
@@ -1147,7 +1232,7 @@ void benchmark_min_element_four(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> data;
     data.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         data.clear();
         for (int i = 0; i < num_items; ++i)
@@ -1164,7 +1249,7 @@ void benchmark_min_element_branchy(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> data;
     data.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         data.clear();
         for (int i = 0; i < num_items; ++i)
@@ -1180,7 +1265,7 @@ void benchmark_min_element_parallel(skb::State & state)
     std::mt19937_64 & randomness = global_randomness;
     std::vector<int> data;
     data.reserve(num_items);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         data.clear();
         for (int i = 0; i < num_items; ++i)
@@ -1208,6 +1293,7 @@ void RegisterHeapBenchmarks()
         skb::CategoryBuilder push = builder.AddCategory("operation", "push");
         SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_heap_push, push.BuildCategories("heap", "std::heap"))->SetBaseline("benchmark_heap_baseline"));
         SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_std_multiset_push, push.BuildCategories("heap", "std::multiset"))->SetBaseline("benchmark_heap_baseline"));
+        SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_heap_push_with_payload, push.BuildCategories("heap", "std::heap with payload"))->SetBaseline("benchmark_heap_baseline"))->AddRange("payload bytes", 8, 128, 2.0);
         SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_minmax_heap_push, push.BuildCategories("heap", "minmax_heap"))->SetBaseline("benchmark_heap_baseline"));
         SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_interval_heap_push, push.BuildCategories("heap", "interval_heap"))->SetBaseline("benchmark_heap_baseline"));
         SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_push_dary_heap<2>, push.AddCategory("dary_heap d", "2").BuildCategories("heap", "dary_heap"))->SetBaseline("benchmark_heap_baseline"));
@@ -1253,6 +1339,7 @@ void RegisterHeapBenchmarks()
         SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_pop_interval_heap_min, pop.AddCategory("minmax pop", "min").BuildCategories("heap", "interval_heap"))->SetBaseline("benchmark_make_interval_heap_baseline"));
         SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_pop_interval_heap_max, pop.AddCategory("minmax pop", "max").BuildCategories("heap", "interval_heap"))->SetBaseline("benchmark_make_interval_heap_baseline"));
         SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_pop_heap, pop.BuildCategories("heap", "std::heap"))->SetBaseline("benchmark_make_heap_baseline"));
+        SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_pop_heap_each, pop.AddCategory("timed", "each pop").BuildCategories("heap", "std::heap"))->RecordLatencies());
         SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_pop_std_multiset, pop.BuildCategories("heap", "std::multiset"))->SetBaseline("benchmark_copy_std_multiset_baseline"));
         SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_pop_dary_heap<2>, pop.AddCategory("dary_heap d", "2").BuildCategories("heap", "dary_heap"))->SetBaseline("benchmark_make_dary_heap_baseline_2"));
         SetHeapRange(SKA_BENCHMARK_CATEGORIES(&benchmark_pop_dary_heap<3>, pop.AddCategory("dary_heap d", "3").BuildCategories("heap", "dary_heap"))->SetBaseline("benchmark_make_dary_heap_baseline_3"));
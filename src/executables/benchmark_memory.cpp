@@ -1,3 +1,4 @@
+#include <atomic>
 #include <random>
 #include <numeric>
 #include <vector>
@@ -15,7 +16,7 @@ void benchmark_random_memory_access(skb::State & state)
     std::vector<size_t> bytes(num_size_ts);
     std::iota(bytes.begin(), bytes.end(), size_t(100));
     std::uniform_int_distribution<size_t> random_index(0, num_size_ts - 1);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i = 0; i < num_loops; ++i)
             skb::DoNotOptimize(bytes[random_index(global_randomness)]);
@@ -39,7 +40,7 @@ void benchmark_memory_access_permutation(skb::State & state)
         }
     }
     size_t index = bytes[0];
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i = 0; i < num_loops; ++i)
         {
@@ -62,7 +63,7 @@ void benchmark_predictable_memory_access(skb::State & state)
     for (size_t & index : indices)
         index = random_index(global_randomness);
     size_t current_index = 0;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i = 0; i < num_loops; ++i)
         {
@@ -86,7 +87,7 @@ void benchmark_cache_miss(benchmark::State & state)
     std::vector<size_t> bytes = random_bytes(state.range(0));
     std::vector<size_t> indices = random_indices(bytes.size());
     size_t current_index = 0;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i = 0; i < 10000; ++i)
         {
@@ -103,7 +104,7 @@ void benchmark_cache_miss(benchmark::State & state)
     std::vector<size_t> bytes = random_bytes(state.range(0));
 
 
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i = 0; i < 10000; ++i)
         {
@@ -120,7 +121,7 @@ void benchmark_cache_miss(benchmark::State & state)
     std::vector<size_t> bytes = random_bytes(state.range(0));
     std::mt19937_64 randomness;
     std::uniform_int_distribution<size_t> distribution(0, bytes.size() - 1);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i = 0; i < 10000; ++i)
         {
@@ -137,7 +138,7 @@ void benchmark_cache_miss(benchmark::State & state)
     std::vector<size_t> bytes = random_bytes(state.range(0));
     std::mt19937_64 randomness;
     std::uniform_int_distribution<size_t> distribution(0, bytes.size() - 1);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i = 0; i < 10000; ++i)
         {
@@ -154,7 +155,7 @@ void benchmark_cache_miss(benchmark::State & state)
     std::vector<size_t> bytes = random_bytes(state.range(0));
     std::mt19937_64 randomness;
     std::uniform_int_distribution<size_t> distribution(0, bytes.size() - 1);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i = 0; i < 10000; ++i)
         {
@@ -172,7 +173,7 @@ void benchmark_sequential_memory_access(skb::State & state)
     size_t num_size_ts = state.range(0) / sizeof(size_t);
     std::vector<size_t> bytes(num_size_ts);
     std::iota(bytes.begin(), bytes.end(), size_t(100));
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i : bytes)
             skb::DoNotOptimize(i);
@@ -182,7 +183,7 @@ void benchmark_sequential_memory_access(skb::State & state)
 void benchmark_sequential_memory_access_baseline(skb::State & state)
 {
     size_t num_size_ts = state.range(0) / sizeof(size_t);
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i = 0; i < num_size_ts; ++i)
             skb::DoNotOptimize(i);
@@ -195,7 +196,7 @@ void benchmark_memory_access_baseline(skb::State & state)
     size_t num_size_ts = state.range(0) / sizeof(size_t);
     std::uniform_int_distribution<size_t> random_index(0, num_size_ts - 1);
 
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i = 0; i < num_loops; ++i)
             skb::DoNotOptimize(random_index(global_randomness));
@@ -211,7 +212,7 @@ void benchmark_predictable_memory_access_baseline(skb::State & state)
     for (size_t & index : indices)
         index = random_index(global_randomness);
     size_t current_index = 0;
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i = 0; i < num_loops; ++i)
         {
@@ -224,7 +225,7 @@ void benchmark_predictable_memory_access_baseline(skb::State & state)
 }
 void benchmark_memory_access_permutation_baseline(skb::State & state)
 {
-    while (state.KeepRunning())
+    for (auto _ : state)
     {
         for (size_t i = 0; i < num_loops; ++i)
         {
@@ -234,6 +235,64 @@ void benchmark_memory_access_permutation_baseline(skb::State & state)
     state.SetItemsProcessed(state.iterations() * num_loops);
 }
 
+// the same loop once with each loop API. the KeepRunning version is the baseline,
+// so the graph shows how much the range-for loop saves per iteration. that
+// difference should stay flat as the body of the loop gets bigger
+void benchmark_range_for_loop(skb::State & state)
+{
+    int64_t body_size = state.range(0);
+    for (auto _ : state)
+    {
+        for (int64_t i = 0; i < body_size; ++i)
+            skb::DoNotOptimize(i);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+void benchmark_keep_running_loop_baseline(skb::State & state)
+{
+    int64_t body_size = state.range(0);
+    while (state.KeepRunning())
+    {
+        for (int64_t i = 0; i < body_size; ++i)
+            skb::DoNotOptimize(i);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+// every thread increments the same counter, like memory_metrics does for every
+// allocation. the counters on separate cache lines show what the contention costs
+static std::atomic<size_t> shared_counter(0);
+void benchmark_shared_atomic_counter(skb::State & state)
+{
+    int64_t num_increments = state.range(0);
+    for (auto _ : state)
+    {
+        for (int64_t i = 0; i < num_increments; ++i)
+            shared_counter.fetch_add(1, std::memory_order_relaxed);
+    }
+    state.SetItemsProcessed(state.iterations() * num_increments);
+}
+struct alignas(64) PaddedCounter
+{
+    std::atomic<size_t> value{ 0 };
+};
+static PaddedCounter separate_counters[64];
+void benchmark_separate_atomic_counters(skb::State & state)
+{
+    int64_t num_increments = state.range(0);
+    std::atomic<size_t> & counter = separate_counters[state.thread_index() % 64].value;
+    for (auto _ : state)
+    {
+        for (int64_t i = 0; i < num_increments; ++i)
+            counter.fetch_add(1, std::memory_order_relaxed);
+    }
+    state.SetItemsProcessed(state.iterations() * num_increments);
+}
+SKA_BENCHMARK("atomic counter", benchmark_shared_atomic_counter)->SetRange(16, 1024)->SetRangeMultiplier(4.0)->SetThreads({ 1, 2, 4, 8 });
+SKA_BENCHMARK("atomic counter", benchmark_separate_atomic_counters)->SetRange(16, 1024)->SetRangeMultiplier(4.0)->SetThreads({ 1, 2, 4, 8 });
+
+SKA_BENCHMARK("baseline", benchmark_keep_running_loop_baseline);
+SKA_BENCHMARK("loop overhead", benchmark_range_for_loop)->SetBaseline("benchmark_keep_running_loop_baseline")->SetRange(1, 64)->SetRangeMultiplier(2.0);
+
 static constexpr int64_t memory_access_min = 2048;
 static constexpr int64_t memory_access_max = 4ll * 1024ll * 1024ll * 1024ll;
 SKA_BENCHMARK("baseline", benchmark_memory_access_baseline);
@@ -5,9 +5,26 @@
 
 namespace memory_metrics
 {
+// all sizes are what malloc_usable_size reports, so they include the padding
+// that the allocator rounds up to. that is what a container really costs
 extern std::atomic<size_t> allocations;
 extern std::atomic<size_t> frees;
 extern std::atomic<size_t> total_allocated;
+extern std::atomic<size_t> total_freed;
+// the most bytes that were live at once since the last ResetPeakLiveBytes()
+extern std::atomic<size_t> peak_live_bytes;
+
+inline size_t LiveBytes()
+{
+    // read the frees first so that a concurrent allocation and free can't make
+    // this wrap around
+    size_t freed = total_freed.load(std::memory_order_relaxed);
+    return total_allocated.load(std::memory_order_relaxed) - freed;
+}
+inline void ResetPeakLiveBytes()
+{
+    peak_live_bytes.store(LiveBytes(), std::memory_order_relaxed);
+}
 }
 
 #ifndef DISABLE_TESTS
@@ -1,5 +1,7 @@
 #include "memory/metrics.hpp"
 #include <cstdlib>
+#include <malloc.h>
+#include <new>
 
 
 namespace memory_metrics
@@ -7,24 +9,85 @@ namespace memory_metrics
 std::atomic<size_t> allocations(0);
 std::atomic<size_t> frees(0);
 std::atomic<size_t> total_allocated(0);
+std::atomic<size_t> total_freed(0);
+std::atomic<size_t> peak_live_bytes(0);
 }
 
 #if !defined(ADDRESS_SANITIZER_BUILD)
-void * operator new(size_t size)
+static void * CountAllocation(void * ptr)
 {
+    if (!ptr)
+        throw std::bad_alloc();
+    size_t size = malloc_usable_size(ptr);
     memory_metrics::allocations.fetch_add(1, std::memory_order_relaxed);
-    memory_metrics::total_allocated.fetch_add(size, std::memory_order_relaxed);
-    return malloc(size);
+    size_t live = memory_metrics::total_allocated.fetch_add(size, std::memory_order_relaxed) + size
+                - memory_metrics::total_freed.load(std::memory_order_relaxed);
+    size_t peak = memory_metrics::peak_live_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !memory_metrics::peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+    {
+    }
+    return ptr;
+}
+static void CountFree(void * ptr)
+{
+    memory_metrics::frees.fetch_add(1, std::memory_order_relaxed);
+    memory_metrics::total_freed.fetch_add(malloc_usable_size(ptr), std::memory_order_relaxed);
+}
+
+void * operator new(size_t size)
+{
+    return CountAllocation(malloc(size));
+}
+void * operator new[](size_t size)
+{
+    return CountAllocation(malloc(size));
+}
+void * operator new(size_t size, std::align_val_t alignment)
+{
+    void * result = nullptr;
+    if (posix_memalign(&result, static_cast<size_t>(alignment), size) != 0)
+        result = nullptr;
+    return CountAllocation(result);
+}
+void * operator new[](size_t size, std::align_val_t alignment)
+{
+    return ::operator new(size, alignment);
 }
 void operator delete(void * ptr) noexcept
 {
     if (!ptr)
         return;
-    memory_metrics::frees.fetch_add(1, std::memory_order_relaxed);
+    CountFree(ptr);
     free(ptr);
 }
+// the sized and aligned versions all come from malloc or posix_memalign, so
+// they can all be freed the same way
+void operator delete[](void * ptr) noexcept
+{
+    ::operator delete(ptr);
+}
 void operator delete(void * ptr, size_t) noexcept
 {
     ::operator delete(ptr);
 }
+void operator delete[](void * ptr, size_t) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete(void * ptr, std::align_val_t) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete[](void * ptr, std::align_val_t) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete(void * ptr, size_t, std::align_val_t) noexcept
+{
+    ::operator delete(ptr);
+}
+void operator delete[](void * ptr, size_t, std::align_val_t) noexcept
+{
+    ::operator delete(ptr);
+}
 #endif
@@ -0,0 +1,132 @@
+#include "thread/cpu_topology.hpp"
+#include <sched.h>
+#include <algorithm>
+#include <charconv>
+#include <fstream>
+#include <map>
+#include <string>
+
+static bool ParseInt(std::string_view str, int & to_fill)
+{
+    return std::from_chars(str.data(), str.data() + str.size(), to_fill).ec == std::errc();
+}
+
+std::vector<int> ParseCpuList(std::string_view list)
+{
+    std::vector<int> result;
+    while (!list.empty() && (list.back() == '\n' || list.back() == ' '))
+        list.remove_suffix(1);
+    while (!list.empty())
+    {
+        size_t comma = list.find(',');
+        std::string_view range = list.substr(0, comma);
+        list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+        size_t dash = range.find('-');
+        int first = 0;
+        int last = 0;
+        if (!ParseInt(range.substr(0, dash), first))
+            return {};
+        if (dash == std::string_view::npos)
+            last = first;
+        else if (!ParseInt(range.substr(dash + 1), last))
+            return {};
+        for (int i = first; i <= last; ++i)
+            result.push_back(i);
+    }
+    return result;
+}
+
+static bool ReadIntFromFile(const std::string & filename, int & to_fill)
+{
+    std::ifstream file(filename);
+    return bool(file >> to_fill);
+}
+
+std::vector<PhysicalCore> ReadCpuTopology()
+{
+    std::string cpu_directory = "/sys/devices/system/cpu/";
+    std::string online_list;
+    std::getline(std::ifstream(cpu_directory + "online"), online_list);
+    std::map<std::pair<int, int>, PhysicalCore> cores;
+    for (int cpu : ParseCpuList(online_list))
+    {
+        std::string topology = cpu_directory + "cpu" + std::to_string(cpu) + "/topology/";
+        int package = 0;
+        int core_id = 0;
+        if (!ReadIntFromFile(topology + "physical_package_id", package) || !ReadIntFromFile(topology + "core_id", core_id))
+            return {};
+        PhysicalCore & core = cores[{ package, core_id }];
+        core.package = package;
+        core.core_id = core_id;
+        core.logical_cpus.push_back(cpu);
+    }
+    std::vector<PhysicalCore> result;
+    for (auto & [_, core] : cores)
+    {
+        std::sort(core.logical_cpus.begin(), core.logical_cpus.end());
+        result.push_back(std::move(core));
+    }
+    return result;
+}
+
+const PhysicalCore * FindHousekeepingCore(const std::vector<PhysicalCore> & cores)
+{
+    auto found = std::find_if(cores.begin(), cores.end(), [](const PhysicalCore & core)
+    {
+        return core.logical_cpus.front() == 0;
+    });
+    return found == cores.end() ? nullptr : &*found;
+}
+
+std::vector<int> PickBenchmarkCpus(const std::vector<PhysicalCore> & cores, int max_count)
+{
+    const PhysicalCore * housekeeping = FindHousekeepingCore(cores);
+    std::vector<int> result;
+    for (const PhysicalCore & core : cores)
+    {
+        if (&core == housekeeping)
+            continue;
+        if (static_cast<int>(result.size()) >= max_count)
+            break;
+        result.push_back(core.logical_cpus.front());
+    }
+    return result;
+}
+
+bool PinCurrentThread(const std::vector<int> & logical_cpus)
+{
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : logical_cpus)
+        CPU_SET(cpu, &cpu_set);
+    // pid 0 means the calling thread. child processes inherit this
+    return sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0;
+}
+
+#ifndef DISABLE_GTEST
+#include "test/include_test.hpp"
+
+TEST(cpu_topology, parse_cpu_list)
+{
+    ASSERT_EQ(std::vector<int>({ 0 }), ParseCpuList("0\n"));
+    ASSERT_EQ(std::vector<int>({ 0, 1, 2, 3, 8, 10, 11 }), ParseCpuList("0-3,8,10-11"));
+    ASSERT_EQ(std::vector<int>(), ParseCpuList(""));
+    ASSERT_EQ(std::vector<int>(), ParseCpuList("a-b"));
+}
+
+TEST(cpu_topology, pick_benchmark_cpus)
+{
+    // two packages with two cores each, every core has two hyperthreads
+    std::vector<PhysicalCore> cores =
+    {
+        { 0, 0, { 0, 4 } },
+        { 0, 1, { 1, 5 } },
+        { 1, 0, { 2, 6 } },
+        { 1, 1, { 3, 7 } },
+    };
+    ASSERT_EQ(&cores[0], FindHousekeepingCore(cores));
+    ASSERT_EQ(std::vector<int>({ 1, 2, 3 }), PickBenchmarkCpus(cores, 64));
+    ASSERT_EQ(std::vector<int>({ 1, 2 }), PickBenchmarkCpus(cores, 2));
+    ASSERT_EQ(std::vector<int>(), PickBenchmarkCpus({ { 0, 0, { 0, 1 } } }, 64));
+}
+#endif
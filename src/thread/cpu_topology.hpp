@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include <string_view>
+
+struct PhysicalCore
+{
+    int package = 0;
+    int core_id = 0;
+    // the hyperthreads of this core. sorted, never empty
+    std::vector<int> logical_cpus;
+};
+
+// parses the format of /sys/devices/system/cpu/online, e.g. "0-3,8,10-11"
+std::vector<int> ParseCpuList(std::string_view list);
+
+// reads /sys/devices/system/cpu. returns an empty vector if the topology isn't available
+std::vector<PhysicalCore> ReadCpuTopology();
+
+// the core that cpu 0 is on. the GUI, the database and all other housekeeping runs there
+const PhysicalCore * FindHousekeepingCore(const std::vector<PhysicalCore> & cores);
+
+// one logical cpu per physical core, leaving out the housekeeping core. the
+// hyperthread siblings of the returned cpus are never handed out, so two
+// benchmarks never share the caches and execution units of one core
+std::vector<int> PickBenchmarkCpus(const std::vector<PhysicalCore> & cores, int max_count);
+
+bool PinCurrentThread(const std::vector<int> & logical_cpus);
@@ -0,0 +1,52 @@
+#include "util/indexed_heap.hpp"
+
+
+#ifndef DISABLE_TESTS
+#include "test/include_test.hpp"
+#include <random>
+
+TEST(indexed_dary_heap, top_is_largest)
+{
+    indexed_dary_heap<4, int, int> heap;
+    for (int i = 0; i < 10; ++i)
+        heap.set(i, (i * 7) % 10);
+    ASSERT_TRUE(heap.is_valid());
+    ASSERT_EQ(10u, heap.size());
+    ASSERT_EQ(7, heap.top().key);
+    ASSERT_EQ(9, heap.top().priority);
+    heap.pop();
+    ASSERT_EQ(4, heap.top().key);
+    ASSERT_EQ(nullptr, heap.find(7));
+    ASSERT_EQ(1, *heap.find(3));
+}
+
+TEST(indexed_dary_heap, change_priorities)
+{
+    std::mt19937 randomness(5);
+    std::uniform_int_distribution<int> distribution(0, 99);
+    indexed_dary_heap<4, int, int> heap;
+    std::vector<int> priorities(100, -1);
+    for (int i = 0; i < 2000; ++i)
+    {
+        int key = distribution(randomness);
+        if (i % 5 == 4)
+        {
+            heap.erase(key);
+            priorities[key] = -1;
+        }
+        else
+        {
+            int priority = distribution(randomness);
+            heap.set(key, priority);
+            priorities[key] = priority;
+        }
+        ASSERT_TRUE(heap.is_valid());
+        int largest = *std::max_element(priorities.begin(), priorities.end());
+        if (largest == -1)
+            ASSERT_TRUE(heap.empty());
+        else
+            ASSERT_EQ(largest, heap.top().priority);
+    }
+}
+
+#endif
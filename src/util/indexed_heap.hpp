@@ -0,0 +1,168 @@
+#pragma once
+
+#include "util/heap.hpp"
+#include "container/flat_hash_map.hpp"
+#include <functional>
+#include <vector>
+
+// a d-ary heap of keys with priorities that remembers where every key is, so
+// that the priority of any key can go up or down, or the key can be removed,
+// in O(log n) without searching for it. like the other heaps in heap.hpp this
+// is a max heap: compare is a less than, and the top is the largest priority
+template<int D, typename Key, typename Priority, typename Compare = std::less<>, typename Hash = std::hash<Key>>
+class indexed_dary_heap
+{
+public:
+    struct item
+    {
+        Key key;
+        Priority priority;
+    };
+
+    explicit indexed_dary_heap(Compare compare = Compare())
+        : compare(std::move(compare))
+    {
+    }
+
+    bool empty() const
+    {
+        return items.empty();
+    }
+    size_t size() const
+    {
+        return items.size();
+    }
+    const item & top() const
+    {
+        return items.front();
+    }
+    // nullptr if the key isn't in the heap
+    const Priority * find(const Key & key) const
+    {
+        auto found = positions.find(key);
+        if (found == positions.end())
+            return nullptr;
+        return &items[found->second].priority;
+    }
+
+    // inserts the key, or moves it to its new place if it's already there
+    void set(const Key & key, Priority priority)
+    {
+        auto found = positions.find(key);
+        if (found == positions.end())
+        {
+            size_t index = items.size();
+            positions.emplace(key, index);
+            items.push_back({ key, std::move(priority) });
+            sift_up(index);
+        }
+        else
+        {
+            size_t index = found->second;
+            items[index].priority = std::move(priority);
+            if (!sift_up(index))
+                sift_down(index);
+        }
+    }
+    void erase(const Key & key)
+    {
+        auto found = positions.find(key);
+        if (found == positions.end())
+            return;
+        size_t index = found->second;
+        positions.erase(found);
+        if (index + 1 == items.size())
+        {
+            items.pop_back();
+            return;
+        }
+        items[index] = std::move(items.back());
+        items.pop_back();
+        positions[items[index].key] = index;
+        if (!sift_up(index))
+            sift_down(index);
+    }
+    void pop()
+    {
+        Key key = items.front().key;
+        erase(key);
+    }
+    void clear()
+    {
+        items.clear();
+        positions.clear();
+    }
+
+    bool is_valid() const
+    {
+        if (positions.size() != items.size())
+            return false;
+        for (size_t i = 0; i < items.size(); ++i)
+        {
+            auto found = positions.find(items[i].key);
+            if (found == positions.end() || found->second != i)
+                return false;
+        }
+        return is_dary_heap<D>(items.begin(), items.end(), item_compare());
+    }
+
+private:
+    auto item_compare() const
+    {
+        return [this](const item & a, const item & b)
+        {
+            return compare(a.priority, b.priority);
+        };
+    }
+    void move_to(size_t index, item && value)
+    {
+        positions[value.key] = index;
+        items[index] = std::move(value);
+    }
+    // returns whether the item moved
+    bool sift_up(size_t index)
+    {
+        if (index == 0)
+            return false;
+        size_t parent = dary_heap_helpers::parent_index<D>(index);
+        if (!compare(items[parent].priority, items[index].priority))
+            return false;
+        item value = std::move(items[index]);
+        do
+        {
+            move_to(index, std::move(items[parent]));
+            index = parent;
+            if (index == 0)
+                break;
+            parent = dary_heap_helpers::parent_index<D>(index);
+        }
+        while (compare(items[parent].priority, value.priority));
+        move_to(index, std::move(value));
+        return true;
+    }
+    void sift_down(size_t index)
+    {
+        size_t length = items.size();
+        auto less = item_compare();
+        item value = std::move(items[index]);
+        for (;;)
+        {
+            size_t first_child = dary_heap_helpers::first_child_index<D>(index);
+            if (first_child >= length)
+                break;
+            auto largest_child = first_child + D <= length
+                ? dary_heap_helpers::largest_child<D>(items.begin() + first_child, less)
+                : dary_heap_helpers::largest_child<D>(items.begin() + first_child, static_cast<int>(length - first_child), less);
+            if (!compare(value.priority, largest_child->priority))
+                break;
+            size_t child = largest_child - items.begin();
+            move_to(index, std::move(*largest_child));
+            index = child;
+        }
+        move_to(index, std::move(value));
+    }
+
+    std::vector<item> items;
+    ska::flat_hash_map<Key, size_t, Hash> positions;
+    Compare compare;
+};